@@ -0,0 +1,208 @@
+// Page-table address decoder for device-backed guest memories
+//
+// The 32-bit guest space is split into 64 KiB pages, and one table entry per
+// page holds either a host pointer (RAM and ROM) or the device that owns the
+// page.  Decoding an access is one indexed load whatever the number of
+// devices, and a RAM hit goes straight to host memory.  Devices register the
+// region they decode, and their callbacks get the offset into that region.
+// Accesses to unregistered addresses read 0 and writes are dropped.
+//
+// RAM regions must start and end on a page boundary; device regions may be
+// smaller than a page (the rest of the page stays unmapped) and may overlap,
+// in which case the device registered last decodes the shared addresses.
+// AddressMap also has the bus interface of memory_subsystem.h, so
+// CPU<AddressMap> works.
+
+#ifndef ADDRESS_MAP_H
+#define ADDRESS_MAP_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "host_ram.h"
+
+class AddressMap {
+public:
+    // Device callbacks see the offset into the device's region and the access
+    // size in bytes (1, 2 or 4)
+    using ReadFn  = std::function<uint32_t(uint32_t offset, uint32_t size)>;
+    using WriteFn = std::function<void(uint32_t offset, uint32_t value, uint32_t size)>;
+
+    static constexpr uint32_t PAGE_SHIFT = 16;
+    static constexpr uint32_t PAGE_SIZE  = 1u << PAGE_SHIFT;
+    static constexpr uint32_t PAGE_MASK  = PAGE_SIZE - 1;
+
+    AddressMap() : pages(new Page[1u << (32 - PAGE_SHIFT)]()) {}
+
+    // Maps size bytes of host memory at guest address base
+    bool add_ram(uint32_t base, uint8_t* host, uint64_t size) {
+        if ((base | size) & PAGE_MASK || base + size > (1ull << 32)) return false;
+        for (uint64_t off = 0; off < size; off += PAGE_SIZE) {
+            Page& p = pages[(base + off) >> PAGE_SHIFT];
+            p.host = host + off;
+            p.dev = nullptr;
+        }
+        ram.push_back({base, size});
+        return true;
+    }
+
+    void add_device(const char* name, uint32_t base, uint32_t size, ReadFn read, WriteFn write) {
+        devices.emplace_back(new Device{name, base, size, std::move(read), std::move(write)});
+        for (uint64_t a = base & ~PAGE_MASK; a < uint64_t(base) + size; a += PAGE_SIZE) {
+            Page& p = pages[a >> PAGE_SHIFT];
+            p.host = nullptr;
+            p.dev = devices.back().get();
+        }
+    }
+
+    // ─── Accesses ──────────────────────────────────────────────────────────────
+    uint32_t fetch32(uint32_t addr) {
+        const Page& p = pages[addr >> PAGE_SHIFT];
+        uint32_t off = addr & PAGE_MASK;
+        if (p.host && off <= PAGE_SIZE - 4) {
+            const uint8_t* h = p.host + off;
+            return h[0] | (h[1]<<8) | (h[2]<<16) | (h[3]<<24);
+        }
+        return slow_read(addr, 4);
+    }
+
+    uint16_t fetch16(uint32_t addr) {
+        const Page& p = pages[addr >> PAGE_SHIFT];
+        uint32_t off = addr & PAGE_MASK;
+        if (p.host && off <= PAGE_SIZE - 2) return p.host[off] | (p.host[off+1]<<8);
+        return slow_read(addr, 2);
+    }
+
+    uint8_t fetch8(uint32_t addr) {
+        const Page& p = pages[addr >> PAGE_SHIFT];
+        if (p.host) return p.host[addr & PAGE_MASK];
+        return slow_read(addr, 1);
+    }
+
+    void store32(uint32_t addr, uint32_t v) {
+        const Page& p = pages[addr >> PAGE_SHIFT];
+        uint32_t off = addr & PAGE_MASK;
+        if (p.host && off <= PAGE_SIZE - 4) {
+            uint8_t* h = p.host + off;
+            h[0] = v;
+            h[1] = v >> 8;
+            h[2] = v >> 16;
+            h[3] = v >> 24;
+            return;
+        }
+        slow_write(addr, v, 4);
+    }
+
+    void store16(uint32_t addr, uint16_t v) {
+        const Page& p = pages[addr >> PAGE_SHIFT];
+        uint32_t off = addr & PAGE_MASK;
+        if (p.host && off <= PAGE_SIZE - 2) {
+            p.host[off]   = v;
+            p.host[off+1] = v >> 8;
+            return;
+        }
+        slow_write(addr, v, 2);
+    }
+
+    void store8(uint32_t addr, uint8_t v) {
+        const Page& p = pages[addr >> PAGE_SHIFT];
+        if (p.host) {
+            p.host[addr & PAGE_MASK] = v;
+            return;
+        }
+        slow_write(addr, v, 1);
+    }
+
+    // Copies an image into RAM; it may span several regions, but not holes
+    bool load_binary(const uint8_t* data, size_t size, uint32_t load_addr = 0) {
+        if (!mapped(load_addr, size)) return false;
+        for (size_t i = 0; i < size; i++) store8(load_addr + i, data[i]);
+        return true;
+    }
+
+    // The host memory behind the regions belongs to the caller, so images
+    // are copied
+    bool load_image(const FileImage& img, uint32_t load_addr = 0) {
+        return load_binary(img.data(), img.size(), load_addr);
+    }
+
+    // True if every byte of [addr, addr + size) is RAM
+    bool mapped(uint32_t addr, uint64_t size) const {
+        for (const Region& r : ram)
+            if (addr >= r.base && addr - r.base + size <= r.size) return true;
+        return false;
+    }
+
+    // Host address of RAM at addr, len cut to the pages after it that are
+    // RAM and follow on in host memory
+    uint8_t* span(uint32_t addr, uint32_t& len) const {
+        const Page& first = pages[addr >> PAGE_SHIFT];
+        if (!first.host) return nullptr;
+        uint8_t* host = first.host + (addr & PAGE_MASK);
+        uint64_t end = (uint64_t(addr) | PAGE_MASK) + 1;
+        while (end < uint64_t(addr) + len && end < (1ull << 32) &&
+               pages[end >> PAGE_SHIFT].host == host + (end - addr))
+            end += PAGE_SIZE;
+        len = uint32_t(std::min<uint64_t>(len, end - addr));
+        return host;
+    }
+
+    uint8_t* data() { return nullptr; }
+    uint64_t size() const { return 1ull << 32; }
+
+private:
+    struct Device {
+        const char* name;
+        uint32_t base, size;
+        ReadFn read;
+        WriteFn write;
+    };
+    struct Page {
+        uint8_t* host;       // host address of the page if it is RAM
+        const Device* dev;   // otherwise the device that decodes it, if any
+    };
+    struct Region { uint32_t base; uint64_t size; };
+
+    std::unique_ptr<Page[]> pages;
+    std::vector<std::unique_ptr<Device>> devices;
+    std::vector<Region> ram;
+
+    // The page's device if it covers addr, else (on a page shared by several
+    // devices) the last registered one that does
+    const Device* device_at(const Page& p, uint32_t addr) const {
+        if (addr - p.dev->base < p.dev->size) return p.dev;
+        for (auto d = devices.rbegin(); d != devices.rend(); ++d)
+            if (addr - (*d)->base < (*d)->size) return d->get();
+        return nullptr;
+    }
+
+    // Device accesses, accesses outside any region, and RAM accesses that
+    // straddle a page boundary
+    uint32_t slow_read(uint32_t addr, uint32_t size) {
+        const Page& p = pages[addr >> PAGE_SHIFT];
+        if (p.dev) {
+            const Device* d = device_at(p, addr);
+            return d && d->read ? d->read(addr - d->base, size) : 0;
+        }
+        if (!p.host) return 0;
+        uint32_t v = 0;
+        for (uint32_t i = 0; i < size; i++) v |= uint32_t(fetch8(addr + i)) << (8 * i);
+        return v;
+    }
+
+    void slow_write(uint32_t addr, uint32_t v, uint32_t size) {
+        const Page& p = pages[addr >> PAGE_SHIFT];
+        if (p.dev) {
+            const Device* d = device_at(p, addr);
+            if (d && d->write) d->write(addr - d->base, v, size);
+            return;
+        }
+        if (!p.host) return;
+        for (uint32_t i = 0; i < size; i++) store8(addr + i, v >> (8 * i));
+    }
+};
+
+#endif // ADDRESS_MAP_H
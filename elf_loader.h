@@ -0,0 +1,171 @@
+// ELF32 RISC-V executable loader
+//
+// ElfFile reads the program headers and the symbol table of a statically
+// linked little-endian RV32 executable mapped as a FileImage (host_ram.h).
+// load() places every PT_LOAD segment at its load address (p_paddr, the LMA
+// objcopy -O binary lays out), and when the segment runs from somewhere else
+// (p_vaddr, like .data copied from ROM to RAM by start.S) at that address as
+// well.  The bytes between p_filesz and p_memsz (.bss) are zeroed at the run
+// address.  Segment data goes through the bus's load_image, so memories that
+// can map it place the file pages copy-on-write.
+//
+// The symbol table (functions, objects and labels, sorted by address) is
+// kept for profilers and diagnostics: describe(pc) gives "name+0x1c".
+
+#ifndef ELF_LOADER_H
+#define ELF_LOADER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "host_ram.h"
+
+class ElfFile {
+public:
+  struct Segment {
+    uint32_t offset;   // in the file
+    uint32_t paddr;    // load address
+    uint32_t vaddr;    // run address
+    uint32_t filesz, memsz;
+  };
+  struct Symbol {
+    uint32_t addr, size;
+    std::string name;
+  };
+
+  uint32_t entry = 0;
+  uint32_t phoff = 0, phentsize = 0, phnum = 0;   // program header table in the file
+  std::vector<Segment> segments;
+  std::vector<Symbol> symbols;   // sorted by address
+
+  // True if data starts with the ELF magic
+  static bool is_elf(const FileImage& f) {
+    return f.size() >= 4 && !memcmp(f.data(), "\177ELF", 4);
+  }
+
+  // Reads the headers and symbols of f; false with error set if f is not an
+  // RV32 executable this loader can place
+  bool parse(const FileImage& f, std::string& error) {
+    const uint8_t* d = f.data();
+    size_t n = f.size();
+    if (!is_elf(f) || n < 52) return fail(error, "not an ELF file");
+    if (d[4] != 1 || d[5] != 1) return fail(error, "not a 32-bit little-endian ELF file");
+    if (u16(d + 18) != EM_RISCV) return fail(error, "not a RISC-V ELF file");
+    if (u16(d + 16) != ET_EXEC) return fail(error, "not a statically linked executable");
+    entry = u32(d + 24);
+
+    phoff = u32(d + 28), phentsize = u16(d + 42), phnum = u16(d + 44);
+    if (phentsize < 32 || uint64_t(phoff) + uint64_t(phnum) * phentsize > n)
+      return fail(error, "truncated program headers");
+    segments.clear();
+    for (uint32_t i = 0; i < phnum; i++) {
+      const uint8_t* ph = d + phoff + i * phentsize;
+      if (u32(ph) != PT_LOAD || !u32(ph + 20)) continue;
+      Segment s{u32(ph + 4), u32(ph + 12), u32(ph + 8), u32(ph + 16), u32(ph + 20)};
+      if (s.filesz > s.memsz || uint64_t(s.offset) + s.filesz > n)
+        return fail(error, "segment outside the file");
+      segments.push_back(s);
+    }
+
+    symbols.clear();
+    uint32_t shoff = u32(d + 32), shentsize = u16(d + 46), shnum = u16(d + 48);
+    if (shentsize < 40 || uint64_t(shoff) + uint64_t(shnum) * shentsize > n) return true;
+    for (uint32_t i = 0; i < shnum; i++) {
+      const uint8_t* sh = d + shoff + i * shentsize;
+      if (u32(sh + 4) != SHT_SYMTAB) continue;
+      uint32_t link = u32(sh + 24);
+      if (link >= shnum) break;
+      const uint8_t* strh = d + shoff + link * shentsize;
+      read_symbols(d, n, u32(sh + 16), u32(sh + 20), u32(strh + 16), u32(strh + 20));
+      break;
+    }
+    return true;
+  }
+
+  // Places the segments in mem; false if one does not fit
+  template <class Bus>
+  bool load(Bus& mem, const FileImage& f) const {
+    for (const Segment& s : segments) {
+      FileImage part(f, s.offset, s.filesz);
+      if (s.filesz && !mem.load_image(part, s.paddr)) return false;
+      if (s.vaddr != s.paddr && s.filesz && !mem.load_image(part, s.vaddr)) return false;
+      if (!zero(mem, s.vaddr + s.filesz, s.memsz - s.filesz)) return false;
+    }
+    return true;
+  }
+
+  // Guest address of the program header table (the auxiliary vector's
+  // AT_PHDR), or 0 if no segment loads it
+  uint32_t phdr_addr() const {
+    for (const Segment& s : segments)
+      if (phoff >= s.offset && phoff - s.offset + phnum * phentsize <= s.filesz) return s.vaddr + (phoff - s.offset);
+    return 0;
+  }
+
+  // First address past every segment, where a process's heap starts
+  uint32_t end() const {
+    uint32_t e = 0;
+    for (const Segment& s : segments) e = std::max(e, s.vaddr + s.memsz);
+    return e;
+  }
+
+  // "symbol+0xoffset" for addr, or "" outside every known symbol
+  std::string describe(uint32_t addr) const {
+    auto it = std::upper_bound(symbols.begin(), symbols.end(), addr,
+                               [](uint32_t a, const Symbol& s) { return a < s.addr; });
+    if (it == symbols.begin()) return "";
+    --it;
+    if (it->size && addr - it->addr >= it->size) return "";
+    char off[16];
+    snprintf(off, sizeof off, "+0x%x", addr - it->addr);
+    return it->name + (addr == it->addr ? "" : off);
+  }
+
+private:
+  static constexpr uint16_t ET_EXEC = 2, EM_RISCV = 243;
+  static constexpr uint32_t PT_LOAD = 1, SHT_SYMTAB = 2;
+
+  static uint16_t u16(const uint8_t* p) { return p[0] | p[1] << 8; }
+  static uint32_t u32(const uint8_t* p) { return p[0] | p[1] << 8 | p[2] << 16 | uint32_t(p[3]) << 24; }
+
+  static bool fail(std::string& error, const char* why) {
+    error = why;
+    return false;
+  }
+
+  // Functions, objects and untyped labels defined in some section, minus the
+  // $x/$d mapping symbols
+  void read_symbols(const uint8_t* d, size_t n, uint32_t off, uint32_t size, uint32_t stroff, uint32_t strsize) {
+    if (uint64_t(off) + size > n || uint64_t(stroff) + strsize > n) return;
+    for (uint32_t at = off; at + 16 <= off + size; at += 16) {
+      const uint8_t* st = d + at;
+      uint32_t name = u32(st), type = st[12] & 0xf, shndx = u16(st + 14);
+      if (type > 2 || !shndx || shndx >= 0xff00 || !name || name >= strsize) continue;
+      const char* s = reinterpret_cast<const char*>(d + stroff + name);
+      size_t len = strnlen(s, strsize - name);
+      if (!len || s[0] == '$') continue;
+      symbols.push_back({u32(st + 4), u32(st + 8), std::string(s, len)});
+    }
+    std::sort(symbols.begin(), symbols.end(),
+              [](const Symbol& a, const Symbol& b) { return a.addr < b.addr; });
+  }
+
+  // Zeroes [addr, addr + size) in mem, skipping words that already are zero
+  // so untouched RAM pages stay unallocated
+  template <class Bus>
+  static bool zero(Bus& mem, uint32_t addr, uint32_t size) {
+    if (!size) return true;
+    if (!mem.mapped(addr, size)) return false;
+    uint32_t end = addr + size;
+    for (; addr < end && (addr & 3); addr++) mem.store8(addr, 0);
+    for (; addr + 4 <= end; addr += 4)
+      if (mem.fetch32(addr)) mem.store32(addr, 0);
+    for (; addr < end; addr++) mem.store8(addr, 0);
+    return true;
+  }
+};
+
+#endif // ELF_LOADER_H
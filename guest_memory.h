@@ -0,0 +1,370 @@
+// Guard-page backed guest address space (x86-64 Linux hosts)
+//
+// GuestMemory reserves the whole 4 GiB guest address range as one PROT_NONE
+// host mapping and maps RAM and ROM regions into it at their guest addresses.
+// A guest load or store is then a single host instruction at base + addr,
+// with no bounds check and no address folding.
+//
+// Every other access faults.  The SIGSEGV handler decodes the faulting host
+// instruction, hands the access to the device registered for that address
+// (wild loads read 0, wild stores and stores to ROM are silently dropped, as
+// with BasicMemory), writes the loaded value back to the host register and resumes
+// after the instruction.  It understands the plain moves emitted by the
+// load/store helpers below and by the JIT (mov, movzx, movsx; 8, 16 and 32
+// bits), so guest memory must only be touched through them while devices or
+// holes can be hit.  Faults anywhere else go to the previous handler.
+//
+// Device callbacks therefore run inside the SIGSEGV handler.  The signal is
+// synchronous: it is raised on the thread doing the guest access, by one of
+// those helpers or by JIT code, never from inside libc or another library.
+// That makes ordinary code (stdio, malloc, locks) usable in a callback, with
+// these limits:
+//   - it must not take a lock the faulting thread may hold around its guest
+//     accesses, which would deadlock instead of blocking;
+//   - it must not throw or longjmp: the handler has to return so that the
+//     instruction can be completed and skipped;
+//   - it must not itself touch guest addresses that fault.
+// The handler keeps errno for the interrupted code.
+
+#ifndef GUEST_MEMORY_H
+#define GUEST_MEMORY_H
+
+#if !defined(__x86_64__) || !defined(__linux__)
+#error "guest_memory.h needs an x86-64 Linux host"
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <vector>
+#include <signal.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include "host_ram.h"
+
+class GuestMemory {
+public:
+  // Device callbacks see the offset into the device's region and the access
+  // size in bytes (as in address_map.h).  They run in the fault handler; see
+  // the top of this file for what they may do.
+  using ReadFn  = std::function<uint32_t(uint32_t offset, uint32_t size)>;
+  using WriteFn = std::function<void(uint32_t offset, uint32_t value, uint32_t size)>;
+
+  static constexpr uint64_t SPAN  = 1ull << 32;
+  static constexpr uint64_t GUARD = 1u << 16;   // catches accesses running past 0xffffffff
+  static constexpr int MAX_SPACES = 16;          // GuestMemory objects alive at a time
+
+  // Reserves the address space; ram_size bytes of RAM at guest address 0
+  explicit GuestMemory(size_t ram_size = 0) {
+    void* p = mmap(nullptr, SPAN + GUARD, PROT_NONE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) {
+      perror("GuestMemory: cannot reserve 4 GiB of address space");
+      abort();
+    }
+    base = static_cast<uint8_t*>(p);
+    install();
+    if (ram_size && !map(0, ram_size)) abort();
+  }
+
+  ~GuestMemory() {
+    for (int i = 0; i < MAX_SPACES; i++) {
+      GuestMemory* self = this;
+      if (spaces()[i].compare_exchange_strong(self, nullptr)) break;
+    }
+    munmap(base, SPAN + GUARD);
+  }
+
+  GuestMemory(const GuestMemory&) = delete;
+  GuestMemory& operator=(const GuestMemory&) = delete;
+
+  // Makes [addr, addr + size) ordinary memory (zero-filled); ROM is mapped
+  // read-only, so guest stores to it fault and are dropped
+  bool map(uint32_t addr, uint64_t size, bool writable = true) {
+    uint64_t lo = addr & ~uint64_t(PAGE - 1), hi = (uint64_t(addr) + size + PAGE - 1) & ~uint64_t(PAGE - 1);
+    if (hi > SPAN || mprotect(base + lo, hi - lo, writable ? PROT_READ | PROT_WRITE : PROT_READ)) {
+      fprintf(stderr, "GuestMemory: cannot map 0x%08x-0x%08llx\n", addr, (unsigned long long)hi);
+      return false;
+    }
+    HostRam::advise(base + lo, hi - lo, HostRam::defaults());
+    regions.push_back({uint32_t(lo), hi - lo, writable});
+    return true;
+  }
+
+  // Zeroes every mapped region (the pages go back to the host, and file
+  // pages placed by load_image are dropped)
+  void clear() {
+    for (const Region& r : regions) {
+      mmap(base + r.addr, r.size, r.writable ? PROT_READ | PROT_WRITE : PROT_READ,
+           MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0);
+      HostRam::advise(base + r.addr, r.size, HostRam::defaults());
+    }
+  }
+
+  // Accesses to unmapped addresses in [addr, addr + size) go to the device;
+  // where regions overlap, the device registered last decodes them
+  void add_device(const char* name, uint32_t addr, uint32_t size, ReadFn read, WriteFn write) {
+    devices.push_back({name, addr, size, std::move(read), std::move(write)});
+  }
+
+  // Copies an image into mapped memory (ROM included)
+  bool load_binary(const uint8_t* data, size_t size, uint32_t addr = 0) {
+    const Region* r = region_at(addr, size);
+    if (!r) return false;
+    if (!r->writable) mprotect(base + r->addr, r->size, PROT_READ | PROT_WRITE);
+    memcpy(base + addr, data, size);
+    if (!r->writable) mprotect(base + r->addr, r->size, PROT_READ);
+    return true;
+  }
+
+  // Maps a program file copy-on-write where it fits a mapped region (stores
+  // to ROM still fault), else copies it
+  bool load_image(const FileImage& img, uint32_t addr = 0) {
+    const Region* r = region_at(addr, img.size());
+    if (!r) return false;
+    return img.map_to(base + addr, r->writable ? PROT_READ | PROT_WRITE : PROT_READ) ||
+           load_binary(img.data(), img.size(), addr);
+  }
+
+  // True if [addr, addr + size) is mapped memory (not a device or a hole)
+  bool mapped(uint32_t addr, uint32_t size) const { return region_at(addr, size) != nullptr; }
+
+  // Host address of mapped memory at addr, len cut to the regions that
+  // follow on from there without a hole
+  uint8_t* span(uint32_t addr, uint32_t& len) const {
+    uint64_t end = addr;
+    for (const Region* r; end < uint64_t(addr) + len && (r = region_at(uint32_t(end), 1)); end = r->addr + r->size) {}
+    if (end == addr) return nullptr;
+    len = uint32_t(std::min<uint64_t>(len, end - addr));
+    return base + addr;
+  }
+
+  // Bus interface of memory_subsystem.h: the whole space is directly
+  // addressable, holes and devices included
+  uint8_t* data() const { return base; }
+  uint64_t size() const { return SPAN; }
+
+  // ─── Guest accesses: one host instruction each ─────────────────────────────
+  uint32_t fetch8(uint32_t addr) const {
+    uint32_t v; asm volatile("movzbl %1, %0" : "=r"(v) : "m"(*(const u8*)(base + addr))); return v;
+  }
+  uint32_t fetch16(uint32_t addr) const {
+    uint32_t v; asm volatile("movzwl %1, %0" : "=r"(v) : "m"(*(const u16*)(base + addr))); return v;
+  }
+  uint32_t fetch32(uint32_t addr) const {
+    uint32_t v; asm volatile("movl %1, %0" : "=r"(v) : "m"(*(const u32*)(base + addr))); return v;
+  }
+  void store8(uint32_t addr, uint32_t v) {
+    asm volatile("movb %b1, %0" : "=m"(*(u8*)(base + addr)) : "r"(v));
+  }
+  void store16(uint32_t addr, uint32_t v) {
+    asm volatile("movw %w1, %0" : "=m"(*(u16*)(base + addr)) : "r"(v));
+  }
+  void store32(uint32_t addr, uint32_t v) {
+    asm volatile("movl %1, %0" : "=m"(*(u32*)(base + addr)) : "r"(v));
+  }
+
+private:
+  typedef uint8_t  __attribute__((may_alias)) u8;
+  typedef uint16_t __attribute__((may_alias)) u16;
+  typedef uint32_t __attribute__((may_alias)) u32;
+
+  static constexpr uint64_t PAGE = 4096;
+
+  struct Region { uint32_t addr; uint64_t size; bool writable; };
+  struct Device { const char* name; uint32_t addr, size; ReadFn read; WriteFn write; };
+
+  uint8_t* base = nullptr;
+  std::vector<Region> regions;
+  std::vector<Device> devices;
+
+  const Region* region_at(uint32_t addr, uint64_t size) const {
+    for (const Region& r : regions)
+      if (addr >= r.addr && addr - r.addr + size <= r.size) return &r;
+    return nullptr;
+  }
+  const Device* device_at(uint32_t addr) const {
+    for (auto d = devices.rbegin(); d != devices.rend(); ++d)
+      if (addr - d->addr < d->size) return &*d;
+    return nullptr;
+  }
+
+  // Accesses the fault handler could not satisfy from RAM.  Nothing is
+  // printed: this runs in the signal handler, and a guest may hit a hole in
+  // a loop.
+  uint32_t fault_load(uint32_t addr, uint32_t size) const {
+    const Device* d = device_at(addr);
+    return d && d->read ? d->read(addr - d->addr, size) : 0;
+  }
+  void fault_store(uint32_t addr, uint32_t value, uint32_t size) {
+    const Device* d = device_at(addr);
+    if (d && d->write) d->write(addr - d->addr, value, size);
+  }
+
+  // ─── SIGSEGV handling ──────────────────────────────────────────────────────
+  static std::atomic<GuestMemory*>* spaces() {
+    static std::atomic<GuestMemory*> s[MAX_SPACES];
+    return s;
+  }
+  static struct sigaction& previous() {
+    static struct sigaction old;
+    return old;
+  }
+
+  void install() {
+    static bool installed = [] {
+      struct sigaction sa;
+      memset(&sa, 0, sizeof sa);
+      sa.sa_sigaction = on_fault;
+      sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+      sigemptyset(&sa.sa_mask);
+      return sigaction(SIGSEGV, &sa, &previous()) == 0;
+    }();
+    (void)installed;
+    for (int i = 0; i < MAX_SPACES; i++) {
+      GuestMemory* none = nullptr;
+      if (spaces()[i].compare_exchange_strong(none, this)) return;
+    }
+    fprintf(stderr, "GuestMemory: too many address spaces\n");
+    abort();
+  }
+
+  static void on_fault(int sig, siginfo_t* si, void* context) {
+    uint8_t* at = static_cast<uint8_t*>(si->si_addr);
+    greg_t* g = static_cast<ucontext_t*>(context)->uc_mcontext.gregs;
+    for (int i = 0; i < MAX_SPACES; i++) {
+      GuestMemory* m = spaces()[i].load(std::memory_order_acquire);
+      if (!m || at < m->base || at >= m->base + SPAN + GUARD) continue;
+      HostAccess a;
+      if (!decode(reinterpret_cast<const uint8_t*>(g[REG_RIP]), g, a)) break;
+      int saved_errno = errno;   // device callbacks may call into libc
+      m->emulate(a, g);
+      errno = saved_errno;
+      g[REG_RIP] += a.len;
+      return;
+    }
+    // Not a guest access: let the previous handler (or the default action,
+    // once the instruction faults again) deal with it
+    const struct sigaction& old = previous();
+    if (old.sa_flags & SA_SIGINFO) old.sa_sigaction(sig, si, context);
+    else if (old.sa_handler != SIG_DFL && old.sa_handler != SIG_IGN) old.sa_handler(sig);
+    else signal(SIGSEGV, SIG_DFL);
+  }
+
+  // A decoded host load or store
+  struct HostAccess {
+    uint64_t ea;          // effective address
+    uint32_t len;         // instruction length
+    uint32_t size;        // access size in bytes (1, 2, 4 or 8)
+    uint32_t dest_bits;   // width of the register a load writes
+    int reg;              // register loaded or stored; -1 for an immediate store
+    bool store, sign, high8, wide;   // wide: REX.W
+    uint32_t imm;
+  };
+
+  static greg_t& host_reg(greg_t* g, int r) {
+    static const int map[16] = {
+      REG_RAX, REG_RCX, REG_RDX, REG_RBX, REG_RSP, REG_RBP, REG_RSI, REG_RDI,
+      REG_R8, REG_R9, REG_R10, REG_R11, REG_R12, REG_R13, REG_R14, REG_R15,
+    };
+    return g[map[r]];
+  }
+
+  static bool decode(const uint8_t* ip, greg_t* g, HostAccess& a) {
+    const uint8_t* p = ip;
+    bool opsize = false;
+    uint8_t rex = 0;
+    if (*p == 0x66) { opsize = true; p++; }
+    if ((*p & 0xf0) == 0x40) rex = *p++;
+    uint32_t op = *p++;
+    if (op == 0x0f) op = 0x100 | *p++;
+
+    a = HostAccess{};
+    a.wide = rex & 8;
+    switch (op) {
+      case 0x88:  a.store = true; a.size = 1; break;
+      case 0x89:  a.store = true; a.size = a.wide ? 8 : opsize ? 2 : 4; break;
+      case 0x8a:  a.size = 1; break;
+      case 0x8b:  a.size = a.wide ? 8 : opsize ? 2 : 4; break;
+      case 0xc6:  a.store = true; a.size = 1; break;
+      case 0xc7:  a.store = true; a.size = a.wide ? 8 : opsize ? 2 : 4; break;
+      case 0x63:  a.size = 4; a.sign = true; break;
+      case 0x1b6: a.size = 1; break;
+      case 0x1b7: a.size = 2; break;
+      case 0x1be: a.size = 1; a.sign = true; break;
+      case 0x1bf: a.size = 2; a.sign = true; break;
+      default:    return false;
+    }
+    a.dest_bits = op == 0x8a ? 8 : a.wide ? 64 : opsize ? 16 : 32;
+
+    uint8_t modrm = *p++;
+    uint32_t mod = modrm >> 6, rm = modrm & 7;
+    a.reg = ((modrm >> 3) & 7) | (rex & 4 ? 8 : 0);
+    if (mod == 3) return false;
+    if (op == 0xc6 || op == 0xc7) {
+      if (a.reg & 7) return false;
+      a.reg = -1;
+    }
+    a.high8 = a.size == 1 && !rex && (op == 0x88 || op == 0x8a) && a.reg >= 4;
+
+    if (rm == 4) {
+      uint8_t sib = *p++;
+      uint32_t index = ((sib >> 3) & 7) | (rex & 2 ? 8 : 0), b = (sib & 7) | (rex & 1 ? 8 : 0);
+      a.ea = index == 4 ? 0 : uint64_t(host_reg(g, index)) << (sib >> 6);
+      if ((sib & 7) == 5 && mod == 0) { int32_t d; memcpy(&d, p, 4); p += 4; a.ea += d; }
+      else a.ea += host_reg(g, b);
+    } else if (rm == 5 && mod == 0) {
+      return false;   // rip-relative: never guest memory
+    } else {
+      a.ea = host_reg(g, rm | (rex & 1 ? 8 : 0));
+    }
+    if (mod == 1) a.ea += int8_t(*p++);
+    if (mod == 2) { int32_t d; memcpy(&d, p, 4); p += 4; a.ea += d; }
+
+    if (op == 0xc6) a.imm = *p++;
+    if (op == 0xc7) {
+      if (opsize) { uint16_t i; memcpy(&i, p, 2); p += 2; a.imm = i; }
+      else { memcpy(&a.imm, p, 4); p += 4; }
+    }
+    a.len = p - ip;
+    return true;
+  }
+
+  void emulate(const HostAccess& a, greg_t* g) {
+    uint32_t addr = uint32_t(a.ea - uint64_t(base));
+    if (a.store) {
+      uint64_t v = a.reg < 0 ? uint64_t(int64_t(int32_t(a.imm)))
+                 : a.high8 ? uint64_t(host_reg(g, a.reg - 4)) >> 8
+                 : uint64_t(host_reg(g, a.reg));
+      if (a.size == 8) {
+        fault_store(addr, uint32_t(v), 4);
+        fault_store(addr + 4, uint32_t(v >> 32), 4);
+      } else {
+        fault_store(addr, uint32_t(v) & uint32_t((1ull << (a.size * 8)) - 1), a.size);
+      }
+      return;
+    }
+
+    uint64_t v = a.size == 8 ? fault_load(addr, 4) | uint64_t(fault_load(addr + 4, 4)) << 32
+                             : fault_load(addr, a.size);
+    if (a.sign) v = a.size == 1 ? uint64_t(int64_t(int8_t(v)))
+                  : a.size == 2 ? uint64_t(int64_t(int16_t(v)))
+                  : uint64_t(int64_t(int32_t(v)));
+    greg_t& r = host_reg(g, a.high8 ? a.reg - 4 : a.reg);
+    uint64_t old = uint64_t(r);
+    switch (a.dest_bits) {
+      case 8:  r = a.high8 ? greg_t((old & ~0xff00ull) | (v & 0xff) << 8)
+                           : greg_t((old & ~0xffull) | (v & 0xff)); break;
+      case 16: r = greg_t((old & ~0xffffull) | (v & 0xffff)); break;
+      case 32: r = greg_t(uint32_t(v)); break;   // 32-bit writes zero-extend
+      default: r = greg_t(v); break;
+    }
+  }
+};
+
+#endif // GUEST_MEMORY_H
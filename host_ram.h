@@ -0,0 +1,244 @@
+// Host memory behind guest RAM
+//
+// HostRam is an anonymous private mapping.  The kernel hands out zero pages
+// on first touch, so allocating a large RAM is free, and a run's resident
+// memory grows with the pages the guest actually uses instead of with the
+// configured size.  Fresh RAM needs no clearing, and clear() gives the pages
+// back to the kernel instead of writing zeros over them.
+//
+// RamOptions selects the page size and NUMA placement:
+//   PAGES_SMALL    base pages (transparent huge pages as the system policy says)
+//   PAGES_THP      madvise(MADV_HUGEPAGE): 2 MiB pages where the kernel can
+//   PAGES_HUGETLB  MAP_HUGETLB from the reserved hugetlbfs pool; falls back to
+//                  PAGES_THP when the pool is empty or the size is not a
+//                  multiple of the huge page size
+//   numa_node      binds the pages to one node (Linux mbind), -1 = first touch
+//
+// The options apply to every RAM allocated without explicit ones, so a
+// driver sets HostRam::defaults() once from its command line.  Huge pages and
+// NUMA binding are Linux only; elsewhere they are ignored.
+//
+// FileImage maps a program file read-only instead of reading it, and
+// HostRam::map_file places the file's pages in guest RAM copy-on-write: every
+// instance running the same image shares one copy of the pages in the host
+// page cache until the guest writes to them.  The file must not change while
+// it is mapped.
+
+#ifndef HOST_RAM_H
+#define HOST_RAM_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+struct RamOptions {
+  enum Pages { PAGES_SMALL, PAGES_THP, PAGES_HUGETLB };
+  Pages pages = PAGES_SMALL;
+  int numa_node = -1;
+};
+
+// A file mapped read-only, or a part of one; data() is nullptr when empty
+class FileImage {
+public:
+  explicit FileImage(const char* path) {
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+      close_file();
+      return;
+    }
+    len = st.st_size;
+    void* p = len ? mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+    if (p == MAP_FAILED) {
+      close_file();
+      len = 0;
+      return;
+    }
+    ptr = static_cast<const uint8_t*>(p);
+    owner = true;
+  }
+
+  // Bytes [offset, offset + size) of file (clipped to it), such as an ELF
+  // segment; file must outlive the part
+  FileImage(const FileImage& file, size_t offset, size_t size) : fd(file.fd) {
+    if (offset > file.len) offset = file.len;
+    len = size < file.len - offset ? size : file.len - offset;
+    ptr = len ? file.ptr + offset : nullptr;
+    file_offset = file.file_offset + offset;
+  }
+
+  ~FileImage() {
+    if (!owner) return;
+    if (ptr) munmap(const_cast<uint8_t*>(ptr), len);
+    if (fd >= 0) close(fd);
+  }
+
+  FileImage(const FileImage&) = delete;
+  FileImage& operator=(const FileImage&) = delete;
+
+  bool ok() const { return fd >= 0; }
+  const uint8_t* data() const { return ptr; }
+  size_t size() const { return len; }
+
+  // Maps the whole pages of the image copy-on-write at host address at
+  // (inside a private mapping with protection prot) and copies the partial
+  // page at the end; false if nothing was mapped.  at and the image's file
+  // offset must both be page aligned.
+  bool map_to(uint8_t* at, int prot = PROT_READ | PROT_WRITE) const {
+    size_t whole = len & ~size_t(PAGE - 1);
+    if (!whole || (uintptr_t(at) | file_offset) & (PAGE - 1)) return false;
+    if (mmap(at, whole, prot, MAP_PRIVATE | MAP_FIXED, fd, file_offset) == MAP_FAILED) return false;
+    if (whole < len) {
+      if (!(prot & PROT_WRITE)) mprotect(at + whole, PAGE, PROT_READ | PROT_WRITE);
+      memcpy(at + whole, ptr + whole, len - whole);
+      if (!(prot & PROT_WRITE)) mprotect(at + whole, PAGE, prot);
+    }
+    return true;
+  }
+
+private:
+  static constexpr size_t PAGE = 4096;
+
+  int fd = -1;
+  const uint8_t* ptr = nullptr;
+  size_t len = 0;
+  size_t file_offset = 0;   // of ptr in the file
+  bool owner = false;       // owns fd and the mapping (not a part)
+
+  void close_file() {
+    if (fd >= 0) close(fd);
+    fd = -1;
+  }
+};
+
+class HostRam {
+public:
+  static RamOptions& defaults() {
+    static RamOptions opt;
+    return opt;
+  }
+
+  HostRam() = default;
+
+  explicit HostRam(size_t size, const RamOptions& opt = defaults()) : len(size), options(opt) {
+    if (!size) return;
+    void* p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (opt.pages == RamOptions::PAGES_HUGETLB && !(size & (HUGE_PAGE - 1)))
+      p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    hugetlb = p != MAP_FAILED;
+    if (hugetlb) {
+      ptr = static_cast<uint8_t*>(p);
+    } else {
+      // Huge pages need a 2 MiB aligned range: map the slack and trim it
+      size_t slack = opt.pages == RamOptions::PAGES_SMALL ? 0 : HUGE_PAGE;
+      p = mmap(nullptr, size + slack, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      if (p == MAP_FAILED) {
+        perror("HostRam: cannot map guest RAM");
+        abort();
+      }
+      uint8_t* raw = static_cast<uint8_t*>(p);
+      ptr = slack ? reinterpret_cast<uint8_t*>((uintptr_t(raw) + slack - 1) & ~uintptr_t(slack - 1)) : raw;
+      uint8_t* end = ptr + ((size + 4095) & ~size_t(4095));
+      if (ptr != raw) munmap(raw, ptr - raw);
+      if (end < raw + size + slack) munmap(end, raw + size + slack - end);
+    }
+    advise(ptr, size, opt);
+  }
+
+  ~HostRam() {
+    if (ptr) munmap(ptr, len);
+  }
+
+  HostRam(HostRam&& o) noexcept
+    : ptr(o.ptr), len(o.len), options(o.options), hugetlb(o.hugetlb), file_backed(o.file_backed) {
+    o.ptr = nullptr;
+    o.len = 0;
+  }
+  HostRam& operator=(HostRam&& o) noexcept {
+    if (this != &o) {
+      if (ptr) munmap(ptr, len);
+      ptr = o.ptr;
+      len = o.len;
+      options = o.options;
+      hugetlb = o.hugetlb;
+      file_backed = o.file_backed;
+      o.ptr = nullptr;
+      o.len = 0;
+    }
+    return *this;
+  }
+  HostRam(const HostRam&) = delete;
+  HostRam& operator=(const HostRam&) = delete;
+
+  uint8_t* data() const { return ptr; }
+  size_t size() const { return len; }
+  uint8_t& operator[](size_t i) const { return ptr[i]; }
+
+  // Places img at offset (page aligned) copy-on-write; false if it does not
+  // fit or cannot be mapped there (hugetlb RAM), so the caller copies it
+  bool map_file(size_t offset, const FileImage& img) {
+    if (hugetlb || offset > len || img.size() > len - offset) return false;
+    if (!img.map_to(ptr + offset)) return false;
+    file_backed = true;
+    return true;
+  }
+
+  // Back to all zeros; on Linux the pages go back to the kernel.  File pages
+  // are replaced by anonymous memory again.
+  void clear() {
+    if (file_backed &&
+        mmap(ptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0) != MAP_FAILED) {
+      file_backed = false;
+      advise(ptr, len, options);
+      return;
+    }
+    discard(ptr, len, hugetlb);
+  }
+
+  // Applies opt's page size and NUMA binding to an existing mapping (THP
+  // stands in for hugetlb pages, which only a new mapping can have)
+  static void advise(uint8_t* p, size_t size, const RamOptions& opt) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if (opt.pages != RamOptions::PAGES_SMALL) madvise(p, size, MADV_HUGEPAGE);
+#endif
+#if defined(__linux__) && defined(SYS_mbind)
+    if (opt.numa_node >= 0 && opt.numa_node < 64) {
+      const unsigned long MPOL_BIND = 2;
+      unsigned long nodes = 1ul << opt.numa_node;
+      if (syscall(SYS_mbind, p, size, MPOL_BIND, &nodes, 64ul, 0ul))
+        fprintf(stderr, "HostRam: cannot bind guest RAM to NUMA node %d\n", opt.numa_node);
+    }
+#endif
+    (void)p; (void)size; (void)opt;
+  }
+
+  // Zeroes [p, p + size) of an anonymous private mapping
+  static void discard(uint8_t* p, size_t size, bool hugetlb = false) {
+#ifdef __linux__
+    if (!hugetlb && !madvise(p, size, MADV_DONTNEED)) return;
+#endif
+    (void)hugetlb;
+    memset(p, 0, size);
+  }
+
+private:
+  static constexpr size_t HUGE_PAGE = 2u << 20;
+
+  uint8_t* ptr = nullptr;
+  size_t len = 0;
+  RamOptions options;         // what the RAM was created with
+  bool hugetlb = false;
+  bool file_backed = false;   // map_file replaced some of the anonymous pages
+};
+
+#endif // HOST_RAM_H
@@ -0,0 +1,137 @@
+// librv32 (rv32.h): Machine on top of the rv32ima CPU
+//
+// rv32ima.cc is compiled in without its command-line driver.  The library is
+// built with hidden visibility and its internal symbols are made local (see
+// the Makefile), so only the rv32:: API is visible to the program that
+// links it.
+
+#define RV32IMA_NO_DRIVER
+#include "rv32ima.cc"
+#include "rv32.h"
+
+namespace rv32 {
+
+struct Machine::Impl {
+  CPU<> cpu;
+  size_t ram_size;
+  std::string console;
+  ElfFile elf;               // headers and symbols of the loaded ELF program
+  bool past_event = false;   // the last run stopped at an Until::on_ecall ecall
+
+  explicit Impl(const Config& config) : cpu(config.ram_size), ram_size(config.ram_size) {}
+};
+
+Machine::Machine(const Config& config) : impl(new Impl(config)) {
+  CPU<>& cpu = impl->cpu;
+  cpu.engine = config.engine == Engine::Interp ? ENGINE_INTERP
+             : config.engine == Engine::Block  ? ENGINE_BLOCK
+                                               : ENGINE_JIT;
+#ifdef RV32_JIT
+  cpu.jit_background = config.jit_background;
+#endif
+  if (config.capture_console) cpu.console = &impl->console;
+}
+
+Machine::~Machine() = default;
+
+bool Machine::load(const char* path, std::string* error) {
+  CPU<>& cpu = impl->cpu;
+  FileImage bin(path);
+  std::string why;
+  bool is_elf = ElfFile::is_elf(bin);
+  impl->elf = ElfFile();
+  if (!bin.ok()) {
+    why = "cannot open file";
+  } else if (is_elf) {
+    if (impl->elf.parse(bin, why) && !impl->elf.load(cpu.mem, bin)) why = "program does not fit in RAM";
+  } else if (!cpu.mem.load_image(bin)) {
+    why = "program does not fit in RAM";
+  }
+  if (!why.empty()) {
+    if (error) *error = std::string(path) + ": " + why;
+    impl->elf = ElfFile();
+    return false;
+  }
+  if (is_elf) {
+    for (const ElfFile::Segment& s : impl->elf.segments) {
+      code_changed(s.paddr, s.filesz);
+      code_changed(s.vaddr, s.memsz);
+    }
+  } else {
+    code_changed(0, bin.size());
+  }
+  cpu.pc = is_elf ? impl->elf.entry : 0;
+  impl->past_event = false;
+  return true;
+}
+
+bool Machine::load(const uint8_t* data, size_t size, uint32_t addr) {
+  if (!host_address(addr, size)) return false;
+  impl->cpu.mem.load_binary(data, size, addr);
+  code_changed(addr, size);
+  return true;
+}
+
+Result Machine::run_until(const Until& until) {
+  CPU<>& cpu = impl->cpu;
+  uint64_t start = cpu.cycles, budget = until.instructions;
+  if (impl->past_event) {   // the ecall that stopped the last run returns now
+    cpu.pc += 4;
+    cpu.cycles++;
+    impl->past_event = false;
+    if (budget) budget--;
+  }
+  cpu.has_stop_syscall = until.has_ecall;
+  cpu.stop_syscall = until.ecall;
+
+  ExitReason why = EXIT_LIMIT;
+  bool planted = false;
+  if (until.has_pc && budget) {
+    if (cpu.pc == until.pc) {   // sitting on the breakpoint: execute it first
+      why = cpu.run<TRACE_OFF>(1);
+      budget--;
+    }
+    if (why == EXIT_LIMIT) planted = cpu.plant_breakpoint(until.pc);
+  }
+  if (why == EXIT_LIMIT && budget) why = cpu.run<TRACE_OFF>(budget);
+  if (planted) cpu.remove_breakpoint(until.pc);
+  cpu.has_stop_syscall = false;
+
+  Exit reason;
+  switch (why) {
+    case EXIT_HALT:    reason = Exit::Halt; break;
+    case EXIT_EBREAK:  reason = planted && cpu.pc == until.pc ? Exit::Breakpoint : Exit::Ebreak; break;
+    case EXIT_ILLEGAL: reason = Exit::Illegal; break;
+    case EXIT_EVENT:   reason = Exit::Event; impl->past_event = true; break;
+    default:           reason = Exit::Budget; break;
+  }
+  return Result{reason, cpu.exit_code, cpu.pc, cpu.cycles - start};
+}
+
+void Machine::reset() {
+  impl->cpu.reset();
+  impl->cpu.mem.clear();
+  impl->console.clear();
+  impl->elf = ElfFile();
+  impl->past_event = false;
+}
+
+uint32_t* Machine::regs() { return impl->cpu.x; }
+uint32_t& Machine::pc() { return impl->cpu.pc; }
+uint64_t Machine::instructions() const { return impl->cpu.cycles; }
+
+uint8_t* Machine::ram() { return impl->cpu.mem.data(); }
+size_t Machine::ram_size() const { return impl->ram_size; }
+
+uint8_t* Machine::host_address(uint32_t addr, size_t size) {
+  if (addr > impl->ram_size || size > impl->ram_size - addr) return nullptr;
+  return impl->cpu.mem.data() + addr;
+}
+
+void Machine::code_changed(uint32_t addr, size_t size) { impl->cpu.code_changed(addr, size); }
+
+std::string& Machine::console() { return impl->console; }
+
+std::string Machine::symbol(uint32_t addr) const { return impl->elf.describe(addr); }
+
+}  // namespace rv32
@@ -0,0 +1,538 @@
+// Linux user-mode personality for rv32ima --linux
+//
+// LinuxProcess runs a statically linked RV32 Linux executable (glibc, musl,
+// newlib-linux) on the CPU's RAM at guest address 0: start() builds the
+// initial stack the kernel would (argc, argv, envp, auxiliary vector) and
+// syscall() serves the ecalls of the rv32 Linux ABI (a7 = number, a0-a5 =
+// arguments, a0 = result or -errno).
+//
+// Files are host files.  Guest descriptors map to host ones through a table;
+// 0, 1 and 2 are the emulator's own stdin/stdout/stderr, which the guest can
+// close without closing them for the emulator.  read/write and friends move
+// the data straight between the host descriptor and guest RAM with one host
+// call, after checking the guest range once; nothing is copied byte by byte.
+//
+// The address space is the RAM: the program's segments at the bottom, then
+// the brk heap, then anonymous mmap regions allocated downwards from the
+// stack, which takes the top of RAM.  There are no page protections.
+// Freed pages go back to the host.
+//
+// rv32 has only the 64-bit time calls and llseek/mmap2; the time32
+// clock_gettime and gettimeofday that older libcs use are served as well.
+
+#ifndef LINUX_USER_H
+#define LINUX_USER_H
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+#include "elf_loader.h"
+#include "host_ram.h"
+
+class LinuxProcess {
+public:
+  static constexpr uint32_t PAGE = 4096;
+  static constexpr uint32_t STACK_SIZE = 8u << 20;
+
+  LinuxProcess(uint8_t* ram, size_t ram_size)
+    : ram(ram), ram_size(uint32_t(std::min<size_t>(ram_size, UINT32_MAX & ~(PAGE - 1)))), fds{0, 1, 2} {
+    stack_bottom = this->ram_size - std::min(STACK_SIZE, this->ram_size / 4);
+  }
+
+  ~LinuxProcess() {
+    for (size_t fd = 3; fd < fds.size(); fd++)
+      if (fds[fd] >= 0) close(fds[fd]);
+  }
+
+  LinuxProcess(const LinuxProcess&) = delete;
+  LinuxProcess& operator=(const LinuxProcess&) = delete;
+
+  // Builds the initial stack for elf (loaded into RAM) and argv; returns the
+  // stack pointer, or 0 if the program leaves no room for heap and stack
+  uint32_t start(const ElfFile& elf, const std::vector<std::string>& argv) {
+    heap_start = brk_end = (elf.end() + PAGE - 1) & ~(PAGE - 1);
+    if (heap_start >= stack_bottom) return 0;
+
+    uint32_t sp = ram_size;
+    sp -= 16;
+    uint32_t random = sp;
+    std::random_device rd;
+    for (int i = 0; i < 16; i += 4) put32(random + i, rd());
+    std::vector<uint32_t> args;
+    for (const std::string& a : argv) {
+      sp -= a.size() + 1;
+      memcpy(ram + sp, a.c_str(), a.size() + 1);
+      args.push_back(sp);
+    }
+
+    const uint32_t auxv[][2] = {
+      {3, elf.phdr_addr()}, {4, elf.phentsize}, {5, elf.phnum}, {6, PAGE}, {9, elf.entry},
+      {11, 0}, {12, 0}, {13, 0}, {14, 0}, {17, 100}, {25, random}, {0, 0},
+    };
+    uint32_t words = 1 + args.size() + 1 + 1 + 2 * (sizeof(auxv) / sizeof(auxv[0]));
+    sp = (sp - 4 * words) & ~15u;
+    if (sp < stack_bottom) return 0;
+
+    uint32_t at = sp;
+    put32(at, args.size()), at += 4;
+    for (uint32_t a : args) put32(at, a), at += 4;
+    put32(at, 0), at += 4;   // end of argv
+    put32(at, 0), at += 4;   // empty environment
+    for (const auto& a : auxv) put32(at, a[0]), put32(at + 4, a[1]), at += 8;
+    return sp;
+  }
+
+  // Serves the ecall at cpu.pc; false if the process exited (exit,
+  // exit_group), with its status in a0
+  template <class Cpu>
+  bool syscall(Cpu& cpu) {
+    uint32_t* x = cpu.x;
+    uint32_t a0 = x[10], a1 = x[11], a2 = x[12], a3 = x[13], a4 = x[14], a5 = x[15];
+    int32_t r;
+    switch (x[17]) {
+      case 17:  r = sys_getcwd(a0, a1); break;
+      case 23:  r = install(dup(host_fd(a0)), 0); break;
+      case 24:  r = sys_dup3(a0, a1, a2); break;
+      case 25:  r = sys_fcntl(a0, a1, a2); break;
+      case 29:  r = host_fd(a0) < 0 ? -EBADF : -ENOTTY; break;   // ioctl: no terminals
+      case 48:  r = sys_faccessat(a0, a1, a2); break;
+      case 56:  r = sys_openat(a0, a1, a2, a3); break;
+      case 57:  r = sys_close(a0); break;
+      case 62:  r = sys_llseek(a0, a1, a2, a3, a4); break;
+      case 63:  r = sys_read(cpu, a0, a1, a2); break;
+      case 64:  r = sys_write(cpu, a0, a1, a2); break;
+      case 65:  r = sys_readv(cpu, a0, a1, a2); break;
+      case 66:  r = sys_writev(cpu, a0, a1, a2); break;
+      case 78:  r = sys_readlinkat(a0, a1, a2, a3); break;
+      case 79:  r = sys_fstatat(a0, a1, a2, a3); break;
+      case 80:  r = sys_fstat(a0, a1); break;
+      case 93:
+      case 94:  return false;   // exit, exit_group
+      case 96:  r = 1; break;   // set_tid_address: the only thread is 1
+      case 99:  r = 0; break;   // set_robust_list
+      case 113: r = sys_clock_gettime(a0, a1, false); break;
+      case 134:
+      case 135: r = 0; break;   // rt_sigaction, rt_sigprocmask: no signals are delivered
+      case 160: r = sys_uname(a0); break;
+      case 169: r = sys_gettimeofday(a0, a1); break;
+      case 172:
+      case 178: r = 1; break;   // getpid, gettid
+      case 173: r = 0; break;   // getppid
+      case 174: r = getuid(); break;
+      case 175: r = geteuid(); break;
+      case 176: r = getgid(); break;
+      case 177: r = getegid(); break;
+      case 214: r = sys_brk(cpu, a0); break;
+      case 215: r = sys_munmap(cpu, a0, a1); break;
+      case 222: r = sys_mmap(cpu, a0, a1, a3, a4, a5); break;
+      case 226:
+      case 233: r = 0; break;   // mprotect, madvise
+      case 278: r = sys_getrandom(cpu, a0, a1); break;
+      case 291: r = sys_statx(a0, a1, a2, a4); break;
+      case 403: r = sys_clock_gettime(a0, a1, true); break;
+      default:
+        if (cpu.trace_enabled) std::cerr << "Unhandled Linux syscall: " << x[17] << std::endl;
+        r = -ENOSYS;   // includes prlimit64, rseq and futex-based threading
+        break;
+    }
+    x[10] = uint32_t(r);
+    return true;
+  }
+
+private:
+  uint8_t* ram;
+  uint32_t ram_size;
+  uint32_t stack_bottom;
+  uint32_t heap_start = 0, brk_end = 0;
+  std::map<uint32_t, uint32_t> regions;   // mmap regions: start -> length (whole pages)
+  std::vector<int> fds;                   // guest descriptor -> host descriptor, -1 if free
+
+  // Guest range [addr, addr + size) in RAM
+  bool valid(uint32_t addr, uint64_t size) const { return addr <= ram_size && size <= ram_size - addr; }
+
+  // NUL-terminated guest string at addr, or nullptr if it runs out of RAM
+  const char* path(uint32_t addr) const {
+    if (addr >= ram_size || !memchr(ram + addr, 0, ram_size - addr)) return nullptr;
+    return reinterpret_cast<const char*>(ram + addr);
+  }
+
+  void put32(uint32_t addr, uint32_t v) {
+    for (int i = 0; i < 4; i++) ram[addr + i] = uint8_t(v >> (8 * i));
+  }
+  void put64(uint32_t addr, uint64_t v) { put32(addr, uint32_t(v)), put32(addr + 4, uint32_t(v >> 32)); }
+  uint32_t get32(uint32_t addr) const {
+    return ram[addr] | ram[addr + 1] << 8 | ram[addr + 2] << 16 | uint32_t(ram[addr + 3]) << 24;
+  }
+
+  int host_fd(uint32_t fd) const { return fd < fds.size() ? fds[fd] : -1; }
+
+  // Host descriptor for a guest *at call's dirfd argument
+  int host_dirfd(uint32_t fd) const { return int32_t(fd) == -100 ? AT_FDCWD : host_fd(fd); }
+
+  // Gives host descriptor h the lowest free guest descriptor >= min; -errno
+  // if h is one
+  int32_t install(int h, uint32_t min) {
+    if (h < 0) return -errno;
+    uint32_t fd = min;
+    while (fd < fds.size() && fds[fd] >= 0) fd++;
+    if (fd >= fds.size()) fds.resize(fd + 1, -1);
+    fds[fd] = h;
+    return fd;
+  }
+
+  // The guest's open flags (asm-generic values) as the host's
+  static int open_flags(uint32_t f) {
+    static const struct { uint32_t guest; int host; } bits[] = {
+      {00100, O_CREAT}, {00200, O_EXCL}, {00400, O_NOCTTY}, {01000, O_TRUNC}, {02000, O_APPEND},
+      {04000, O_NONBLOCK}, {010000, O_DSYNC}, {0200000, O_DIRECTORY}, {0400000, O_NOFOLLOW},
+      {02000000, O_CLOEXEC}, {04000000, O_SYNC & ~O_DSYNC},
+    };
+    int h = f & O_ACCMODE;
+    for (const auto& b : bits)
+      if (f & b.guest) h |= b.host;
+    return h;
+  }
+
+  // Zeroes guest [addr, addr + size); whole pages above the program image
+  // go back to the host (below it they may be file pages, which would come
+  // back with the file's contents)
+  template <class Cpu>
+  void zero(Cpu& cpu, uint32_t addr, uint32_t size) {
+    uint32_t end = addr + size;
+    uint32_t first = std::max((addr + PAGE - 1) & ~(PAGE - 1), heap_start), last = end & ~(PAGE - 1);
+    if (first < last) {
+      if (addr < first) memset(ram + addr, 0, first - addr);
+      HostRam::discard(ram + first, last - first);
+      if (last < end) memset(ram + last, 0, end - last);
+    } else {
+      memset(ram + addr, 0, size);
+    }
+    cpu.code_changed(addr, size);
+  }
+
+  // Files
+
+  int32_t sys_openat(uint32_t dirfd, uint32_t name, uint32_t flags, uint32_t mode) {
+    const char* p = path(name);
+    if (!p) return -EFAULT;
+    return install(openat(host_dirfd(dirfd), p, open_flags(flags), mode), 0);
+  }
+
+  int32_t sys_close(uint32_t fd) {
+    int h = host_fd(fd);
+    if (h < 0) return -EBADF;
+    fds[fd] = -1;
+    if (h > 2) close(h);
+    return 0;
+  }
+
+  int32_t sys_dup3(uint32_t from, uint32_t to, uint32_t flags) {
+    int h = host_fd(from);
+    if (h < 0) return -EBADF;
+    if (from == to || to > 65535) return -EINVAL;
+    int d = fcntl(h, (flags & 02000000) ? F_DUPFD_CLOEXEC : F_DUPFD, 3);
+    if (d < 0) return -errno;
+    if (to < fds.size() && fds[to] > 2) close(fds[to]);
+    if (to >= fds.size()) fds.resize(to + 1, -1);
+    fds[to] = d;
+    return to;
+  }
+
+  int32_t sys_fcntl(uint32_t fd, uint32_t cmd, uint32_t arg) {
+    int h = host_fd(fd);
+    if (h < 0) return -EBADF;
+    switch (cmd) {
+      case 0:    return install(fcntl(h, F_DUPFD, 3), arg);           // F_DUPFD
+      case 1030: return install(fcntl(h, F_DUPFD_CLOEXEC, 3), arg);   // F_DUPFD_CLOEXEC
+      case 1:                                                         // F_GETFD
+      case 3: {                                                       // F_GETFL
+        int r = fcntl(h, cmd == 1 ? F_GETFD : F_GETFL);
+        return r < 0 ? -errno : r & (cmd == 1 ? FD_CLOEXEC : O_ACCMODE | O_APPEND | O_NONBLOCK);
+      }
+      default:   return 0;                                            // F_SETFD, F_SETFL, locks
+    }
+  }
+
+  int32_t sys_llseek(uint32_t fd, uint32_t hi, uint32_t lo, uint32_t result, uint32_t whence) {
+    int h = host_fd(fd);
+    if (h < 0) return -EBADF;
+    if (!valid(result, 8)) return -EFAULT;
+    off_t at = lseek(h, off_t(uint64_t(hi) << 32 | lo), whence);
+    if (at < 0) return -errno;
+    put64(result, at);
+    return 0;
+  }
+
+  template <class Cpu>
+  int32_t sys_read(Cpu& cpu, uint32_t fd, uint32_t buf, uint32_t count) {
+    int h = host_fd(fd);
+    if (h < 0) return -EBADF;
+    if (!valid(buf, count)) return -EFAULT;
+    ssize_t n = read(h, ram + buf, count);
+    if (n < 0) return -errno;
+    cpu.code_changed(buf, n);
+    return n;
+  }
+
+  template <class Cpu>
+  int32_t sys_write(Cpu& cpu, uint32_t fd, uint32_t buf, uint32_t count) {
+    int h = host_fd(fd);
+    if (h < 0) return -EBADF;
+    if (!valid(buf, count)) return -EFAULT;
+    if (cpu.console && (h == 1 || h == 2)) {
+      cpu.console->append(reinterpret_cast<const char*>(ram + buf), count);
+      return count;
+    }
+    ssize_t n = write(h, ram + buf, count);
+    return n < 0 ? -errno : n;
+  }
+
+  // Host iovecs for the guest's iovec array (rv32: {base, len} words);
+  // -errno if one is not in RAM
+  int32_t iovecs(uint32_t iov, uint32_t count, std::vector<struct iovec>& out) const {
+    if (count > 1024) return -EINVAL;
+    if (!valid(iov, uint64_t(count) * 8)) return -EFAULT;
+    out.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+      uint32_t base = get32(iov + 8 * i), len = get32(iov + 8 * i + 4);
+      if (!valid(base, len)) return -EFAULT;
+      out[i] = {ram + base, len};
+    }
+    return 0;
+  }
+
+  template <class Cpu>
+  int32_t sys_readv(Cpu& cpu, uint32_t fd, uint32_t iov, uint32_t count) {
+    int h = host_fd(fd);
+    if (h < 0) return -EBADF;
+    std::vector<struct iovec> v;
+    if (int32_t e = iovecs(iov, count, v)) return e;
+    ssize_t n = readv(h, v.data(), count);
+    if (n < 0) return -errno;
+    for (size_t i = 0, left = n; i < v.size() && left; left -= std::min(left, v[i].iov_len), i++)
+      cpu.code_changed(uint32_t(static_cast<uint8_t*>(v[i].iov_base) - ram), std::min(left, v[i].iov_len));
+    return n;
+  }
+
+  template <class Cpu>
+  int32_t sys_writev(Cpu& cpu, uint32_t fd, uint32_t iov, uint32_t count) {
+    int h = host_fd(fd);
+    if (h < 0) return -EBADF;
+    std::vector<struct iovec> v;
+    if (int32_t e = iovecs(iov, count, v)) return e;
+    if (cpu.console && (h == 1 || h == 2)) {
+      size_t n = 0;
+      for (const struct iovec& i : v) cpu.console->append(static_cast<const char*>(i.iov_base), i.iov_len), n += i.iov_len;
+      return n;
+    }
+    ssize_t n = writev(h, v.data(), count);
+    return n < 0 ? -errno : n;
+  }
+
+  int32_t sys_readlinkat(uint32_t dirfd, uint32_t name, uint32_t buf, uint32_t size) {
+    const char* p = path(name);
+    if (!p || !valid(buf, size)) return -EFAULT;
+    ssize_t n = readlinkat(host_dirfd(dirfd), p, reinterpret_cast<char*>(ram + buf), size);
+    return n < 0 ? -errno : n;
+  }
+
+  int32_t sys_faccessat(uint32_t dirfd, uint32_t name, uint32_t mode) {
+    const char* p = path(name);
+    if (!p) return -EFAULT;
+    return faccessat(host_dirfd(dirfd), p, mode, 0) ? -errno : 0;
+  }
+
+  int32_t sys_getcwd(uint32_t buf, uint32_t size) {
+    if (!valid(buf, size)) return -EFAULT;
+    if (!getcwd(reinterpret_cast<char*>(ram + buf), size)) return -errno;
+    return strlen(reinterpret_cast<char*>(ram + buf)) + 1;
+  }
+
+  // struct stat64 of the asm-generic ABI (fstat, fstatat)
+  static constexpr uint32_t STAT_SIZE = 104;
+  void put_stat(uint32_t at, const struct stat& s) {
+    memset(ram + at, 0, STAT_SIZE);
+    put64(at, s.st_dev), put64(at + 8, s.st_ino);
+    put32(at + 16, s.st_mode), put32(at + 20, s.st_nlink), put32(at + 24, s.st_uid), put32(at + 28, s.st_gid);
+    put64(at + 32, s.st_rdev), put64(at + 48, s.st_size), put32(at + 56, s.st_blksize), put64(at + 64, s.st_blocks);
+    put32(at + 72, s.st_atim.tv_sec), put32(at + 76, s.st_atim.tv_nsec);
+    put32(at + 80, s.st_mtim.tv_sec), put32(at + 84, s.st_mtim.tv_nsec);
+    put32(at + 88, s.st_ctim.tv_sec), put32(at + 92, s.st_ctim.tv_nsec);
+  }
+
+  int32_t sys_fstat(uint32_t fd, uint32_t buf) {
+    int h = host_fd(fd);
+    if (h < 0) return -EBADF;
+    if (!valid(buf, STAT_SIZE)) return -EFAULT;
+    struct stat s;
+    if (fstat(h, &s)) return -errno;
+    put_stat(buf, s);
+    return 0;
+  }
+
+  int32_t sys_fstatat(uint32_t dirfd, uint32_t name, uint32_t buf, uint32_t flags) {
+    const char* p = path(name);
+    if (!p || !valid(buf, STAT_SIZE)) return -EFAULT;
+    struct stat s;
+    if (fstatat(host_dirfd(dirfd), p, &s, flags & (AT_SYMLINK_NOFOLLOW | AT_EMPTY_PATH))) return -errno;
+    put_stat(buf, s);
+    return 0;
+  }
+
+  // statx, what rv32 libcs stat files with; filled from the host's stat
+  int32_t sys_statx(uint32_t dirfd, uint32_t name, uint32_t flags, uint32_t buf) {
+    const char* p = path(name);
+    if (!p || !valid(buf, 256)) return -EFAULT;
+    struct stat s;
+    if (fstatat(host_dirfd(dirfd), p, &s, flags & (AT_SYMLINK_NOFOLLOW | AT_EMPTY_PATH))) return -errno;
+    memset(ram + buf, 0, 256);
+    put32(buf, 0x7ff);   // STATX_BASIC_STATS
+    put32(buf + 4, s.st_blksize), put32(buf + 16, s.st_nlink), put32(buf + 20, s.st_uid), put32(buf + 24, s.st_gid);
+    ram[buf + 28] = uint8_t(s.st_mode), ram[buf + 29] = uint8_t(s.st_mode >> 8);
+    put64(buf + 32, s.st_ino), put64(buf + 40, s.st_size), put64(buf + 48, s.st_blocks);
+    const struct timespec* times[] = {&s.st_atim, &s.st_ctim, &s.st_ctim, &s.st_mtim};   // a, b, c, m
+    for (int i = 0; i < 4; i++) put64(buf + 64 + 16 * i, times[i]->tv_sec), put32(buf + 72 + 16 * i, times[i]->tv_nsec);
+    put32(buf + 128, major(s.st_rdev)), put32(buf + 132, minor(s.st_rdev));
+    put32(buf + 136, major(s.st_dev)), put32(buf + 140, minor(s.st_dev));
+    return 0;
+  }
+
+  // Memory
+
+  template <class Cpu>
+  int32_t sys_brk(Cpu& cpu, uint32_t want) {
+    auto above = regions.lower_bound(brk_end);
+    uint32_t limit = above == regions.end() ? stack_bottom : above->first;
+    if (want >= heap_start && want <= limit) {
+      if (want > brk_end) zero(cpu, brk_end, want - brk_end);
+      brk_end = want;
+    }
+    return brk_end;
+  }
+
+  // Removes [addr, addr + len) from the mmap regions
+  void unmap(uint32_t addr, uint32_t len) {
+    uint32_t end = addr + len;
+    auto it = regions.upper_bound(addr);
+    if (it != regions.begin()) --it;
+    while (it != regions.end() && it->first < end) {
+      uint32_t start = it->first, stop = start + it->second;
+      if (stop <= addr) { ++it; continue; }
+      it = regions.erase(it);
+      if (start < addr) regions[start] = addr - start;
+      if (stop > end) regions[end] = stop - end;
+    }
+  }
+
+  template <class Cpu>
+  int32_t sys_munmap(Cpu& cpu, uint32_t addr, uint32_t len) {
+    len = (len + PAGE - 1) & ~(PAGE - 1);
+    if ((addr & (PAGE - 1)) || !len || !valid(addr, len)) return -EINVAL;
+    unmap(addr, len);
+    if (addr >= heap_start && addr + len <= stack_bottom) zero(cpu, addr, len);
+    return 0;
+  }
+
+  // mmap2: anonymous memory, and private file mappings (read in); offset is
+  // in pages
+  template <class Cpu>
+  int32_t sys_mmap(Cpu& cpu, uint32_t addr, uint32_t len, uint32_t flags, uint32_t fd, uint32_t pgoff) {
+    const uint32_t MAP_SHARED_ = 0x01, MAP_FIXED_ = 0x10, MAP_ANON_ = 0x20;
+    len = (len + PAGE - 1) & ~(PAGE - 1);
+    if (!len) return -EINVAL;
+    int h = -1;
+    if (!(flags & MAP_ANON_)) {
+      if ((h = host_fd(fd)) < 0) return -EBADF;
+      if (flags & MAP_SHARED_) return -ENODEV;
+    }
+
+    if (flags & MAP_FIXED_) {
+      if ((addr & (PAGE - 1)) || !valid(addr, len)) return -EINVAL;
+      unmap(addr, len);
+    } else {
+      // highest gap between the heap and the stack
+      uint32_t floor = (brk_end + PAGE - 1) & ~(PAGE - 1), top = stack_bottom;
+      for (auto it = regions.rbegin(); it != regions.rend() && top >= floor + len; ++it) {
+        uint32_t end = std::max(it->first + it->second, floor);
+        if (end <= top && top - end >= len) break;
+        top = std::min(top, it->first);
+      }
+      if (top < floor + len) return -ENOMEM;
+      addr = top - len;
+    }
+    regions[addr] = len;
+    zero(cpu, addr, len);
+
+    if (h >= 0) {
+      ssize_t n = pread(h, ram + addr, len, off_t(pgoff) * PAGE);
+      if (n < 0) {
+        int e = errno;
+        unmap(addr, len);
+        return -e;
+      }
+      cpu.code_changed(addr, n);
+    }
+    return addr;
+  }
+
+  template <class Cpu>
+  int32_t sys_getrandom(Cpu& cpu, uint32_t buf, uint32_t len) {
+    if (!valid(buf, len)) return -EFAULT;
+    static std::random_device rd;
+    uint32_t i = 0;
+    for (; i + 4 <= len; i += 4) put32(buf + i, rd());
+    for (uint32_t v = rd(); i < len; i++, v >>= 8) ram[buf + i] = uint8_t(v);
+    cpu.code_changed(buf, len);
+    return len;
+  }
+
+  // Time and system
+
+  int32_t sys_clock_gettime(uint32_t clock, uint32_t buf, bool time64) {
+    if (!valid(buf, time64 ? 16 : 8)) return -EFAULT;
+    struct timespec t;
+    if (clock_gettime(clockid_t(clock), &t)) return -errno;
+    if (time64) put64(buf, t.tv_sec), put64(buf + 8, t.tv_nsec);
+    else put32(buf, t.tv_sec), put32(buf + 4, t.tv_nsec);
+    return 0;
+  }
+
+  int32_t sys_gettimeofday(uint32_t tv, uint32_t tz) {
+    if (tv) {
+      if (!valid(tv, 8)) return -EFAULT;
+      struct timeval t;
+      gettimeofday(&t, nullptr);
+      put32(tv, t.tv_sec), put32(tv + 4, t.tv_usec);
+    }
+    if (tz) {
+      if (!valid(tz, 8)) return -EFAULT;
+      put64(tz, 0);
+    }
+    return 0;
+  }
+
+  int32_t sys_uname(uint32_t buf) {
+    if (!valid(buf, 6 * 65)) return -EFAULT;
+    struct utsname host;
+    uname(&host);
+    const char* fields[] = {"Linux", host.nodename, "6.1.0", "#1", "riscv32", "(none)"};
+    memset(ram + buf, 0, 6 * 65);
+    for (int i = 0; i < 6; i++) strncpy(reinterpret_cast<char*>(ram + buf + 65 * i), fields[i], 64);
+    return 0;
+  }
+};
+
+#endif // LINUX_USER_H
@@ -1,89 +1,291 @@
 // Memory Subsystem Interface for rv32ima.cc
 // This allows pluggable memory implementations (basic RAM, MMIO+SDL, etc)
+//
+// The CPU in rv32ima.cc is a template over its bus type (CPU<Bus>) and calls
+// the bus directly, so a concrete final class such as BasicMemory inlines to
+// a bounds check and a host load.  Implementations of the virtual interface
+// below plug in through the VirtualBus adapter at the end of this file.
+//
+// A bus provides fetch8/16/32, store8/16/32, load_binary, load_image and
+// mapped() as below, plus
+//
+//   data()    host address of guest address 0 when [0, size()) may be
+//             accessed directly (by the JIT), or nullptr
+//   size()    span of guest addresses the CPU keeps per-page state for
+//   span(addr, len)
+//             host address of guest addr if it is plain memory, with len cut
+//             to the bytes from there on that are contiguous in the host, or
+//             nullptr (system calls hand guest buffers to the host this way)
 
 #ifndef MEMORY_SUBSYSTEM_H
 #define MEMORY_SUBSYSTEM_H
 
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
 #include <vector>
+#include "host_ram.h"
+
+#ifdef RV32_GUARD_MEM
+#include "guest_memory.h"
+#endif
 
 // Abstract memory subsystem interface
 class MemorySubsystem {
 public:
     virtual ~MemorySubsystem() = default;
-    
+
     // Basic memory operations
     virtual uint32_t fetch32(uint32_t addr) = 0;
     virtual void store32(uint32_t addr, uint32_t value) = 0;
-    
+
     virtual uint16_t fetch16(uint32_t addr) = 0;
     virtual void store16(uint32_t addr, uint16_t value) = 0;
-    
+
     virtual uint8_t fetch8(uint32_t addr) = 0;
     virtual void store8(uint32_t addr, uint8_t value) = 0;
-    
+
     // Load binary into memory
     virtual bool load_binary(const uint8_t* data, size_t size, uint32_t load_addr = 0) = 0;
-    
+
+    // Load a mapped program file; memories backed by host mappings place its
+    // pages copy-on-write instead of copying them (host_ram.h)
+    virtual bool load_image(const FileImage& img, uint32_t load_addr = 0) {
+        return load_binary(img.data(), img.size(), load_addr);
+    }
+
+    // True if [addr, addr + size) is plain memory, so reading it has no side
+    // effects (tracing re-reads memory after an access)
+    virtual bool mapped(uint32_t addr, uint32_t size) { return false; }
+
+    // Host address of plain memory at addr, len cut to the contiguous part
+    virtual uint8_t* span(uint32_t addr, uint32_t& len) { return nullptr; }
+
     // Optional: periodic updates (for display refresh, etc)
     virtual void update(uint64_t cycles) {}
-    
+
     // Optional: check if we should quit (SDL window closed, etc)
     virtual bool should_quit() { return false; }
-    
+
     // Get memory size
     virtual size_t size() const = 0;
 };
 
-// Basic RAM-only implementation
-class BasicMemory : public MemorySubsystem {
+// Basic RAM-only implementation; the RAM is a HostRam, so pages the guest
+// never touches cost nothing
+class BasicMemory final : public MemorySubsystem {
 private:
-    std::vector<uint8_t> mem;
-    
+    HostRam mem;
+
 public:
-    explicit BasicMemory(size_t mem_size) : mem(mem_size, 0) {}
-    
+    explicit BasicMemory(size_t mem_size, const RamOptions& opt = HostRam::defaults()) : mem(mem_size, opt) {}
+
     uint32_t fetch32(uint32_t addr) override {
-        if (addr + 3 >= mem.size()) return 0;
+        if (!mapped(addr, 4)) return 0;
         return mem[addr] | (mem[addr+1]<<8) | (mem[addr+2]<<16) | (mem[addr+3]<<24);
     }
-    
+
     void store32(uint32_t addr, uint32_t v) override {
-        if (addr + 3 >= mem.size()) return;
+        if (!mapped(addr, 4)) return;
         mem[addr]   = v;
         mem[addr+1] = v >> 8;
         mem[addr+2] = v >> 16;
         mem[addr+3] = v >> 24;
     }
-    
+
     uint16_t fetch16(uint32_t addr) override {
-        if (addr + 1 >= mem.size()) return 0;
+        if (!mapped(addr, 2)) return 0;
         return mem[addr] | (mem[addr+1]<<8);
     }
-    
+
     void store16(uint32_t addr, uint16_t v) override {
-        if (addr + 1 >= mem.size()) return;
+        if (!mapped(addr, 2)) return;
         mem[addr]   = v;
         mem[addr+1] = v >> 8;
     }
-    
+
     uint8_t fetch8(uint32_t addr) override {
         if (addr >= mem.size()) return 0;
         return mem[addr];
     }
-    
+
     void store8(uint32_t addr, uint8_t v) override {
         if (addr >= mem.size()) return;
         mem[addr] = v;
     }
-    
+
     bool load_binary(const uint8_t* data, size_t size, uint32_t load_addr = 0) override {
-        if (load_addr + size > mem.size()) return false;
+        if (load_addr > mem.size() || size > mem.size() - load_addr) return false;
         std::memcpy(mem.data() + load_addr, data, size);
         return true;
     }
-    
+
+    bool load_image(const FileImage& img, uint32_t load_addr = 0) override {
+        return mem.map_file(load_addr, img) || load_binary(img.data(), img.size(), load_addr);
+    }
+
+    bool mapped(uint32_t addr, uint32_t size) override {
+        return addr < mem.size() && size <= mem.size() - addr;
+    }
+
+    uint8_t* span(uint32_t addr, uint32_t& len) override {
+        if (addr >= mem.size()) return nullptr;
+        len = std::min<size_t>(len, mem.size() - addr);
+        return mem.data() + addr;
+    }
+
+    // Zeroes the RAM, handing its pages back to the host
+    void clear() { mem.clear(); }
+
+    uint8_t* data() { return mem.data(); }
     size_t size() const override { return mem.size(); }
 };
 
-#endif // MEMORY_SUBSYSTEM_H
\ No newline at end of file
+#ifdef RV32_GUARD_MEM
+// RAM at guest address 0 inside a guarded 4 GiB space (guest_memory.h): the
+// accesses need no bounds checks, anything past the RAM reads 0 / is dropped
+class GuardedMemory final : public MemorySubsystem {
+private:
+    GuestMemory mem;
+    size_t ram_size;
+
+public:
+    explicit GuardedMemory(size_t mem_size) : mem(mem_size), ram_size(mem_size) {}
+
+    uint32_t fetch32(uint32_t addr) override { return mem.fetch32(addr); }
+    void store32(uint32_t addr, uint32_t v) override { mem.store32(addr, v); }
+
+    uint16_t fetch16(uint32_t addr) override { return mem.fetch16(addr); }
+    void store16(uint32_t addr, uint16_t v) override { mem.store16(addr, v); }
+
+    uint8_t fetch8(uint32_t addr) override { return mem.fetch8(addr); }
+    void store8(uint32_t addr, uint8_t v) override { mem.store8(addr, v); }
+
+    bool load_binary(const uint8_t* data, size_t size, uint32_t load_addr = 0) override {
+        return mem.load_binary(data, size, load_addr);
+    }
+
+    bool load_image(const FileImage& img, uint32_t load_addr = 0) override {
+        return mem.load_image(img, load_addr);
+    }
+
+    bool mapped(uint32_t addr, uint32_t size) override { return mem.mapped(addr, size); }
+    uint8_t* span(uint32_t addr, uint32_t& len) override { return mem.span(addr, len); }
+
+    size_t size() const override { return ram_size; }
+};
+#endif
+
+// Bus adapter for CPU<VirtualBus>: every access is a virtual call into a
+// MemorySubsystem, which may place RAM and devices anywhere in the 32-bit
+// space (so the CPU covers all of it, and the JIT calls back for every access)
+class VirtualBus {
+private:
+    MemorySubsystem* mem;
+
+public:
+    explicit VirtualBus(MemorySubsystem* m) : mem(m) {}
+
+    uint32_t fetch32(uint32_t addr) { return mem->fetch32(addr); }
+    void store32(uint32_t addr, uint32_t v) { mem->store32(addr, v); }
+
+    uint16_t fetch16(uint32_t addr) { return mem->fetch16(addr); }
+    void store16(uint32_t addr, uint16_t v) { mem->store16(addr, v); }
+
+    uint8_t fetch8(uint32_t addr) { return mem->fetch8(addr); }
+    void store8(uint32_t addr, uint8_t v) { mem->store8(addr, v); }
+
+    bool load_binary(const uint8_t* data, size_t size, uint32_t load_addr = 0) {
+        return mem->load_binary(data, size, load_addr);
+    }
+
+    bool load_image(const FileImage& img, uint32_t load_addr = 0) {
+        return mem->load_image(img, load_addr);
+    }
+
+    bool mapped(uint32_t addr, uint32_t size) { return mem->mapped(addr, size); }
+    uint8_t* span(uint32_t addr, uint32_t& len) { return mem->span(addr, len); }
+
+    uint8_t* data() { return nullptr; }
+    uint64_t size() const { return 1ull << 32; }
+
+    MemorySubsystem* operator->() { return mem; }
+};
+
+// Bus adapter for CPU<DeviceBus<Mem>>: like VirtualBus, Mem may place RAM and
+// devices anywhere in the 32-bit space (SDLMemory), but Mem is a final class,
+// so the accesses are direct calls that inline into the engines.  data() is
+// Mem's host view of the whole space where it has one (MEM=guard builds), so
+// the JIT loads and stores there directly and devices are reached through
+// faults.
+template <class Mem>
+class DeviceBus {
+private:
+    Mem* mem;
+
+public:
+    explicit DeviceBus(Mem* m) : mem(m) {}
+
+    uint32_t fetch32(uint32_t addr) { return mem->fetch32(addr); }
+    void store32(uint32_t addr, uint32_t v) { mem->store32(addr, v); }
+
+    uint16_t fetch16(uint32_t addr) { return mem->fetch16(addr); }
+    void store16(uint32_t addr, uint16_t v) { mem->store16(addr, v); }
+
+    uint8_t fetch8(uint32_t addr) { return mem->fetch8(addr); }
+    void store8(uint32_t addr, uint8_t v) { mem->store8(addr, v); }
+
+    bool load_binary(const uint8_t* data, size_t size, uint32_t load_addr = 0) {
+        return mem->load_binary(data, size, load_addr);
+    }
+
+    bool load_image(const FileImage& img, uint32_t load_addr = 0) {
+        return mem->load_image(img, load_addr);
+    }
+
+    bool mapped(uint32_t addr, uint32_t size) { return mem->mapped(addr, size); }
+    uint8_t* span(uint32_t addr, uint32_t& len) { return mem->span(addr, len); }
+
+    uint8_t* data() { return mem->data(); }
+    uint64_t size() const { return 1ull << 32; }
+
+    Mem* operator->() { return mem; }
+};
+
+// Bus adapter for harts that share one memory (rv32ima --harts=N): each
+// hart's CPU<SharedBus<Mem>> forwards to the same Mem, owned by the caller.
+// The calls are not virtual, so they inline as for Mem itself, and the JIT
+// still accesses RAM directly.
+template <class Mem>
+class SharedBus {
+private:
+    Mem* mem;
+
+public:
+    explicit SharedBus(Mem* m) : mem(m) {}
+
+    uint32_t fetch32(uint32_t addr) { return mem->fetch32(addr); }
+    void store32(uint32_t addr, uint32_t v) { mem->store32(addr, v); }
+
+    uint16_t fetch16(uint32_t addr) { return mem->fetch16(addr); }
+    void store16(uint32_t addr, uint16_t v) { mem->store16(addr, v); }
+
+    uint8_t fetch8(uint32_t addr) { return mem->fetch8(addr); }
+    void store8(uint32_t addr, uint8_t v) { mem->store8(addr, v); }
+
+    bool load_binary(const uint8_t* data, size_t size, uint32_t load_addr = 0) {
+        return mem->load_binary(data, size, load_addr);
+    }
+
+    bool load_image(const FileImage& img, uint32_t load_addr = 0) {
+        return mem->load_image(img, load_addr);
+    }
+
+    bool mapped(uint32_t addr, uint32_t size) { return mem->mapped(addr, size); }
+    uint8_t* span(uint32_t addr, uint32_t& len) { return mem->span(addr, len); }
+
+    uint8_t* data() { return mem->data(); }
+    uint64_t size() const { return mem->size(); }
+};
+
+#endif // MEMORY_SUBSYSTEM_H
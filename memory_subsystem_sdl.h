@@ -1,28 +1,41 @@
 // SDL/MMIO Memory Subsystem for DOOM
-// Implements framebuffer, UART, and timer MMIO regions
+// Implements framebuffer, UART, keyboard and timer MMIO regions
+//
+// Guest addresses are decoded by a page table (address_map.h): RAM pages go
+// straight to host memory and each device registers the region it decodes.
+// With RV32_GUARD_MEM the RAM lives in a guarded 4 GiB address space instead
+// (guest_memory.h), where device accesses arrive through the fault handler.
+//
+// rv32ima_modular.cc runs the rv32ima CPU on it through DeviceBus
+// (memory_subsystem.h); the run loop calls update() between slices of
+// instructions.
 
 #ifndef MEMORY_SUBSYSTEM_SDL_H
 #define MEMORY_SUBSYSTEM_SDL_H
 
 #include "memory_subsystem.h"
+#include "address_map.h"
 #include <SDL2/SDL.h>
+#include <chrono>
+#include <cstdio>
 #include <iostream>
 #include <cstring>
 #include <vector>
 
-// Memory-mapped I/O addresses
-#define MMIO_UART_BASE    0x10000000
-#define MMIO_UART_SIZE    0x100
-#define MMIO_FB_BASE      0x11100000
-#define MMIO_FB_SIZE      (640 * 480 * 4)  // 640x480 @ 32bpp
-#define MMIO_KBD_BASE     0x11200000  // Keyboard input
-#define MMIO_KBD_SIZE     0x100
-#define MMIO_TIMER_BASE   0x11300000
-#define MMIO_TIMER_SIZE   0x100
+// Guest RAM, at the addresses the DOOM build is linked for (src_doom/riscv/riscv.lds)
+#define MEM_ROM_BASE      0x80000000
+#define MEM_ROM_SIZE      0x500000
+#define MEM_PSRAM_BASE    0x80500000
+#define MEM_PSRAM_SIZE    0x1300000
 
-class SDLMemory : public MemorySubsystem {
+class SDLMemory final : public MemorySubsystem {
 private:
-    std::vector<uint8_t> mem;
+#ifdef RV32_GUARD_MEM
+    GuestMemory mem;           // ROM and PSRAM mapped, devices reached through faults
+#else
+    HostRam ram;               // guest RAM from MEM_ROM_BASE up
+    AddressMap mem;            // decodes RAM and device pages
+#endif
     
     // SDL components
     SDL_Window* window;
@@ -36,7 +49,7 @@ private:
     
     // Timing
     uint64_t cycle_counter;
-    uint32_t update_counter;
+    std::chrono::steady_clock::time_point last_present;
     
     // Keyboard input queue
     std::vector<uint8_t> kbd_queue;
@@ -69,14 +82,112 @@ private:
         }
     }
     
+    // ─── Devices ──────────────────────────────────────────────────────────────
+    // Register reads and writes; offsets are relative to the device's region
+    // and size is the access width in bytes.
+    
+    // UART: byte writes to +0 are console output, +5 is the line status
+    uint32_t uart_read(uint32_t offset, uint32_t size) {
+        (void)size;
+        return offset == 5 ? 0x60 : 0;  // TX ready, RX ready
+    }
+    void uart_write(uint32_t offset, uint32_t v, uint32_t size) {
+        if (offset == 0 && size != 2) {
+            putchar(v & 0xFF);
+            fflush(stdout);
+        }
+    }
+    
+    // Framebuffer: one RGB word per pixel, stored as ARGB for SDL
+    uint32_t fb_read(uint32_t offset, uint32_t size) {
+        uint32_t pixel = offset / 4;
+        if (size != 4 || pixel >= uint32_t(fb_width * fb_height)) return 0;
+        // Convert ARGB to RGB (DOOM format)
+        uint32_t argb = framebuffer[pixel];
+        uint32_t r = (argb >> 16) & 0xFF;
+        uint32_t g = (argb >> 8) & 0xFF;
+        uint32_t b = argb & 0xFF;
+        return (r << 16) | (g << 8) | b;
+    }
+    void fb_write(uint32_t offset, uint32_t v, uint32_t size) {
+        uint32_t pixel = offset / 4;
+        if (pixel >= uint32_t(fb_width * fb_height)) return;
+        if (size == 4) {
+            // Convert RGB (DOOM format) to ARGB for SDL
+            uint32_t r = (v >> 16) & 0xFF;
+            uint32_t g = (v >> 8) & 0xFF;
+            uint32_t b = v & 0xFF;
+            framebuffer[pixel] = 0xFF000000 | (r << 16) | (g << 8) | b;
+        } else if (size == 1) {
+            // Byte write (less common)
+            uint32_t shift = (offset % 4) * 8;
+            framebuffer[pixel] = (framebuffer[pixel] & ~(0xFFu << shift)) | ((v & 0xFF) << shift);
+        }
+    }
+    
+    // Keyboard: +0 status (bit 0 = data available), +4 next key event
+    // (high bit set for keydown), write +8 to clear the queue
+    uint32_t kbd_read(uint32_t offset, uint32_t size) {
+        if (size != 4) return 0;
+        if (offset == 0) return kbd_read_pos < kbd_queue.size() ? 1 : 0;
+        if (offset == 4 && kbd_read_pos < kbd_queue.size()) return kbd_queue[kbd_read_pos++];
+        return 0;
+    }
+    void kbd_write(uint32_t offset, uint32_t v, uint32_t size) {
+        (void)v;
+        if (offset == 8 && size == 4) {
+            kbd_queue.clear();
+            kbd_read_pos = 0;
+        }
+    }
+    
+    // Timer: the 64-bit cycle counter at +0 (low) and +4 (high); read-only
+    uint32_t timer_read(uint32_t offset, uint32_t size) {
+        if (size != 4) return 0;
+        if (offset == 0) return cycle_counter & 0xFFFFFFFF;
+        if (offset == 4) return (cycle_counter >> 32) & 0xFFFFFFFF;
+        return 0;
+    }
+    
+    // With RV32_GUARD_MEM these callbacks run in the SIGSEGV handler on the
+    // emulation thread (see guest_memory.h).  That is fine for the stdio and
+    // plain member updates they do; they must not take locks that thread
+    // holds, throw, or call SDL, which update() does between slices.
+    void add_devices() {
+        using namespace std::placeholders;
+        mem.add_device("uart", 0x10000000, 0x100,
+                       std::bind(&SDLMemory::uart_read, this, _1, _2),
+                       std::bind(&SDLMemory::uart_write, this, _1, _2, _3));
+        mem.add_device("framebuffer", 0x11100000, fb_width * fb_height * 4,
+                       std::bind(&SDLMemory::fb_read, this, _1, _2),
+                       std::bind(&SDLMemory::fb_write, this, _1, _2, _3));
+        mem.add_device("keyboard", 0x11200000, 0x100,
+                       std::bind(&SDLMemory::kbd_read, this, _1, _2),
+                       std::bind(&SDLMemory::kbd_write, this, _1, _2, _3));
+        mem.add_device("timer", 0x11300000, 0x100,
+                       std::bind(&SDLMemory::timer_read, this, _1, _2), nullptr);
+    }
+    
 public:
+    // mem_size is the RAM behind MEM_ROM_BASE; with RV32_GUARD_MEM the ROM and
+    // PSRAM regions of the linker script are mapped instead
     explicit SDLMemory(size_t mem_size) 
-        : mem(mem_size, 0), window(nullptr), renderer(nullptr),
+        : window(nullptr), renderer(nullptr),
           texture(nullptr), sdl_initialized(false), quit_requested(false),
-          cycle_counter(0), update_counter(0), kbd_read_pos(0) {
+          cycle_counter(0), kbd_read_pos(0) {
         
         framebuffer = new uint32_t[fb_width * fb_height];
         memset(framebuffer, 0, fb_width * fb_height * sizeof(uint32_t));
+
+#ifdef RV32_GUARD_MEM
+        (void)mem_size;
+        mem.map(MEM_ROM_BASE, MEM_ROM_SIZE, false);
+        mem.map(MEM_PSRAM_BASE, MEM_PSRAM_SIZE);
+#else
+        ram = HostRam((mem_size + AddressMap::PAGE_MASK) & ~size_t(AddressMap::PAGE_MASK));
+        mem.add_ram(MEM_ROM_BASE, ram.data(), ram.size());
+#endif
+        add_devices();
         
         // Initialize SDL
         if (SDL_Init(SDL_INIT_VIDEO) == 0) {
@@ -112,201 +223,72 @@ public:
         }
     }
     
-    uint32_t fetch32(uint32_t addr) override {
-        // UART status register
-        if (addr == MMIO_UART_BASE + 5) {
-            return 0x60;  // TX ready, RX ready
-        }
-        
-        // Keyboard input
-        if (addr == MMIO_KBD_BASE) {
-            // Status register: bit 0 = data available
-            return kbd_read_pos < kbd_queue.size() ? 1 : 0;
-        }
-        if (addr == MMIO_KBD_BASE + 4) {
-            // Data register: read next key event
-            if (kbd_read_pos < kbd_queue.size()) {
-                return kbd_queue[kbd_read_pos++];
-            }
-            return 0;
-        }
-        
-        // Timer/cycle counter
-        if (addr == MMIO_TIMER_BASE) {
-            return cycle_counter & 0xFFFFFFFF;
-        }
-        if (addr == MMIO_TIMER_BASE + 4) {
-            return (cycle_counter >> 32) & 0xFFFFFFFF;
-        }
-        
-        // Framebuffer read (usually not used by DOOM)
-        if (addr >= MMIO_FB_BASE && addr < MMIO_FB_BASE + MMIO_FB_SIZE) {
-            uint32_t offset = (addr - MMIO_FB_BASE) / 4;
-            if (offset < fb_width * fb_height) {
-                uint32_t pixel = framebuffer[offset];
-                // Convert ARGB to RGB (DOOM format)
-                uint32_t r = (pixel >> 16) & 0xFF;
-                uint32_t g = (pixel >> 8) & 0xFF;
-                uint32_t b = pixel & 0xFF;
-                return (r << 16) | (g << 8) | b;
-            }
-            return 0;
-        }
-        
-        // Regular memory - map high addresses down to fit in our memory
-        uint32_t mapped_addr = addr & 0x3FFFFFF;  // Map to 64MB range
-        if (mapped_addr + 3 >= mem.size()) return 0;
-        return mem[mapped_addr] | (mem[mapped_addr+1]<<8) | (mem[mapped_addr+2]<<16) | (mem[mapped_addr+3]<<24);
-    }
+    uint32_t fetch32(uint32_t addr) override { return mem.fetch32(addr); }
+    uint16_t fetch16(uint32_t addr) override { return mem.fetch16(addr); }
+    uint8_t fetch8(uint32_t addr) override   { return mem.fetch8(addr); }
     
-    void store32(uint32_t addr, uint32_t v) override {
-        // UART output
-        if (addr == MMIO_UART_BASE) {
-            putchar(v & 0xFF);
-            fflush(stdout);
-            return;
-        }
-        
-        // Framebuffer write
-        if (addr >= MMIO_FB_BASE && addr < MMIO_FB_BASE + MMIO_FB_SIZE) {
-            uint32_t offset = (addr - MMIO_FB_BASE) / 4;
-            if (offset < fb_width * fb_height) {
-                // Convert RGB (DOOM format) to ARGB for SDL
-                uint32_t r = (v >> 16) & 0xFF;
-                uint32_t g = (v >> 8) & 0xFF;
-                uint32_t b = v & 0xFF;
-                framebuffer[offset] = 0xFF000000 | (r << 16) | (g << 8) | b;
-            }
-            return;
-        }
-        
-        // Keyboard control (write to clear queue)
-        if (addr == MMIO_KBD_BASE + 8) {
-            kbd_queue.clear();
-            kbd_read_pos = 0;
-            return;
-        }
-        
-        // Timer (read-only, ignore writes)
-        if (addr >= MMIO_TIMER_BASE && addr < MMIO_TIMER_BASE + MMIO_TIMER_SIZE) {
-            return;
-        }
-        
-        // Regular memory - map high addresses down to fit in our memory
-        uint32_t mapped_addr = addr & 0x3FFFFFF;  // Map to 64MB range
-        if (mapped_addr + 3 >= mem.size()) return;
-        mem[mapped_addr]   = v;
-        mem[mapped_addr+1] = v >> 8;
-        mem[mapped_addr+2] = v >> 16;
-        mem[mapped_addr+3] = v >> 24;
-    }
+    void store32(uint32_t addr, uint32_t v) override { mem.store32(addr, v); }
+    void store16(uint32_t addr, uint16_t v) override { mem.store16(addr, v); }
+    void store8(uint32_t addr, uint8_t v) override   { mem.store8(addr, v); }
     
-    uint16_t fetch16(uint32_t addr) override {
-        // MMIO regions typically don't support 16-bit access
-        if (addr >= MMIO_UART_BASE && addr < MMIO_UART_BASE + MMIO_UART_SIZE) return 0;
-        if (addr >= MMIO_TIMER_BASE && addr < MMIO_TIMER_BASE + MMIO_TIMER_SIZE) return 0;
-        
-        // Regular memory - map high addresses down to fit in our memory
-        uint32_t mapped_addr = addr & 0x3FFFFFF;  // Map to 64MB range
-        if (mapped_addr + 1 >= mem.size()) return 0;
-        return mem[mapped_addr] | (mem[mapped_addr+1]<<8);
-    }
-    
-    void store16(uint32_t addr, uint16_t v) override {
-        // MMIO regions typically don't support 16-bit access
-        if (addr >= MMIO_UART_BASE && addr < MMIO_UART_BASE + MMIO_UART_SIZE) return;
-        if (addr >= MMIO_FB_BASE && addr < MMIO_FB_BASE + MMIO_FB_SIZE) return;
-        if (addr >= MMIO_TIMER_BASE && addr < MMIO_TIMER_BASE + MMIO_TIMER_SIZE) return;
-        
-        // Regular memory - map high addresses down to fit in our memory
-        uint32_t mapped_addr = addr & 0x3FFFFFF;  // Map to 64MB range
-        if (mapped_addr + 1 >= mem.size()) return;
-        mem[mapped_addr]   = v;
-        mem[mapped_addr+1] = v >> 8;
-    }
-    
-    uint8_t fetch8(uint32_t addr) override {
-        // UART status
-        if (addr == MMIO_UART_BASE + 5) return 0x60;
-        
-        // Regular memory - map high addresses down to fit in our memory
-        uint32_t mapped_addr = addr & 0x3FFFFFF;  // Map to 64MB range
-        if (mapped_addr >= mem.size()) return 0;
-        return mem[mapped_addr];
+    // Images go to their link address (MEM_ROM_BASE for the DOOM build)
+    bool load_binary(const uint8_t* data, size_t size, uint32_t load_addr = 0) override {
+        return mem.load_binary(data, size, load_addr);
     }
-    
-    void store8(uint32_t addr, uint8_t v) override {
-        // UART output
-        if (addr == MMIO_UART_BASE) {
-            putchar(v);
-            fflush(stdout);
-            return;
-        }
-        
-        // Framebuffer byte write (less common)
-        if (addr >= MMIO_FB_BASE && addr < MMIO_FB_BASE + MMIO_FB_SIZE) {
-            uint32_t pixel_offset = (addr - MMIO_FB_BASE) / 4;
-            uint32_t byte_offset = (addr - MMIO_FB_BASE) % 4;
-            if (pixel_offset < fb_width * fb_height) {
-                uint32_t mask = 0xFF << (byte_offset * 8);
-                framebuffer[pixel_offset] = (framebuffer[pixel_offset] & ~mask) | 
-                                           ((uint32_t)v << (byte_offset * 8));
-            }
-            return;
-        }
-        
-        // Regular memory - map high addresses down to fit in our memory
-        uint32_t mapped_addr = addr & 0x3FFFFFF;  // Map to 64MB range
-        if (mapped_addr >= mem.size()) return;
-        mem[mapped_addr] = v;
+
+    // The image (code, data and the WAD for DOOM) is mapped copy-on-write, so
+    // instances running the same file share its pages
+    bool load_image(const FileImage& img, uint32_t load_addr = 0) override {
+#ifdef RV32_GUARD_MEM
+        return mem.load_image(img, load_addr);
+#else
+        return (load_addr >= MEM_ROM_BASE && ram.map_file(load_addr - MEM_ROM_BASE, img)) ||
+               mem.load_binary(img.data(), img.size(), load_addr);
+#endif
     }
     
-    bool load_binary(const uint8_t* data, size_t size, uint32_t load_addr = 0) override {
-        // Map high addresses down to fit in our memory
-        uint32_t mapped_addr = load_addr & 0x3FFFFFF;  // Map to 64MB range
-        if (mapped_addr + size > mem.size()) return false;
-        std::memcpy(mem.data() + mapped_addr, data, size);
-        return true;
-    }
+    bool mapped(uint32_t addr, uint32_t size) override { return mem.mapped(addr, size); }
+    uint8_t* span(uint32_t addr, uint32_t& len) override { return mem.span(addr, len); }
     
+    // Called by the run loop between slices of guest instructions: latches
+    // the cycle count for the timer, takes the pending SDL events and shows
+    // the framebuffer, at most 60 times a second
     void update(uint64_t cycles) override {
         cycle_counter = cycles;
-        update_counter++;
-        
-        // Handle SDL events periodically
-        if (sdl_initialized && (update_counter % 10000 == 0)) {
-            SDL_Event event;
-            while (SDL_PollEvent(&event)) {
-                if (event.type == SDL_QUIT) {
-                    quit_requested = true;
-                } else if (event.type == SDL_KEYDOWN || event.type == SDL_KEYUP) {
-                    // Convert SDL key to DOOM key
-                    uint8_t doom_key = sdl_to_doom_key(event.key.keysym.sym);
-                    if (doom_key != 0) {
-                        // Add to queue: high bit set for keydown, clear for keyup
-                        uint8_t key_event = doom_key;
-                        if (event.type == SDL_KEYDOWN) {
-                            key_event |= 0x80;  // Set high bit for keydown
-                        }
-                        kbd_queue.push_back(key_event);
-                        
-                        // Limit queue size to prevent overflow
-                        if (kbd_queue.size() > 256) {
-                            kbd_queue.erase(kbd_queue.begin(), kbd_queue.begin() + 128);
-                            if (kbd_read_pos > 128) kbd_read_pos -= 128;
-                            else kbd_read_pos = 0;
-                        }
+        if (!sdl_initialized) return;
+
+        SDL_Event event;
+        while (SDL_PollEvent(&event)) {
+            if (event.type == SDL_QUIT) {
+                quit_requested = true;
+            } else if (event.type == SDL_KEYDOWN || event.type == SDL_KEYUP) {
+                // Convert SDL key to DOOM key
+                uint8_t doom_key = sdl_to_doom_key(event.key.keysym.sym);
+                if (doom_key != 0) {
+                    // Add to queue: high bit set for keydown, clear for keyup
+                    uint8_t key_event = doom_key;
+                    if (event.type == SDL_KEYDOWN) {
+                        key_event |= 0x80;  // Set high bit for keydown
+                    }
+                    kbd_queue.push_back(key_event);
+                    
+                    // Limit queue size to prevent overflow
+                    if (kbd_queue.size() > 256) {
+                        kbd_queue.erase(kbd_queue.begin(), kbd_queue.begin() + 128);
+                        if (kbd_read_pos > 128) kbd_read_pos -= 128;
+                        else kbd_read_pos = 0;
                     }
                 }
             }
         }
         
-        // Update display periodically
-        if (sdl_initialized && (update_counter % 100000 == 0)) {
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_present >= std::chrono::milliseconds(16)) {
             SDL_UpdateTexture(texture, NULL, framebuffer, fb_width * sizeof(uint32_t));
             SDL_RenderClear(renderer);
             SDL_RenderCopy(renderer, texture, NULL, NULL);
             SDL_RenderPresent(renderer);
+            last_present = now;
         }
     }
     
@@ -314,7 +296,19 @@ public:
         return quit_requested;
     }
     
-    size_t size() const override { return mem.size(); }
+    // Host address of guest address 0 in MEM=guard builds, where the whole
+    // space is one mapping (DeviceBus hands it to the JIT); nullptr otherwise
+#ifdef RV32_GUARD_MEM
+    uint8_t* data() { return mem.data(); }
+#else
+    uint8_t* data() { return nullptr; }
+#endif
+
+#ifdef RV32_GUARD_MEM
+    size_t size() const override { return MEM_ROM_SIZE + MEM_PSRAM_SIZE; }
+#else
+    size_t size() const override { return ram.size(); }
+#endif
 };
 
 #endif // MEMORY_SUBSYSTEM_SDL_H
\ No newline at end of file
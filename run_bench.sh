@@ -0,0 +1,81 @@
+#!/bin/bash
+
+# Script to compare the switch and threaded (computed goto) interpreters, the
+# execution engines of the threaded build, and the templated bus against the
+# virtual MemorySubsystem one (--bus=virtual)
+
+# Colors for output
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+NC='\033[0m' # No Color
+
+# Configuration
+CXX="${CXX:-g++}"
+CFLAGS="${CFLAGS:--O3 -Wall}"
+PROGRAM="${1:-./bench.bin}"
+RUNS="${RUNS:-5}"
+TEMP_DIR="./bench_temp"
+
+mkdir -p "$TEMP_DIR"
+
+if [ ! -f "$PROGRAM" ]; then
+    echo "Error: benchmark program not found at $PROGRAM"
+    exit 1
+fi
+
+echo "Building interpreter variants..."
+$CXX $CFLAGS -pthread -o "$TEMP_DIR/rv32ima_switch" rv32ima.cc -lz || exit 1
+$CXX $CFLAGS -DRV32_THREADED -pthread -o "$TEMP_DIR/rv32ima_threaded" rv32ima.cc -lz || exit 1
+
+# Best-of-N wall time in milliseconds
+best_time() {
+    local best=""
+    for i in $(seq "$RUNS"); do
+        local start=$(date +%s%N)
+        "$@" > /dev/null
+        local end=$(date +%s%N)
+        local ms=$(( (end - start) / 1000000 ))
+        if [ -z "$best" ] || [ "$ms" -lt "$best" ]; then
+            best=$ms
+        fi
+    done
+    echo "$best"
+}
+
+echo "Running $PROGRAM (best of $RUNS)"
+echo "==============================="
+
+for variant in switch:interp threaded:interp threaded:block threaded:jit; do
+    sim="$TEMP_DIR/rv32ima_${variant%%:*}"
+    engine="--engine=${variant##*:}"
+    ms=$(best_time "$sim" "$engine" "$PROGRAM")
+    echo -e "  ${GREEN}$variant${NC}: ${ms} ms"
+
+    # Host branch statistics, when perf is available
+    if command -v perf &> /dev/null; then
+        perf stat -x, -e instructions,branches,branch-misses "$sim" "$engine" "$PROGRAM" 2>&1 > /dev/null |
+            awk -F, '{ printf "      %-14s %s\n", $3, $1 }'
+    fi
+done
+
+# Guest MIPS with the bus inlined into the CPU (CPU<BasicMemory>) and behind
+# the virtual interface (CPU<VirtualBus>)
+sim="$TEMP_DIR/rv32ima_threaded"
+instructions=$("$sim" --stats "$PROGRAM" 2>&1 > /dev/null | awk '/^Executed/ { print $2 }')
+echo ""
+echo "Bus: templated vs virtual ($instructions instructions)"
+for engine in interp block jit; do
+    line="  ${engine}:"
+    for bus in direct virtual; do
+        ms=$(best_time "$sim" "--engine=$engine" "--bus=$bus" "$PROGRAM")
+        mips=$(awk -v n="$instructions" -v ms="$ms" 'BEGIN { printf "%.0f", ms ? n / ms / 1000 : 0 }')
+        line="$line $bus ${mips} MIPS"
+    done
+    echo -e "${GREEN}${line}${NC}"
+done
+
+if ! command -v perf &> /dev/null; then
+    echo -e "${YELLOW}perf not found: install linux-perf to see branch-miss counts${NC}"
+fi
+
+rm -rf "$TEMP_DIR"
@@ -0,0 +1,93 @@
+#!/bin/bash
+
+# Script to check that every execution engine and build variant runs the
+# programs in tests/ exactly like the interpreter: same output, same exit
+# code.  The flat-memory build's --engine=interp is the reference; the
+# fixtures come from tests/mkfixtures.py.
+
+# Colors for output
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+NC='\033[0m' # No Color
+
+# Configuration
+CXX="${CXX:-g++}"
+CFLAGS="${CFLAGS:--O3 -Wall}"
+TEST_DIR="./tests"
+TEMP_DIR="./check_temp"
+
+mkdir -p "$TEMP_DIR"
+
+echo "Building memory variants..."
+BUILDS="flat"
+$CXX $CFLAGS -DRV32_THREADED -pthread -o "$TEMP_DIR/rv32ima_flat" rv32ima.cc -lz || exit 1
+if [ "$(uname -m)" = x86_64 ] && [ "$(uname -s)" = Linux ]; then
+    $CXX $CFLAGS -DRV32_THREADED -DRV32_GUARD_MEM -pthread -o "$TEMP_DIR/rv32ima_guard" rv32ima.cc -lz || exit 1
+    BUILDS="$BUILDS guard"
+else
+    echo -e "${YELLOW}MEM=guard needs x86-64 Linux: checking the flat build only${NC}"
+fi
+
+VARIANTS=(
+    "--engine=interp"
+    "--engine=interp --no-fusion"
+    "--engine=block"
+    "--engine=block --no-fusion"
+    "--engine=block --block-threshold=1"
+    "--engine=jit"
+    "--engine=jit --no-fusion"
+    "--engine=jit --jit-sync --block-threshold=1 --jit-threshold=1"
+    "--engine=interp --bus=virtual"
+    "--engine=block --bus=virtual"
+    "--engine=jit --bus=virtual"
+)
+
+PASSED=0
+FAILED=0
+
+# Runs one program on one build with the given options; stdout goes to $TEMP_DIR/out
+run() {
+    local build="$1" program="$2"
+    shift 2
+    timeout 60 "$TEMP_DIR/rv32ima_$build" "$@" "$program" > "$TEMP_DIR/out" 2> /dev/null
+}
+
+check() {
+    if [ "$1" = 0 ]; then
+        PASSED=$((PASSED + 1))
+    else
+        echo -e "${RED}FAIL${NC} $2"
+        FAILED=$((FAILED + 1))
+    fi
+}
+
+for program in "$TEST_DIR"/random_*.bin; do
+    run flat "$program" --engine=interp
+    expected_exit=$?
+    mv "$TEMP_DIR/out" "$TEMP_DIR/expected"
+    for build in $BUILDS; do
+        for variant in "${VARIANTS[@]}"; do
+            run "$build" "$program" $variant
+            status=$?
+            cmp -s "$TEMP_DIR/out" "$TEMP_DIR/expected" && [ $status = $expected_exit ]
+            check $? "$(basename "$program") MEM=$build $variant (exit $status, expected $expected_exit)"
+        done
+    done
+done
+
+# Lost updates from amoadd or LR/SC show up as a wrong count
+for build in $BUILDS; do
+    for engine in interp block jit; do
+        run "$build" "$TEST_DIR/harts_counter.bin" --harts=4 --engine=$engine
+        status=$?
+        [ $status = 0 ] && [ "$(cat "$TEMP_DIR/out")" = ok ]
+        check $? "harts_counter.bin MEM=$build --harts=4 --engine=$engine (exit $status)"
+    done
+done
+
+rm -rf "$TEMP_DIR"
+
+echo "==============================="
+echo -e "Results: ${GREEN}$PASSED passed${NC}, ${RED}$FAILED failed${NC}"
+[ $FAILED = 0 ]
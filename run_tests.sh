@@ -75,17 +75,9 @@ run_test() {
         return 1
     fi
     
-    # Convert to binary
-    "${CROSS_COMPILE}objcopy" -O binary "$TEMP_DIR/$test_name.elf" "$TEMP_DIR/$test_name.bin" 2>/dev/null
-    
-    if [ $? -ne 0 ]; then
-        echo -e "${RED}FAIL${NC} (objcopy failed)"
-        return 1
-    fi
-    
     # Run the test with timeout and capture output
     # Use perl for timeout on macOS (works universally)
-    perl -e 'alarm 10; exec @ARGV' "$SIMULATOR" "$TEMP_DIR/$test_name.bin" > "$TEMP_DIR/$test_name.log" 2>&1
+    perl -e 'alarm 10; exec @ARGV' "$SIMULATOR" "$TEMP_DIR/$test_name.elf" > "$TEMP_DIR/$test_name.log" 2>&1
     local exit_code=$?
     
     # Check if test passed
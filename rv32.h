@@ -0,0 +1,129 @@
+// librv32: the rv32ima emulator as a library (make lib)
+//
+// A Machine is one RV32IMA hart with its own RAM at guest address 0, run by
+// the same engines as rv32ima (interpreter, cached blocks, x86-64 JIT).  Any
+// number of machines can live in one process (MEM=guard builds: at most 16),
+// each used by one thread at a time.  Nothing here exits the process: every
+// way a run can end comes back as a Result.
+//
+//   rv32::Machine m;
+//   if (!m.load("test.elf", &error)) ...
+//   rv32::Result r = m.run_until(rv32::Until().budget(100000000));
+//   if (r.reason == rv32::Exit::Halt) printf("exit %u, a1 = %u\n", r.exit_code, m.regs()[11]);
+//
+// Registers and RAM are the machine's own storage, not copies; the host may
+// change them between runs.  After writing code into RAM, tell the machine
+// with code_changed() so it drops what it decoded or translated there.
+//
+// Link with librv32.a -pthread -lz.
+
+#ifndef RV32_H
+#define RV32_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// The library's only exported symbols (it is built with hidden visibility)
+#ifdef __GNUC__
+#define RV32_API __attribute__((visibility("default")))
+#else
+#define RV32_API
+#endif
+
+namespace rv32 {
+
+// Why run_until() returned
+enum class Exit {
+  Halt,        // the guest called exit (a7 = 93); exit_code holds a0
+  Ebreak,      // EBREAK; pc points at it
+  Illegal,     // illegal instruction; pc points at it
+  Budget,      // the instruction budget ran out
+  Breakpoint,  // execution reached the pc of Until::at; the instruction there has not run
+  Event,       // ecall with a7 = Until::on_ecall; pc points at it, and the next run
+               // continues after it (set a0 first to return a value)
+};
+
+struct Result {
+  Exit reason;
+  uint32_t exit_code;      // a0 of the exit call (Exit::Halt)
+  uint32_t pc;
+  uint64_t instructions;   // retired during this run
+};
+
+// Stop conditions of one run_until() call; the guest's own exits (exit,
+// EBREAK, illegal instructions) always stop it
+struct Until {
+  uint64_t instructions = UINT64_MAX;   // budget
+  bool has_pc = false;
+  uint32_t pc = 0;                      // stop before executing the instruction here
+  bool has_ecall = false;
+  uint32_t ecall = 0;                   // stop at an ecall with this a7
+
+  Until& budget(uint64_t n) { instructions = n; return *this; }
+  Until& at(uint32_t addr) { has_pc = true; pc = addr; return *this; }
+  Until& on_ecall(uint32_t a7) { has_ecall = true; ecall = a7; return *this; }
+};
+
+enum class Engine { Interp, Block, Jit };
+
+struct Config {
+  size_t ram_size = 2 << 20;      // bytes of RAM at guest address 0
+  Engine engine = Engine::Jit;    // Block in builds without the JIT
+  bool jit_background = true;     // translate on a compile thread of the machine's own
+  bool capture_console = false;   // collect guest stdout/stderr in console() instead of printing
+};
+
+class RV32_API Machine {
+public:
+  explicit Machine(const Config& config = Config());
+  ~Machine();
+  Machine(const Machine&) = delete;
+  Machine& operator=(const Machine&) = delete;
+
+  // Loads a program file: an ELF executable at its segments' addresses (pc =
+  // its entry point), anything else as a flat image at 0 (pc = 0).  False
+  // with *error set if it cannot be read or does not fit.
+  bool load(const char* path, std::string* error = nullptr);
+
+  // Copies an image to guest address addr; false if it does not fit
+  bool load(const uint8_t* data, size_t size, uint32_t addr = 0);
+
+  // Runs from pc until a stop condition or the guest's exit
+  Result run_until(const Until& until = Until());
+
+  // Back to power-on: registers, counters, caches and RAM cleared (RAM pages
+  // go back to the host).  Load a program again afterwards.
+  void reset();
+
+  // Architectural state, in place
+  uint32_t* regs();                // x0..x31; x0 must stay 0
+  uint32_t& pc();
+  uint64_t instructions() const;   // retired since reset
+
+  // Guest RAM [0, ram_size()) as host memory
+  uint8_t* ram();
+  size_t ram_size() const;
+
+  // Host address of guest [addr, addr + size) if it lies in RAM, else nullptr
+  uint8_t* host_address(uint32_t addr, size_t size);
+
+  // Drops decoded and translated code for [addr, addr + size) after the host
+  // wrote there
+  void code_changed(uint32_t addr, size_t size);
+
+  // Guest output collected with Config::capture_console
+  std::string& console();
+
+  // "symbol+0x10" for addr in the loaded ELF program, or ""
+  std::string symbol(uint32_t addr) const;
+
+private:
+  struct Impl;
+  std::unique_ptr<Impl> impl;
+};
+
+}  // namespace rv32
+
+#endif  // RV32_H
@@ -1,3 +1,4 @@
+#include <chrono>
 #include <cstdint>
 #include <vector>
 #include <iostream>
@@ -6,71 +7,512 @@
 #include <fstream>
 #include <iterator>
 #include <cassert>
+#include <cerrno>
 #include <climits>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "rv32ima_isa.h"
+#include "rv32ima_trace.h"
+
+// x86-64 hosts translate hot blocks to native code (build with -DRV32_NO_JIT
+// to leave it out)
+#if defined(__x86_64__) && !defined(RV32_NO_JIT)
+#define RV32_JIT
+#include <condition_variable>
+#include "x86_emitter.h"
+#endif
+
+#include "memory_subsystem.h"
+#include "elf_loader.h"
+#include "linux_user.h"
+#include "semihosting.h"
+
+// The CPU is a template over its bus (memory_subsystem.h).  The console
+// emulator runs on plain RAM at guest address 0; MEM=guard builds keep it in
+// a guarded 4 GiB address space (guest_memory.h), so loads and stores skip
+// the bounds checks.
+#ifdef RV32_GUARD_MEM
+typedef GuestMemory DefaultBus;
+#else
+typedef BasicMemory DefaultBus;
+#endif
 
 // -----------------------------------------------------------------------------
 // RV32IMA simulator with full trace output
 // Supports: I (base), M (multiply/divide), A (atomic)
 // -----------------------------------------------------------------------------
 
+// Fused pairs (rv32ima_fused.h) are numbered after the table-decoded ops
+static constexpr uint8_t OP_FUSED_FIRST = OP_LI;
+static constexpr uint32_t FUSED_COUNT = OP_COUNT - OP_FUSED_FIRST;
+static const char* const FUSED_NAMES[FUSED_COUNT] = {
+  "lui+addi", "auipc+jalr", "auipc+lw",
+  "slt+bnez", "slt+beqz", "sltu+bnez", "sltu+beqz",
+  "addi+sw",
+};
+
+static constexpr uint32_t PAGE_SHIFT = 12;
+static constexpr uint32_t PAGE_MASK  = (1u << PAGE_SHIFT) - 1;
+
+struct DecodedPage {
+  DecodedIns ins[(1u << (PAGE_SHIFT - 2)) + 1]{};   // one slot per aligned word
+  DecodedPage() { ins[1u << (PAGE_SHIFT - 2)].op = OP_PAGE_END; }
+};
+
+// ─── Basic blocks ────────────────────────────────────────────────────────────
+// Straight-line runs of predecoded instructions ending at a branch, JAL, JALR
+// or FENCE.I (so code patched before a fence.i is picked up).  SYSTEM
+// instructions (ECALL, EBREAK, CSR*) and illegal encodings always form
+// single-instruction blocks: everything before them has retired when they run,
+// so the cycle counter they observe stays exact.  Blocks never cross a page
+// boundary.
+static constexpr uint32_t MAX_BLOCK_INS = 64;
+
+// Stores to cached code are remembered word by word until the next block
+// exit, which drops just the blocks overlapping them; past this many words
+// it flushes the whole cache instead
+static constexpr uint32_t DIRTY_MAX = 64;
+
+struct Block;
+// Runs translated code from a block onwards, following links between
+// translations; sets cpu->pc and returns the block it finally left (cpu is
+// the CPU<Bus> the code was translated for)
+typedef Block* (*NativeBlock)(void* cpu);
+
+struct Block {
+  uint32_t pc = 0;               // guest address of the first instruction
+  uint32_t n_ins = 0;            // guest instructions in the block
+  std::vector<DecodedIns> ins;   // body, followed by an OP_BLOCK_END sentinel
+
+  // Direct links to successor blocks, filled in as they are discovered, so
+  // the common path never goes back to the hash table
+  uint32_t next_pc[2] = {};
+  Block* next[2] = {};
+
+  uint32_t hits = 0;             // times run by the block interpreter
+#ifdef RV32_JIT
+  // Translated code, once the block is hot; published by the compile thread
+  std::atomic<NativeBlock> native{nullptr};
+#endif
+  void* native_body = nullptr;   // its entry for jumps from other translations
+  uint32_t exit_pc[2] = {1, 1};  // static successors of the translation (1 = none)
+  void* exit_to[2] = {};         // their native_body, once linked
+};
+
+static bool ends_block(uint8_t op) {
+  return (op >= OP_JAL && op <= OP_BGEU) || op == OP_FENCE_I || op == OP_ECALL || op == OP_EBREAK ||
+         (op >= OP_CSRRW && op <= OP_CSRRCI) || op == OP_ILLEGAL;
+}
+
+static bool runs_alone(uint8_t op) {
+  return ends_block(op) && !(op >= OP_JAL && op <= OP_BGEU) && op != OP_FENCE_I;
+}
+
+// Ops whose only effect is writing x[rd]; with rd == 0 they are no-ops.
+// Loads are not: the access itself may fault or reach a device.
+static bool only_writes_rd(uint8_t op) {
+  return op == OP_LUI || op == OP_AUIPC || (op >= OP_ADDI && op <= OP_REMU);
+}
+
+// Ops that can be dropped when nothing reads their result (loads are kept:
+// their address may be bad)
+static bool is_pure(uint8_t op) {
+  return op == OP_LUI || op == OP_AUIPC || (op >= OP_ADDI && op <= OP_REMU);
+}
+
+// Guest registers a record reads and writes, as bit masks.  For a fused op d
+// is the first record of the pair and d[1] the second.
+static void reg_effects(const DecodedIns* d, uint32_t& reads, uint32_t& writes) {
+  uint8_t op = d->op;
+  uint32_t rd = 1u << d->rd, rs1 = 1u << d->rs1, rs2 = 1u << d->rs2;
+  reads = writes = 0;
+  if (op == OP_LUI || op == OP_AUIPC || op == OP_LI) writes = rd;
+  else if (op == OP_JAL) writes = rd;
+  else if (op == OP_JALR || (op >= OP_LB && op <= OP_LHU) || (op >= OP_ADDI && op <= OP_SRAI) || op == OP_LR) {
+    reads = rs1; writes = rd;
+  }
+  else if ((op >= OP_BEQ && op <= OP_BGEU) || (op >= OP_SB && op <= OP_SW)) reads = rs1 | rs2;
+  else if ((op >= OP_ADD && op <= OP_REMU) || (op >= OP_SC && op <= OP_AMOMAXU) ||
+           (op >= OP_SLT_BNEZ && op <= OP_SLTU_BEQZ)) {
+    reads = rs1 | rs2; writes = rd;
+  }
+  else if (op >= OP_CSRRW && op <= OP_CSRRC) { reads = rs1; writes = rd; }
+  else if (op >= OP_CSRRWI && op <= OP_CSRRCI) writes = rd;
+  else if (op == OP_AUIPC_JALR || op == OP_AUIPC_LW) writes = rs1 | rd;
+  else if (op == OP_ADDI_SW) { reads = rd | (1u << d[1].rs2); writes = rd; }
+  else if (op == OP_ECALL) { reads = ~0u; writes = 1u << 10; }
+  reads &= ~1u;
+  writes &= ~1u;
+}
+
+enum Engine {
+  ENGINE_INTERP,   // one predecoded instruction at a time
+  ENGINE_BLOCK,    // tiers 0-1: single-stepping, then chained basic blocks
+  ENGINE_JIT,      // tiers 0-2: as above, hot blocks translated to x86-64
+};
+
+#ifdef RV32_JIT
+static constexpr Engine DEFAULT_ENGINE = ENGINE_JIT;
+#else
+static constexpr Engine DEFAULT_ENGINE = ENGINE_BLOCK;
+#endif
+
+// Tier thresholds: times a pc is entered (single-stepping) before it gets a
+// block, and times a block is interpreted before it is translated.  Entry
+// counts live in a small direct-mapped table; collisions only make code hot
+// a little early.
+static constexpr uint32_t DEFAULT_BLOCK_THRESHOLD = 4;
+static constexpr uint32_t DEFAULT_JIT_THRESHOLD = 64;
+static constexpr uint32_t HEAT_SLOTS = 4096;
+
+// Size of the buffer translations live in (recycled with the block cache)
+static constexpr size_t JIT_CODE_SIZE = 32 << 20;
+
+// Why CPU::run() returned
+enum ExitReason {
+  EXIT_NONE = 0,   // still running
+  EXIT_HALT,       // the guest called exit (a7 = 93); exit_code holds a0
+  EXIT_EBREAK,     // EBREAK; pc points at it
+  EXIT_ILLEGAL,    // illegal instruction; pc points at it
+  EXIT_LIMIT,      // max_instructions have retired
+  EXIT_CLONE,      // the guest reached its clone point; pc points at the ecall
+  EXIT_EVENT,      // ecall with a7 = stop_syscall (embedders, rv32.h); pc points at it
+};
+
+// Syscall number (a7) of the clone point: with clone_pending set it stops the
+// run for rv32ima --clones; otherwise it returns the clone number in a0
+static constexpr uint32_t SYS_CLONE_POINT = 4096;
+
+// Per-instruction tracing is a template parameter of the run loop, so the
+// untraced loops contain no trace code at all
+enum TraceMode {
+  TRACE_OFF,
+  TRACE_FULL,      // disassembly and register dump before every instruction
+  TRACE_BINARY,    // compact records to CPU::trace_out (rv32ima_trace.h)
+};
+
+// The fast loops only check the instruction limit at control transfers,
+// page ends and block exits, and hand over to single-stepping once they are
+// closer than this to it (the longest run between two checks is a page)
+static constexpr uint64_t LIMIT_SLACK = 1u << (PAGE_SHIFT - 2);
+
+// LR/SC reservations of harts sharing RAM (rv32ima --harts=N).  Any store to
+// a reserved word from another hart breaks the reservation, even one that
+// writes back the value LR read.  The first LR in a page flags the page in
+// every hart's code_pages.  From then on, stores there leave the fast path:
+// translated stores take their slow path, since the flag is nonzero.  They
+// bump the word's sequence number under a striped lock, and SC checks that
+// number under the same lock.
+class ReservationSet {
+public:
+  static constexpr uint8_t WATCHED = 2;   // code_pages flag (1 is "has decoded code")
+
+  ReservationSet() {
+#if defined(__linux__) && defined(SYS_membarrier)
+    expedited = syscall(SYS_membarrier, 1 << 4, 0, 0) == 0;   // MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED
+#endif
+  }
+
+  void attach(std::vector<uint8_t>& code_pages) { pages.push_back(&code_pages); }
+
+  static bool watched(const std::vector<uint8_t>& code_pages, uint32_t addr) {
+    uint32_t page = addr >> PAGE_SHIFT;
+    return page < code_pages.size() && (__atomic_load_n(&code_pages[page], __ATOMIC_ACQUIRE) & WATCHED);
+  }
+
+  // LR at addr: returns the sequence number SC must still find
+  uint32_t reserve(uint32_t addr) {
+    uint32_t page = addr >> PAGE_SHIFT;
+    if (!watched(*pages[0], addr)) {
+      for (std::vector<uint8_t>* p : pages) __atomic_fetch_or(&(*p)[page], WATCHED, __ATOMIC_SEQ_CST);
+      // A store another hart began before it saw the flag must land before
+      // LR reads the word
+#if defined(__linux__) && defined(SYS_membarrier)
+      if (!expedited || syscall(SYS_membarrier, 1 << 3, 0, 0) != 0)   // MEMBARRIER_CMD_PRIVATE_EXPEDITED
+#endif
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+    return slot(addr).seq.load(std::memory_order_acquire);
+  }
+
+  // A store (or AMO) of len bytes to a watched page, done by write()
+  template <typename F>
+  void store(uint32_t addr, uint32_t len, F write) {
+    Slot& a = slot(addr);
+    Slot& b = slot(addr + len - 1);
+    Slot& lo = &a < &b ? a : b;
+    Slot& hi = &a < &b ? b : a;
+    std::lock_guard<std::mutex> l1(lo.lock);
+    std::unique_lock<std::mutex> l2(hi.lock, std::defer_lock);
+    if (&hi != &lo) l2.lock();
+    write();
+    a.seq.fetch_add(1, std::memory_order_release);
+    if (&b != &a) b.seq.fetch_add(1, std::memory_order_release);
+  }
+
+  // SC: write() runs, and returns whether it stored, only if no store has
+  // hit the word since LR saw seq
+  template <typename F>
+  bool store_conditional(uint32_t addr, uint32_t seq, F write) {
+    Slot& s = slot(addr);
+    std::lock_guard<std::mutex> lock(s.lock);
+    if (s.seq.load(std::memory_order_relaxed) != seq || !write()) return false;
+    s.seq.fetch_add(1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  static constexpr uint32_t SLOTS = 1024;   // words hash to slots; a collision only makes SC fail
+  struct alignas(64) Slot {
+    std::mutex lock;
+    std::atomic<uint32_t> seq{0};
+  };
+  Slot slots[SLOTS];
+  std::vector<std::vector<uint8_t>*> pages;   // every hart's code_pages
+  bool expedited = false;
+
+  Slot& slot(uint32_t addr) { return slots[(addr >> 2) % SLOTS]; }
+};
+
+template <class Bus = DefaultBus>
 struct CPU {
   // ─── Core state ────────────────────────────────────────────────────────────
-  uint32_t pc = 0;
-  uint32_t x[32]{};          // integer registers
+  // What the run loops and translated code touch on every instruction or
+  // block exit fills the first three cache lines: pc, the counter and its
+  // limits, the reservation and the exit flags in the first, the registers in
+  // the next two.  Everything else comes after.
+  alignas(64) uint32_t pc = 0;
+  ExitReason exit_reason = EXIT_NONE;  // why the last run() stopped
   uint64_t cycles = 0;
-  std::vector<uint8_t> mem;  // flat little-endian memory
-  
-  // Atomic extension state
+  uint64_t fast_limit = UINT64_MAX;    // fast loops stop when cycles reaches this
+  uint64_t cycle_limit = UINT64_MAX;   // run() stops when cycles reaches this
+  uint32_t reservation_addr = 0;       // LR/SC reservation (A extension), the
+  uint32_t reservation_value = 0;      // value LR read there and, with several
+  uint32_t reservation_seq = 0;        // harts, the word's store sequence number
   bool has_reservation = false;
-  uint32_t reservation_addr = 0;
-  
-  // CSR (Control and Status Register) state
-  uint32_t csr[4096]{};  // CSR address space
+  bool blocks_dirty = false;           // drop stale blocks (or flush) at the next block exit
+  ReservationSet* reservations = nullptr;   // shared by the harts of rv32ima --harts=N
+  alignas(64) uint32_t x[32]{};        // integer registers
+
+  Bus mem;                   // guest memory and devices
+  uint32_t exit_code = 0;    // a0 of the exit syscall
+
+  // Harts sharing mem (rv32ima --harts=N) and this one's number (mhartid)
+  uint32_t harts = 1, hart_id = 0;
+  bool code_stale = false;   // fence.i with several harts: drop all cached code
+
+  // rv32ima --clones: stop at the guest's clone point, and which clone this is
+  bool clone_pending = false;
+  uint32_t clone_id = 0;
+
+  // Syscall number that stops the run with EXIT_EVENT when has_stop_syscall
+  // is set, so the host can serve the call (librv32's Machine)
+  bool has_stop_syscall = false;
+  uint32_t stop_syscall = 0;
+
+  // Linux user-mode personality (rv32ima --linux): serves every system call
+  // but the clone point
+  LinuxProcess* process = nullptr;
+
+  // Host files for RISC-V semihosting calls (--semihosting); without it
+  // every EBREAK stops the run
+  Semihost* semihost = nullptr;
+
+  // CSRs.  The machine-mode trap CSRs have fields of their own; any other
+  // CSR that is ever written lives in a side table.  The counters are views
+  // of cycles.
+  uint32_t mstatus = 0, mie = 0, mtvec = 0, mscratch = 0;
+  uint32_t mepc = 0, mcause = 0, mtval = 0, mip = 0;
+  std::unordered_map<uint32_t, uint32_t> csr_other;
   
-  // Trace mode
+  // Diagnostics on stderr for unhandled syscalls
   bool trace_enabled = false;
+  std::string* console = nullptr;           // collects guest output instead of stdout
+  std::unique_ptr<TraceWriter> trace_out;   // destination of TRACE_BINARY runs
+
+  // Predecode cache, one lazily allocated page of records per guest page;
+  // code_pages mirrors which of them exist (read by translated stores)
+  std::vector<std::unique_ptr<DecodedPage>> decoded;
+  std::vector<uint8_t> code_pages;
+  DecodedIns uncached[2] = {{}, {OP_PAGE_END, 0, 0, 0, 0}};
+
+  // Block cache; block_pages counts the cached blocks in each guest page
+  // (blocks never cross one), dirty_code lists the code words stored to since
+  // the last block exit
+  Engine engine = DEFAULT_ENGINE;
+  std::unordered_map<uint32_t, std::unique_ptr<Block>> blocks;
+  std::vector<uint16_t> block_pages;
+  std::vector<uint32_t> dirty_code;
+  uint32_t flushes = 0;        // bumped whenever blocks are dropped, so callers can tell blocks died
+
+  // Block optimizer (optimize_block) and its statistics
+  bool fusion = true;
+  bool fusion_stats = false;            // print the counters when the guest exits
+  uint64_t fused_hits[FUSED_COUNT]{};   // executions of each fused pattern
+  uint64_t fused_formed[FUSED_COUNT]{}; // instances formed while building blocks
+  uint64_t x0_folded = 0, dead_dropped = 0;
+
+  // Tiering
+  uint32_t block_threshold = DEFAULT_BLOCK_THRESHOLD;
+  uint32_t jit_threshold = DEFAULT_JIT_THRESHOLD;
+  uint32_t heat[HEAT_SLOTS]{};  // entry counts of pcs that have no block yet
+
+#ifdef RV32_JIT
+  // Translations are made on a background thread unless jit_background is
+  // off.  Lock order: jit_queue_mutex, then jit_code_mutex (held while a
+  // block is compiled or the code buffer is recycled).
+  bool jit_background = true;
+  std::unique_ptr<x86::CodeBuffer> jit_code;   // allocated on first translation
+  std::thread jit_thread;
+  std::mutex jit_queue_mutex, jit_code_mutex;
+  std::condition_variable jit_cv;
+  std::deque<Block*> jit_queue;
+  bool jit_stop = false;
+  std::atomic<bool> jit_full{false};           // code buffer ran out of space
+#endif
   
-  explicit CPU(size_t mem_size, bool trace = false) : mem(mem_size), trace_enabled(trace) {}
+  // bus_arg goes to the bus constructor (the RAM size for BasicMemory and
+  // GuestMemory, the MemorySubsystem for VirtualBus)
+  template <class BusArg>
+  explicit CPU(BusArg&& bus_arg, bool trace = false)
+    : mem(std::forward<BusArg>(bus_arg)), trace_enabled(trace), decoded((mem.size() + PAGE_MASK) >> PAGE_SHIFT),
+      code_pages(decoded.size()), block_pages(decoded.size()) {}
 
-  // ─── Memory access helpers ─────────────────────────────────────────────────
-  uint32_t fetch32(uint32_t addr) const {
-    if (addr + 3 >= mem.size()) {
-      std::cerr << "fetch32: addr=0x" << std::hex << addr << " mem.size=0x" << mem.size() << std::endl;
-      return 0;
-    }
-    return mem[addr] | mem[addr+1]<<8 | mem[addr+2]<<16 | mem[addr+3]<<24;
+#ifdef RV32_JIT
+  ~CPU() { jit_shutdown(); }
+#endif
+
+  // Back to the state of a new CPU, keeping the bus and the allocations
+  // (JIT code buffer and compile thread included), so the object can run
+  // another program.  Guest memory is left as it is.
+  void reset() {
+    pc = 0;
+    exit_reason = EXIT_NONE;
+    cycles = 0;
+    fast_limit = cycle_limit = UINT64_MAX;
+    has_reservation = false;
+    std::fill(std::begin(x), std::end(x), 0);
+    exit_code = 0;
+    mstatus = mie = mtvec = mscratch = mepc = mcause = mtval = mip = 0;
+    csr_other.clear();
+    for (std::unique_ptr<DecodedPage>& p : decoded) p.reset();
+    for (uint8_t& c : code_pages) c &= ReservationSet::WATCHED;   // other harts may still reserve
+    flush_blocks();
+    std::fill(std::begin(heat), std::end(heat), 0);
+    std::fill(std::begin(fused_hits), std::end(fused_hits), 0);
+    std::fill(std::begin(fused_formed), std::end(fused_formed), 0);
+    x0_folded = dead_dropped = 0;
   }
 
+  // Call before fork(): a child gets only the calling thread, so the compile
+  // thread is stopped (pending translations stay queued) and the next request
+  // in either process starts a new one
+  void prepare_fork() {
+#ifdef RV32_JIT
+    jit_shutdown();
+    jit_stop = false;
+#endif
+  }
+
+  // ─── Memory access helpers ─────────────────────────────────────────────────
+  // Stores also drop any predecoded instructions they overwrite.
+  uint32_t fetch8(uint32_t addr)  { return mem.fetch8(addr); }
+  uint32_t fetch16(uint32_t addr) { return mem.fetch16(addr); }
+  uint32_t fetch32(uint32_t addr) { return mem.fetch32(addr); }
+
   void store32(uint32_t addr, uint32_t v) {
-    assert(addr + 3 < mem.size());
-    mem[addr]   = v;
-    mem[addr+1] = v >> 8;
-    mem[addr+2] = v >> 16;
-    mem[addr+3] = v >> 24;
+    if (reserved(addr)) reservations->store(addr, 4, [&] { mem.store32(addr, v); });
+    else mem.store32(addr, v);
+    invalidate_decoded(addr, 4);
+  }
+  void store16(uint32_t addr, uint16_t v) {
+    if (reserved(addr)) reservations->store(addr, 2, [&] { mem.store16(addr, v); });
+    else mem.store16(addr, v);
+    invalidate_decoded(addr, 2);
+  }
+  void store8(uint32_t addr, uint8_t v) {
+    if (reserved(addr)) reservations->store(addr, 1, [&] { mem.store8(addr, v); });
+    else mem.store8(addr, v);
+    invalidate_decoded(addr, 1);
+  }
+
+  // A store to addr must break other harts' reservations (ReservationSet)
+  bool reserved(uint32_t addr) const {
+    return reservations && ReservationSet::watched(code_pages, addr);
+  }
+
+  // Host address of an aligned guest word in directly accessible RAM, for
+  // atomics other harts must see as one access; nullptr for anything else
+  // (which falls back to a plain load and store)
+  uint32_t* atomic_word(uint32_t addr) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (mem.data() && !(addr & 3) && mem.mapped(addr, 4)) return (uint32_t*)(mem.data() + addr);
+#endif
+    return nullptr;
   }
   
   // ─── Syscall handling ─────────────────────────────────────────────────────
   void handle_syscall() {
     uint32_t syscall_num = x[17];  // a7
+    if (has_stop_syscall && syscall_num == stop_syscall) {
+      exit_reason = EXIT_EVENT;
+      return;
+    }
+    if (process && syscall_num != SYS_CLONE_POINT) {
+      if (!process->syscall(*this)) {
+        exit_code = x[10];
+        exit_reason = EXIT_HALT;
+      }
+      return;
+    }
     
     switch (syscall_num) {
-      case 93: {  // Exit
-        uint32_t exit_code = x[10];  // a0
-        if (trace_enabled) {
-          std::cout << "Program exited with code " << exit_code << std::endl;
+      case 93:  // Exit
+        exit_code = x[10];  // a0
+        exit_reason = EXIT_HALT;
+        break;
+      case SYS_CLONE_POINT:
+        if (clone_pending) exit_reason = EXIT_CLONE;
+        else x[10] = clone_id;
+        break;
+      case 63: {  // Read: stdin straight into guest RAM
+        struct iovec iov;
+        if (x[10] != 0 || !guest_iov(x[11], x[12], &iov, 1)) {
+          x[10] = -1;
+          break;
         }
-        exit(exit_code);
+        ssize_t n;
+        while ((n = read(0, iov.iov_base, iov.iov_len)) < 0 && errno == EINTR) {}
+        if (n > 0) code_changed(x[11], n);
+        x[10] = n < 0 ? -1 : n;
+        break;
       }
       case 64: {  // Write
         uint32_t fd = x[10];     // a0
         uint32_t buf = x[11];    // a1
         uint32_t count = x[12];  // a2
         
-        if (fd == 1 || fd == 2) {  // stdout or stderr
-          for (uint32_t i = 0; i < count && buf + i < mem.size(); i++) {
-            std::cout << (char)mem[buf + i];
+        if (fd == 1 || fd == 2) {  // stdout or stderr, both to stdout
+          struct iovec iov[8];
+          int n = guest_iov(buf, count, iov, 8);   // the part of the buffer that is memory
+          if (console) {
+            for (int i = 0; i < n; i++) console->append(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+          } else {
+            static std::mutex out_mutex;   // one write at a time across harts
+            std::lock_guard<std::mutex> lock(out_mutex);
+            if (trace_enabled) fflush(stdout);   // trace lines first
+            write_all(1, iov, n);
           }
-          std::cout.flush();
           x[10] = count;  // return number of bytes written
         } else {
           x[10] = -1;  // error
@@ -85,6 +527,59 @@ struct CPU {
     }
   }
   
+  // Host spans of guest [addr, addr + len), at most max of them, up to the
+  // first byte that is not plain memory; returns how many there are.  A
+  // range within one RAM region is one span.
+  int guest_iov(uint32_t addr, uint32_t len, struct iovec* iov, int max) {
+    int n = 0;
+    while (len && n < max) {
+      uint32_t part = len;
+      uint8_t* p = mem.span(addr, part);
+      if (!p) break;
+      iov[n++] = {p, part};
+      addr += part;
+      len -= part;
+    }
+    return n;
+  }
+
+  // One writev(2) of the spans, more only if the host takes them in parts
+  static void write_all(int fd, struct iovec* iov, int n) {
+    while (n) {
+      ssize_t done = writev(fd, iov, n);
+      if (done < 0) {
+        if (errno == EINTR) continue;
+        return;
+      }
+      for (; n && size_t(done) >= iov->iov_len; iov++, n--) done -= iov->iov_len;
+      if (n) iov->iov_base = static_cast<char*>(iov->iov_base) + done, iov->iov_len -= done;
+    }
+  }
+
+  // An EBREAK at `at` between slli x0, x0, 0x1f and srai x0, x0, 7 in the
+  // same page is a semihosting call when a host is attached; true if it
+  // was one (and has been served)
+  __attribute__((noinline, cold)) bool semihost_call(uint32_t at) {
+    if (!semihost || (at & PAGE_MASK) < 4 || (at & PAGE_MASK) > PAGE_MASK - 7) return false;
+    if (fetch32(at - 4) != SEMIHOST_ENTRY || fetch32(at) != 0x00100073 || fetch32(at + 4) != SEMIHOST_EXIT)
+      return false;   // a planted breakpoint is an EBREAK record over other code
+    if (!semihost->call(*this)) {
+      exit_code = x[10];
+      exit_reason = EXIT_HALT;
+    }
+    return true;
+  }
+
+  void print_fusion_stats() const {
+    std::cerr << std::dec << "fusion:    pattern     formed        executed\n";
+    for (uint32_t i = 0; i < FUSED_COUNT; i++) {
+      std::cerr << "  " << std::setw(16) << std::setfill(' ') << FUSED_NAMES[i]
+                << std::setw(11) << fused_formed[i] << std::setw(16) << fused_hits[i] << "\n";
+    }
+    std::cerr << "  " << std::setw(16) << "x0 writes" << std::setw(11) << x0_folded << "  (folded to nop)\n";
+    std::cerr << "  " << std::setw(16) << "dead" << std::setw(11) << dead_dropped << "  (dropped)\n";
+  }
+  
   // ─── CSR (Control and Status Register) operations ────────────────────────
   uint32_t read_csr(uint32_t addr) {
     // Special handling for certain CSRs
@@ -105,8 +600,13 @@ struct CPU {
       case 0xC82:  // instreth (upper 32 bits)
       case 0xB82:  // minstreth
         return (cycles >> 32) & 0xFFFFFFFF;
-      default:
-        return csr[addr];
+      case 0xF14:  // mhartid
+        return hart_id;
+      default: {
+        if (uint32_t* f = csr_field(addr)) return *f;
+        auto it = csr_other.find(addr);
+        return it == csr_other.end() ? 0 : it->second;
+      }
     }
   }
   
@@ -119,415 +619,1205 @@ struct CPU {
       case 0xC81:  // timeh (read-only)
       case 0xC02:  // instret (read-only)
       case 0xC82:  // instreth (read-only)
+      case 0xF14:  // mhartid (read-only)
         // Silently ignore writes to read-only CSRs
         break;
       default:
-        csr[addr] = value;
+        if (uint32_t* f = csr_field(addr)) *f = value;
+        else csr_other[addr] = value;
         break;
     }
   }
 
-  // ─── Instruction decoding helpers ──────────────────────────────────────────
-  std::string decode_ins(uint32_t ins) {
-    std::stringstream ss;
-    
-    uint32_t opc = ins & 0x7f;
-    uint32_t rd  = (ins >> 7) & 0x1f;
-    uint32_t f3  = (ins >> 12) & 0x7;
-    uint32_t rs1 = (ins >> 15) & 0x1f;
-    uint32_t rs2 = (ins >> 20) & 0x1f;
-    uint32_t f7  = ins >> 25;
-
-    auto sx = [](uint32_t v, unsigned bits) {
-      uint32_t sign = 1u << (bits - 1);
-      return int32_t((v ^ sign) - sign);
-    };
-
-    auto imm_i = [&]{ return sx(ins>>20,12); };
-    auto imm_u = [&]{ return ins & 0xfffff000u; };
-    auto imm_s = [&]{ return sx(((ins>>7)&0x1f)|((ins>>20)&0xfe0),12); };
-    auto imm_b = [&]{
-      uint32_t v = ((ins>>7)&0x1e)|((ins>>20)&0x7e0)|((ins<<4)&0x800)|((ins>>19)&0x1000);
-      return sx(v,13);
-    };
-    auto imm_j = [&]{
-      uint32_t v = ((ins>>21)&0x3ff)<<1;
-      v |= ((ins>>20)&1)<<11;
-      v |= ((ins>>12)&0xff)<<12;
-      v |= (ins>>31)<<20;
-      return sx(v,21);
-    };
-
-    switch (opc) {
-      case 0x37: ss << "lui  x" << rd << ",0x" << std::hex << imm_u(); break;
-      case 0x17: ss << "auipc x" << rd << ",0x" << std::hex << imm_u(); break;
-      case 0x6f: ss << "jal  x" << rd << "," << std::dec << imm_j(); break;
-      case 0x67: ss << "jalr x" << rd << ",x" << rs1 << "," << imm_i(); break;
-      case 0x63: {
-        const char* names[] = {"beq","bne","?","?","blt","bge","bltu","bgeu"};
-        ss << names[f3] << " x" << rs1 << ",x" << rs2 << "," << imm_b();
-        break;
+  // The dedicated field for a CSR, or nullptr
+  uint32_t* csr_field(uint32_t addr) {
+    switch (addr) {
+      case 0x300: return &mstatus;
+      case 0x304: return &mie;
+      case 0x305: return &mtvec;
+      case 0x340: return &mscratch;
+      case 0x341: return &mepc;
+      case 0x342: return &mcause;
+      case 0x343: return &mtval;
+      case 0x344: return &mip;
+      default:    return nullptr;
+    }
+  }
+
+  // ─── Predecoding ───────────────────────────────────────────────────────────
+  // Both are generated from the instruction table in rv32ima_isa.h.
+  std::string decode_ins(uint32_t ins) { return disassemble(ins); }
+  static DecodedIns decode(uint32_t ins) { return predecode<RV32_ISA>(ins); }
+
+  // Returns the cache slot for the instruction at addr.  Slots start out as
+  // OP_UNDECODED and are filled on first execution.  Misaligned and
+  // out-of-range fetches bypass the cache and use a scratch slot instead.
+  DecodedIns* decoded_slot(uint32_t addr) {
+    uint32_t page = addr >> PAGE_SHIFT;
+    if ((addr & 3) || page >= decoded.size()) {
+      uncached[0] = decode(fetch32(addr));
+      return uncached;
+    }
+    std::unique_ptr<DecodedPage>& p = decoded[page];
+    if (!p) {
+      p.reset(new DecodedPage());
+      __atomic_fetch_or(&code_pages[page], 1, __ATOMIC_RELAXED);   // keeps ReservationSet::WATCHED
+    }
+    return &p->ins[(addr & PAGE_MASK) >> 2];
+  }
+
+  DecodedIns fetch_decoded(uint32_t addr) {
+    DecodedIns* d = decoded_slot(addr);
+    if (d->op == OP_UNDECODED) *d = decode(fetch32(addr));
+    return *d;
+  }
+
+  // Makes the instruction at addr (aligned, inside the decoded space) stop
+  // every engine as an EBREAK would, by replacing its record; blocks and
+  // translations holding the real instruction are dropped at the next block
+  // exit.  A store to the word, or remove_breakpoint, decodes it again.
+  bool plant_breakpoint(uint32_t addr) {
+    if ((addr & 3) || (addr >> PAGE_SHIFT) >= decoded.size()) return false;
+    invalidate_word(addr);
+    *decoded_slot(addr) = {OP_EBREAK, 0, 0, 0, 0};
+    return true;
+  }
+  void remove_breakpoint(uint32_t addr) { invalidate_word(addr); }
+
+  // Drops the records, blocks and translations of code in [addr, addr +
+  // size) after the host wrote there behind the guest's back (system calls
+  // reading into guest RAM, librv32 hosts); a page nothing was decoded in
+  // costs one check
+  void code_changed(uint32_t addr, size_t size) {
+    uint64_t at = addr & ~3u, end = uint64_t(addr) + size;
+    while (at < end) {
+      uint64_t page = at >> PAGE_SHIFT;
+      if (page >= decoded.size()) break;
+      if (!decoded[page]) {
+        at = (page + 1) << PAGE_SHIFT;
+        continue;
       }
-      case 0x03: {
-        const char* names[] = {"lb","lh","lw","?","lbu","lhu"};
-        ss << names[f3] << " x" << rd << "," << imm_i() << "(x" << rs1 << ")";
-        break;
+      invalidate_word(uint32_t(at));
+      at += 4;
+    }
+  }
+
+  // Forget the records of the (at most two) words overlapped by a guest store
+  void invalidate_decoded(uint32_t addr, uint32_t len) {
+    invalidate_word(addr);
+    if ((addr ^ (addr + len - 1)) & ~3u) invalidate_word(addr + len - 1);
+  }
+
+  // Only words that have been decoded can be part of a block, so plain data
+  // sharing a page with code costs nothing beyond the page check
+  void invalidate_word(uint32_t addr) {
+    uint32_t page = addr >> PAGE_SHIFT;
+    if (page >= decoded.size() || !decoded[page]) return;
+    DecodedIns& slot = decoded[page]->ins[(addr & PAGE_MASK) >> 2];
+    if (slot.op == OP_UNDECODED) return;
+    slot.op = OP_UNDECODED;
+    if (block_pages[page]) {
+      if (dirty_code.size() <= DIRTY_MAX) dirty_code.push_back(addr & ~3u);
+      blocks_dirty = true;
+    }
+  }
+
+  // ─── Shared instruction helpers ────────────────────────────────────────────
+  void exec_csr(const DecodedIns& d, uint32_t src, int kind) {
+    uint32_t csr_addr = d.imm;
+    uint32_t old_val = read_csr(csr_addr);
+    uint32_t new_val = old_val;
+
+    switch (kind) {
+      case 1: new_val = src; break;             // CSRRW/CSRRWI
+      case 2: new_val = old_val | src; break;   // CSRRS/CSRRSI
+      case 3: new_val = old_val & ~src; break;  // CSRRC/CSRRCI
+    }
+
+    if (d.rd != 0) x[d.rd] = old_val;
+    if (kind == 1 || d.rs1 != 0) write_csr(csr_addr, new_val);
+  }
+
+  // AMOs on RAM are a host compare-and-swap loop, so they are atomic with
+  // respect to every other hart
+  template <typename F>
+  void exec_amo(const DecodedIns& d, F op) {
+    uint32_t addr = x[d.rs1], old_val;
+    if (uint32_t* p = atomic_word(addr)) {
+      auto update = [&] {
+        old_val = __atomic_load_n(p, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(p, &old_val, op(old_val, x[d.rs2]), true,
+                                            __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {}
+      };
+      if (reserved(addr)) reservations->store(addr, 4, update);
+      else update();
+      invalidate_decoded(addr, 4);
+    } else {
+      old_val = fetch32(addr);
+      store32(addr, op(old_val, x[d.rs2]));
+    }
+    if (d.rd) x[d.rd] = old_val;
+  }
+
+  // SC: stores v if the reservation still holds.  With several harts any
+  // store another hart made to the word since LR breaks it (ReservationSet);
+  // the word must also still hold what LR read.
+  bool store_conditional(uint32_t addr, uint32_t v) {
+    if (!has_reservation || reservation_addr != addr) return false;
+    has_reservation = false;
+    if (uint32_t* p = atomic_word(addr)) {
+      auto swap = [&] {
+        uint32_t expected = reservation_value;
+        return __atomic_compare_exchange_n(p, &expected, v, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+      };
+      if (reservations ? !reservations->store_conditional(addr, reservation_seq, swap) : !swap()) return false;
+      invalidate_decoded(addr, 4);
+    } else {
+      store32(addr, v);
+    }
+    return true;
+  }
+
+  // fence.i.  A hart sees its own code stores straight away; with several
+  // harts another one may have rewritten code this one has cached, so all of
+  // it is dropped (the decoded records now, the blocks at the next exit).
+  void fence_i() {
+    if (harts == 1) return;
+    for (std::unique_ptr<DecodedPage>& p : decoded) {
+      if (!p) continue;
+      for (uint32_t i = 0; i < (1u << (PAGE_SHIFT - 2)); i++) p->ins[i].op = OP_UNDECODED;
+    }
+    code_stale = blocks_dirty = true;
+  }
+
+  // Executes one record at address `at` without touching pc or cycles (used
+  // by translated blocks for the instructions they do not inline)
+  void exec_one(const DecodedIns& d, uint32_t at) {
+#define OP(name) case OP_##name:
+#define D        d
+#define PC       at
+#define NEXT     break
+#define JUMP(t)  { (void)(t); break; }
+#define STOP     break
+    switch (d.op) {
+#include "rv32ima_ops.h"
+    default: break;
+    }
+#undef OP
+#undef D
+#undef PC
+#undef NEXT
+#undef JUMP
+#undef STOP
+  }
+
+  // ─── Tracing ───────────────────────────────────────────────────────────────
+  // Disassembly and register dump of the instruction at pc (TRACE_FULL)
+  __attribute__((noinline, cold)) void trace_step() {
+    uint32_t ins = fetch32(pc);
+    print_trace_entry(std::cout, cycles, pc, ins, decode_ins(ins), x);
+  }
+
+  // Runs the instruction at pc and hands its record to trace_out
+  // (TRACE_BINARY).  Memory accesses are logged with the value in memory
+  // once the instruction has run.
+  __attribute__((noinline)) void trace_binary_step() {
+    uint32_t at = pc, ins = fetch32(pc);
+    const DecodedIns d = fetch_decoded(pc);
+    uint32_t size = 0, addr = x[d.rs1] + d.imm, value = 0;
+    if (d.op >= OP_LB && d.op <= OP_LHU) size = (d.op == OP_LB || d.op == OP_LBU) ? 1 : (d.op == OP_LW) ? 4 : 2;
+    else if (d.op >= OP_SB && d.op <= OP_SW) size = 1u << (d.op - OP_SB);
+    else if (d.op >= OP_LR && d.op <= OP_AMOMAXU) { size = 4; addr = x[d.rs1]; }
+
+    step<TRACE_OFF>();
+
+    if (size && mem.mapped(addr, size))   // never re-read a device
+      value = size == 1 ? fetch8(addr) : size == 2 ? fetch16(addr) : fetch32(addr);
+    trace_out->record(at, ins, x, size, addr, value);
+  }
+
+  // ─── Main step function ────────────────────────────────────────────────────
+  // An instruction that stops the run (exit_reason set) leaves pc at itself
+  // and does not retire.
+  template <TraceMode Trace>
+  void step() {
+    if (Trace == TRACE_BINARY) { trace_binary_step(); return; }
+    if (Trace == TRACE_FULL) trace_step();
+
+    // Fetch predecoded instruction (a copy: stores may overwrite its slot)
+    const DecodedIns d = fetch_decoded(pc);
+
+    // Execute
+#define OP(name) case OP_##name:
+#define D        d
+#define PC       pc
+#define NEXT     { pc += 4; break; }
+#define JUMP(t)  { pc = (t); break; }
+#define STOP     return
+    switch (d.op) {
+#include "rv32ima_ops.h"
+    default: break;
+    }
+#undef OP
+#undef D
+#undef PC
+#undef NEXT
+#undef JUMP
+#undef STOP
+
+    x[0] = 0;  // x0 is always zero
+    cycles++;
+  }
+
+#ifdef RV32_THREADED
+  // Handler addresses for the computed-goto loops, indexed by Op.  Ops of
+  // extensions outside RV32_ISA are never decoded and have no handler; their
+  // slots point at op_ILLEGAL only to keep the initializer list in order.
+#if RV32_ISA & RV32_EXT_M
+#define RV32_M_LABELS \
+      [OP_MUL] = &&op_MUL, [OP_MULH] = &&op_MULH, [OP_MULHSU] = &&op_MULHSU, [OP_MULHU] = &&op_MULHU, \
+      [OP_DIV] = &&op_DIV, [OP_DIVU] = &&op_DIVU, [OP_REM] = &&op_REM, [OP_REMU] = &&op_REMU,
+#else
+#define RV32_M_LABELS \
+      [OP_MUL] = &&op_ILLEGAL, [OP_MULH] = &&op_ILLEGAL, [OP_MULHSU] = &&op_ILLEGAL, [OP_MULHU] = &&op_ILLEGAL, \
+      [OP_DIV] = &&op_ILLEGAL, [OP_DIVU] = &&op_ILLEGAL, [OP_REM] = &&op_ILLEGAL, [OP_REMU] = &&op_ILLEGAL,
+#endif
+#if RV32_ISA & RV32_EXT_A
+#define RV32_A_LABELS \
+      [OP_LR] = &&op_LR, [OP_SC] = &&op_SC, [OP_AMOADD] = &&op_AMOADD, [OP_AMOSWAP] = &&op_AMOSWAP, \
+      [OP_AMOXOR] = &&op_AMOXOR, [OP_AMOOR] = &&op_AMOOR, [OP_AMOAND] = &&op_AMOAND, \
+      [OP_AMOMIN] = &&op_AMOMIN, [OP_AMOMAX] = &&op_AMOMAX, [OP_AMOMINU] = &&op_AMOMINU, \
+      [OP_AMOMAXU] = &&op_AMOMAXU,
+#else
+#define RV32_A_LABELS \
+      [OP_LR] = &&op_ILLEGAL, [OP_SC] = &&op_ILLEGAL, [OP_AMOADD] = &&op_ILLEGAL, [OP_AMOSWAP] = &&op_ILLEGAL, \
+      [OP_AMOXOR] = &&op_ILLEGAL, [OP_AMOOR] = &&op_ILLEGAL, [OP_AMOAND] = &&op_ILLEGAL, \
+      [OP_AMOMIN] = &&op_ILLEGAL, [OP_AMOMAX] = &&op_ILLEGAL, [OP_AMOMINU] = &&op_ILLEGAL, \
+      [OP_AMOMAXU] = &&op_ILLEGAL,
+#endif
+#define RV32_OP_LABELS \
+      [OP_UNDECODED] = &&op_UNDECODED, [OP_PAGE_END] = &&op_PAGE_END, \
+      [OP_BLOCK_END] = &&op_BLOCK_END, [OP_ILLEGAL] = &&op_ILLEGAL, \
+      [OP_LUI] = &&op_LUI, [OP_AUIPC] = &&op_AUIPC, [OP_JAL] = &&op_JAL, [OP_JALR] = &&op_JALR, \
+      [OP_BEQ] = &&op_BEQ, [OP_BNE] = &&op_BNE, [OP_BLT] = &&op_BLT, [OP_BGE] = &&op_BGE, \
+      [OP_BLTU] = &&op_BLTU, [OP_BGEU] = &&op_BGEU, \
+      [OP_LB] = &&op_LB, [OP_LH] = &&op_LH, [OP_LW] = &&op_LW, [OP_LBU] = &&op_LBU, [OP_LHU] = &&op_LHU, \
+      [OP_SB] = &&op_SB, [OP_SH] = &&op_SH, [OP_SW] = &&op_SW, \
+      [OP_ADDI] = &&op_ADDI, [OP_SLTI] = &&op_SLTI, [OP_SLTIU] = &&op_SLTIU, [OP_XORI] = &&op_XORI, \
+      [OP_ORI] = &&op_ORI, [OP_ANDI] = &&op_ANDI, [OP_SLLI] = &&op_SLLI, [OP_SRLI] = &&op_SRLI, \
+      [OP_SRAI] = &&op_SRAI, \
+      [OP_ADD] = &&op_ADD, [OP_SUB] = &&op_SUB, [OP_SLL] = &&op_SLL, [OP_SLT] = &&op_SLT, \
+      [OP_SLTU] = &&op_SLTU, [OP_XOR] = &&op_XOR, [OP_SRL] = &&op_SRL, [OP_SRA] = &&op_SRA, \
+      [OP_OR] = &&op_OR, [OP_AND] = &&op_AND, \
+      RV32_M_LABELS \
+      [OP_NOP] = &&op_NOP, [OP_FENCE] = &&op_FENCE, [OP_FENCE_I] = &&op_FENCE_I, \
+      [OP_ECALL] = &&op_ECALL, [OP_EBREAK] = &&op_EBREAK, \
+      [OP_CSRRW] = &&op_CSRRW, [OP_CSRRS] = &&op_CSRRS, [OP_CSRRC] = &&op_CSRRC, \
+      [OP_CSRRWI] = &&op_CSRRWI, [OP_CSRRSI] = &&op_CSRRSI, [OP_CSRRCI] = &&op_CSRRCI, \
+      RV32_A_LABELS
+#define RV32_FUSED_LABELS \
+      [OP_LI] = &&op_LI, [OP_AUIPC_JALR] = &&op_AUIPC_JALR, [OP_AUIPC_LW] = &&op_AUIPC_LW, \
+      [OP_SLT_BNEZ] = &&op_SLT_BNEZ, [OP_SLT_BEQZ] = &&op_SLT_BEQZ, \
+      [OP_SLTU_BNEZ] = &&op_SLTU_BNEZ, [OP_SLTU_BEQZ] = &&op_SLTU_BEQZ, \
+      [OP_ADDI_SW] = &&op_ADDI_SW,
+
+  // ─── Threaded interpreter ──────────────────────────────────────────────────
+  // Every handler ends in its own indirect jump (GCC labels-as-values) to the
+  // next instruction's handler, so there is no central switch and the host
+  // predictor sees one branch site per guest instruction form.  Straight-line
+  // code just advances the record pointer; each decoded page ends in an
+  // OP_PAGE_END sentinel that sends the loop back through decoded_slot().
+  // Returns when the guest stops or cycles reaches fast_limit.
+  __attribute__((noinline)) void run_threaded() {
+    static const void* const labels[OP_COUNT] = { RV32_OP_LABELS };
+
+    DecodedIns* d;
+    goto op_PAGE_END;
+
+#define OP(name) op_##name:
+#define D        (*d)
+#define PC       pc
+#define NEXT     do { x[0] = 0; cycles++; pc += 4; ++d; goto *labels[d->op]; } while (0)
+#define JUMP(t)  do { x[0] = 0; cycles++; pc = (t); if (cycles >= fast_limit) return; \
+                      d = decoded_slot(pc); goto *labels[d->op]; } while (0)
+#define STOP     return
+  op_UNDECODED:
+    *d = decode(fetch32(pc));
+    goto *labels[d->op];
+  op_PAGE_END:
+  op_BLOCK_END:
+    if (cycles >= fast_limit) return;
+    d = decoded_slot(pc);
+    goto *labels[d->op];
+#include "rv32ima_ops.h"
+#undef OP
+#undef D
+#undef PC
+#undef NEXT
+#undef JUMP
+#undef STOP
+  }
+#endif
+
+  // ─── Block engine ──────────────────────────────────────────────────────────
+  Block* lookup_block(uint32_t start) {
+    auto it = blocks.find(start);
+    if (it != blocks.end()) return it->second.get();
+
+    std::unique_ptr<Block> b(new Block);
+    b->pc = start;
+    uint32_t addr = start;
+    do {
+      DecodedIns d = fetch_decoded(addr);
+      if (runs_alone(d.op) && !b->ins.empty()) break;
+      if (d.rd == 0 && only_writes_rd(d.op)) {   // keeps x0 zero within the block
+        d.op = OP_NOP;
+        x0_folded++;
       }
-      case 0x23: {
-        const char* names[] = {"sb","sh","sw"};
-        ss << names[f3] << " x" << rs2 << "," << imm_s() << "(x" << rs1 << ")";
-        break;
+      b->ins.push_back(d);
+      addr += 4;
+      if (ends_block(d.op)) break;
+      if (d.rd == 0 && d.op >= OP_LB && d.op <= OP_LHU) break;   // the block exit clears x0 again
+    } while (b->ins.size() < MAX_BLOCK_INS && (addr & PAGE_MASK));
+    b->n_ins = b->ins.size();
+    if (fusion) optimize_block(b->ins);
+    b->ins.push_back({OP_BLOCK_END, 0, 0, 0, 0});
+
+    if ((start >> PAGE_SHIFT) < block_pages.size()) block_pages[start >> PAGE_SHIFT]++;
+    Block* raw = b.get();
+    blocks[start] = std::move(b);
+    return raw;
+  }
+
+  // Block-local rewriting: drops pure instructions whose result is
+  // overwritten before anything reads it, then fuses common pairs.  Blocks
+  // are only ever entered at their first instruction, so neither is visible
+  // from outside the block.
+  void optimize_block(std::vector<DecodedIns>& ins) {
+    uint32_t overwritten = 0;   // registers written further on before being read
+    for (size_t i = ins.size(); i-- > 0;) {
+      uint32_t reads, writes;
+      reg_effects(&ins[i], reads, writes);
+      if (is_pure(ins[i].op) && writes && !(writes & ~overwritten)) {
+        ins[i].op = OP_NOP;
+        dead_dropped++;
+        continue;
       }
-      case 0x13: {
-        if (f3 == 1 || f3 == 5) {
-          uint32_t shamt = rs2;
-          ss << ((f3 == 1) ? "slli" : (f7 ? "srai" : "srli")) << " x" << rd << ",x" << rs1 << "," << shamt;
-        } else {
-          const char* names[] = {"addi","?","slti","sltiu","xori","?","ori","andi"};
-          ss << names[f3] << " x" << rd << ",x" << rs1 << "," << imm_i();
-        }
+      overwritten = (overwritten | writes) & ~reads;
+    }
+
+    for (size_t i = 0; i + 1 < ins.size(); i++) {
+      DecodedIns& a = ins[i];
+      const DecodedIns& b = ins[i + 1];
+      DecodedIns f{OP_UNDECODED, a.rd, a.rs1, a.rs2, a.imm};
+      switch (a.op) {
+      case OP_LUI:
+        if (b.op == OP_ADDI && b.rd == a.rd && b.rs1 == a.rd) f = {OP_LI, a.rd, 0, 0, a.imm + b.imm};
         break;
-      }
-      case 0x33: {
-        if (f7 == 1) { // M extension
-          const char* names[] = {"mul","mulh","mulhsu","mulhu","div","divu","rem","remu"};
-          ss << names[f3] << " x" << rd << ",x" << rs1 << ",x" << rs2;
-        } else {
-          const char* names[] = {"add","sll","slt","sltu","xor","srl","or","and"};
-          const char* alt[] = {"sub","","","","","sra","",""};
-          ss << (f7 && alt[f3][0] ? alt[f3] : names[f3]) << " x" << rd << ",x" << rs1 << ",x" << rs2;
-        }
+      case OP_AUIPC:
+        if (b.op == OP_JALR && b.rs1 == a.rd) f = {OP_AUIPC_JALR, b.rd, a.rd, 0, a.imm + b.imm};
+        else if (b.op == OP_LW && b.rs1 == a.rd) f = {OP_AUIPC_LW, b.rd, a.rd, 0, a.imm + b.imm};
         break;
-      }
-      case 0x0f: ss << "fence"; break;
-      case 0x73: {
-        if (f3 == 0) {
-          if (ins == 0x73) ss << "ecall";
-          else if (ins == 0x100073) ss << "ebreak";
-          else ss << "unknown_system";
-        } else {
-          const char* names[] = {"?","csrrw","csrrs","csrrc","?","csrrwi","csrrsi","csrrci"};
-          ss << names[f3] << " x" << rd << ",0x" << std::hex << (ins>>20) << ",x" << rs1;
+      case OP_SLT:
+      case OP_SLTU:
+        if ((b.op == OP_BNE || b.op == OP_BEQ) && b.rs1 == a.rd && b.rs2 == 0) {
+          f.op = a.op == OP_SLT ? (b.op == OP_BNE ? OP_SLT_BNEZ : OP_SLT_BEQZ)
+                                : (b.op == OP_BNE ? OP_SLTU_BNEZ : OP_SLTU_BEQZ);
+          f.imm = b.imm;
         }
         break;
-      }
-      case 0x2f: { // A extension
-        uint32_t funct5 = f7 >> 2;
-        const char* names[] = {"amoadd","amoswap","lr","sc","amoxor","?","?","?",
-                                "amoor","amoand","amomin","amomax","amominu","amomaxu"};
-        if (funct5 < 14 && names[funct5][0] != '?') {
-          ss << names[funct5] << ".w x" << rd << ",x" << rs2 << ",(x" << rs1 << ")";
-        } else {
-          ss << "unknown_atomic";
-        }
+      case OP_ADDI:
+        if (b.op == OP_SW && a.rs1 == a.rd && b.rs1 == a.rd) f.op = OP_ADDI_SW;
         break;
       }
-      default: ss << "unknown"; break;
+      if (f.op == OP_UNDECODED) continue;
+      a = f;
+      fused_formed[f.op - OP_FUSED_FIRST]++;
+      i++;   // the second record stays as it is
     }
-    return ss.str();
   }
 
-  // ─── Main step function ────────────────────────────────────────────────────
-  void step() {
-    // Fetch instruction
-    uint32_t ins = fetch32(pc);
-    
-    // Decode and trace if enabled
-    if (trace_enabled) {
-      std::cout << "[cycle " << cycles << "] pc=0x" << std::hex << std::setw(8) 
-                << std::setfill('0') << pc << " ins=0x" << std::setw(8) 
-                << std::setfill('0') << ins << "  " << decode_ins(ins) << "\n";
-
-      // Show registers
-      for (int i = 0; i < 32; i++) {
-        if (i % 8 == 0) std::cout << "x" << std::dec << std::setw(2) 
-                                   << std::setfill('0') << i << ":";
-        std::cout << "0x" << std::hex << std::setw(8) << std::setfill('0') 
-                  << x[i] << "  ";
-        if (i % 8 == 7) std::cout << "\n";
+  // Drop every block (and with them all chain links and translations)
+  void flush_blocks() {
+#ifdef RV32_JIT
+    std::lock_guard<std::mutex> queue_lock(jit_queue_mutex);
+    std::lock_guard<std::mutex> code_lock(jit_code_mutex);   // waits out a compile in flight
+    jit_queue.clear();
+    if (jit_code) jit_code->reset();
+    jit_full = false;
+#endif
+    blocks.clear();
+    std::fill(block_pages.begin(), block_pages.end(), 0);
+    dirty_code.clear();
+    blocks_dirty = code_stale = false;
+    flushes++;
+  }
+
+  // Drop the blocks overlapping the words in dirty_code, together with the
+  // links into them and their queued translations.  Their translated code
+  // stays in the buffer until it is recycled.
+  void drop_dirty_blocks() {
+#ifdef RV32_JIT
+    if (jit_full) return flush_blocks();
+#endif
+    if (dirty_code.size() > DIRTY_MAX || code_stale) return flush_blocks();
+
+    std::vector<Block*> dead;
+    for (uint32_t addr : dirty_code) {
+      uint32_t page_start = addr & ~PAGE_MASK, reach = (MAX_BLOCK_INS - 1) * 4;
+      for (uint32_t start = addr - page_start > reach ? addr - reach : page_start; start <= addr; start += 4) {
+        auto it = blocks.find(start);
+        if (it == blocks.end() || start + it->second->n_ins * 4 <= addr) continue;
+        if (std::find(dead.begin(), dead.end(), it->second.get()) == dead.end()) dead.push_back(it->second.get());
       }
-      std::cout << "\n";
-    }
-
-    // Decode instruction fields
-    uint32_t opc = ins & 0x7f;
-    uint32_t rd  = (ins >> 7) & 0x1f;
-    uint32_t f3  = (ins >> 12) & 0x7;
-    uint32_t rs1 = (ins >> 15) & 0x1f;
-    uint32_t rs2 = (ins >> 20) & 0x1f;
-    uint32_t f7  = ins >> 25;
-
-    auto sx = [](uint32_t v, unsigned bits) {
-      uint32_t sign = 1u << (bits - 1);
-      return int32_t((v ^ sign) - sign);
-    };
-
-    auto imm_i = [&]{ return sx(ins>>20,12); };
-    auto imm_u = [&]{ return ins & 0xfffff000u; };
-    auto imm_s = [&]{ return sx(((ins>>7)&0x1f)|((ins>>20)&0xfe0),12); };
-    auto imm_b = [&]{
-      uint32_t v = ((ins>>7)&0x1e)|((ins>>20)&0x7e0)|((ins<<4)&0x800)|((ins>>19)&0x1000);
-      return sx(v,13);
-    };
-    auto imm_j = [&]{
-      uint32_t v = ((ins>>21)&0x3ff)<<1;
-      v |= ((ins>>20)&1)<<11;
-      v |= ((ins>>12)&0xff)<<12;
-      v |= (ins>>31)<<20;
-      return sx(v,21);
-    };
-
-    // Update PC
-    uint32_t next_pc = pc + 4;
+    }
+    dirty_code.clear();
+    blocks_dirty = false;
+    if (dead.empty()) return;
 
-    // Execute
-    switch (opc) {
-    case 0x37: x[rd] = imm_u();           pc = next_pc; break;          // LUI
-    case 0x17: x[rd] = pc + imm_u();      pc = next_pc; break;          // AUIPC
-    case 0x6f: { uint32_t t = next_pc; pc += imm_j(); if(rd) x[rd] = t; } break; // JAL
-    case 0x67: { uint32_t t = next_pc; pc = (x[rs1] + imm_i()) & ~1u; if(rd) x[rd] = t; } break; // JALR
-    case 0x63: {
-      bool take = false;
-      switch (f3) {
-        case 0: take = x[rs1] == x[rs2]; break; // BEQ
-        case 1: take = x[rs1] != x[rs2]; break; // BNE
-        case 4: take = (int32_t)x[rs1] <  (int32_t)x[rs2]; break; // BLT
-        case 5: take = (int32_t)x[rs1] >= (int32_t)x[rs2]; break; // BGE
-        case 6: take = x[rs1] <  x[rs2]; break; // BLTU
-        case 7: take = x[rs1] >= x[rs2]; break; // BGEU
+    auto is_dead = [&](const Block* b) { return std::find(dead.begin(), dead.end(), b) != dead.end(); };
+#ifdef RV32_JIT
+    std::lock_guard<std::mutex> queue_lock(jit_queue_mutex);
+    std::lock_guard<std::mutex> code_lock(jit_code_mutex);   // waits out a compile in flight
+    jit_queue.erase(std::remove_if(jit_queue.begin(), jit_queue.end(), is_dead), jit_queue.end());
+#endif
+    for (auto& entry : blocks) {
+      Block* b = entry.second.get();
+      for (int k = 0; k < 2; k++) {
+        if (b->next[k] && is_dead(b->next[k])) b->next[k] = nullptr;
+        if (b->exit_to[k]) {
+          for (const Block* d : dead)
+            if (b->exit_to[k] == d->native_body) b->exit_to[k] = nullptr;
+        }
       }
-      pc = take ? pc + imm_b() : next_pc;
-    } break;
-    case 0x03: {
-      uint32_t addr = x[rs1] + imm_i();
-      switch (f3) {
-        case 0: x[rd] = (int8_t) mem[addr]; break;                       // LB
-        case 1: x[rd] = (int16_t)(mem[addr] | mem[addr+1]<<8); break;    // LH
-        case 2: x[rd] = fetch32(addr); break;                            // LW
-        case 4: x[rd] = mem[addr]; break;                                // LBU
-        case 5: x[rd] = mem[addr] | mem[addr+1]<<8; break;               // LHU
+    }
+    for (Block* b : dead) {
+      if ((b->pc >> PAGE_SHIFT) < block_pages.size()) block_pages[b->pc >> PAGE_SHIFT]--;
+      blocks.erase(b->pc);
+    }
+    flushes++;
+  }
+
+  // Tier 0: single-steps up to and including the next control transfer
+  void step_cold() {
+    for (;;) {
+      uint8_t op = fetch_decoded(pc).op;
+      step<TRACE_OFF>();
+      if (ends_block(op) || exit_reason || cycles >= fast_limit) return;
+    }
+  }
+
+  // Block for pc, single-stepping until execution reaches a pc that has been
+  // entered block_threshold times; nullptr if the run stops first
+  Block* warm_block() {
+    for (;;) {
+      if (exit_reason || cycles >= fast_limit) return nullptr;
+      if (blocks_dirty) drop_dirty_blocks();
+      auto it = blocks.find(pc);
+      if (it != blocks.end()) return it->second.get();
+      uint32_t& h = heat[(pc >> 2) & (HEAT_SLOTS - 1)];
+      if (++h >= block_threshold) {
+        h = 0;
+        return lookup_block(pc);
       }
-      pc = next_pc;
-    } break;
-    case 0x23: {
-      uint32_t addr = x[rs1] + imm_s();
-      switch (f3) {
-        case 0: mem[addr] = x[rs2]; break;                               // SB
-        case 1: mem[addr] = x[rs2]; mem[addr+1] = x[rs2]>>8; break;      // SH
-        case 2: store32(addr, x[rs2]); break;                            // SW
+      step_cold();
+    }
+  }
+
+  // Successor of b once it has left pc at the next guest address; nullptr
+  // if the run stops first
+  Block* next_block(Block* b) {
+    if (cycles >= fast_limit) return nullptr;
+    if (b->next[0] && b->next_pc[0] == pc && !blocks_dirty) return b->next[0];
+    if (b->next[1] && b->next_pc[1] == pc && !blocks_dirty) return b->next[1];
+    uint32_t target = pc, gen = flushes;
+    Block* nb = warm_block();
+    if (nb && flushes == gen && nb->pc == target) {   // b is still alive and nb starts at the edge
+      int slot = b->next[0] ? 1 : 0;
+      b->next_pc[slot] = target;
+      b->next[slot] = nb;
+    }
+    return nb;
+  }
+
+#ifdef RV32_JIT
+  // ─── JIT (rv32ima_jit.h) ───────────────────────────────────────────────────
+  bool jit_compile(Block* b);
+  void jit_request(Block* b);
+  void jit_worker();
+  void jit_shutdown();
+  static uint32_t jit_load(CPU* c, uint32_t addr, uint32_t op);
+  static void jit_store(CPU* c, uint32_t addr, uint32_t v, uint32_t op);
+  static void jit_exec(CPU* c, const DecodedIns* d, uint32_t at);
+
+  // Runs translated blocks, translating blocks as they become hot and linking
+  // translations to each other as their edges are taken; returns the first
+  // block that has to be interpreted, or nullptr if the run stops first.
+  // Translations check fast_limit before following a link.
+  Block* run_native(Block* b) {
+    for (;;) {
+      NativeBlock fn = b->native.load(std::memory_order_acquire);
+      if (!fn) {
+        if (++b->hits == jit_threshold) jit_request(b);
+        if (!(fn = b->native.load(std::memory_order_acquire))) return b;
       }
-      pc = next_pc;
-    } break;
-    case 0x13: {
-      if (f3 == 1 || f3 == 5) {
-        uint32_t shamt = rs2;
-        if (f3 == 1) x[rd] = x[rs1] << shamt;                            // SLLI
-        else x[rd] = f7 ? int32_t(x[rs1]) >> shamt : x[rs1] >> shamt;    // SRAI/SRLI
-      } else {
-        int32_t imm = imm_i();
-        switch (f3) {
-          case 0: x[rd] = x[rs1] + imm; break;                           // ADDI
-          case 2: x[rd] = (int32_t)x[rs1] < imm; break;                  // SLTI
-          case 3: x[rd] = x[rs1] < (uint32_t)imm; break;                 // SLTIU
-          case 4: x[rd] = x[rs1] ^ imm; break;                           // XORI
-          case 6: x[rd] = x[rs1] | imm; break;                           // ORI
-          case 7: x[rd] = x[rs1] & imm; break;                           // ANDI
-        }
+      Block* last = fn(this);
+      uint32_t gen = flushes;
+      if (!(b = next_block(last))) return nullptr;
+      if (flushes == gen && b->native.load(std::memory_order_acquire)) {
+        for (int k = 0; k < 2; k++)
+          if (last->exit_pc[k] == pc) last->exit_to[k] = b->native_body;
       }
-      pc = next_pc;
-    } break;
-    case 0x33: {
-      if (f7 == 1) { // M extension
-        int32_t a = x[rs1], b = x[rs2];
-        uint32_t ua = x[rs1], ub = x[rs2];
-        int64_t prod = (int64_t)a * b;
-        uint64_t uprod = (uint64_t)ua * ub;
-        int64_t mxprod = (int64_t)a * (uint64_t)ub;
-        switch (f3) {
-          case 0: x[rd] = prod; break;                                   // MUL
-          case 1: x[rd] = prod >> 32; break;                             // MULH
-          case 2: x[rd] = mxprod >> 32; break;                           // MULHSU
-          case 3: x[rd] = uprod >> 32; break;                            // MULHU
-          case 4: x[rd] = b ? a / b : -1; break;                         // DIV
-          case 5: x[rd] = b ? ua / ub : UINT_MAX; break;                 // DIVU
-          case 6: x[rd] = b ? a % b : a; break;                          // REM
-          case 7: x[rd] = b ? ua % ub : ua; break;                       // REMU
-        }
-      } else {
-        switch (f3) {
-          case 0: x[rd] = f7 ? x[rs1] - x[rs2] : x[rs1] + x[rs2]; break; // ADD/SUB
-          case 1: x[rd] = x[rs1] << (x[rs2] & 0x1f); break;              // SLL
-          case 2: x[rd] = (int32_t)x[rs1] < (int32_t)x[rs2]; break;      // SLT
-          case 3: x[rd] = x[rs1] < x[rs2]; break;                        // SLTU
-          case 4: x[rd] = x[rs1] ^ x[rs2]; break;                        // XOR
-          case 5: x[rd] = f7 ? (int32_t)x[rs1] >> (x[rs2] & 0x1f)        // SRA/SRL
-                              : x[rs1] >> (x[rs2] & 0x1f); break;
-          case 6: x[rd] = x[rs1] | x[rs2]; break;                        // OR
-          case 7: x[rd] = x[rs1] & x[rs2]; break;                        // AND
-        }
+    }
+  }
+#endif
+
+  // Runs chained basic blocks.  pc, cycle counting, x0 clearing and the choice
+  // of successor are only dealt with once per block; the body just steps from
+  // record to record (PC is derived from the record position when needed).
+  // Returns when the guest stops or cycles reaches fast_limit.
+  __attribute__((noinline)) void run_blocks() {
+    Block* b = warm_block();
+#ifdef RV32_JIT
+    if (b && engine == ENGINE_JIT) b = run_native(b);
+#endif
+    if (!b) return;
+    DecodedIns* d = b->ins.data();
+
+#define D        (*d)
+#define D2       (d[1])
+#define PC       (b->pc + uint32_t(d - b->ins.data()) * 4)
+#define JUMP(t)  { pc = (t); goto block_exit; }
+#define STOP     { pc = PC; return; }   // only ever the sole instruction of its block
+#ifdef RV32_THREADED
+    static const void* const labels[OP_COUNT] = { RV32_OP_LABELS RV32_FUSED_LABELS };
+#define OP(name) op_##name:
+#define NEXT     { ++d; goto *labels[d->op]; }
+#define NEXT2    { d += 2; goto *labels[d->op]; }
+    goto *labels[d->op];
+#else
+#define OP(name) case OP_##name:
+#define NEXT     { ++d; continue; }
+#define NEXT2    { d += 2; continue; }
+    for (;;) {
+      switch (d->op) {
+#endif
+
+    OP(BLOCK_END)
+      pc = b->pc + b->n_ins * 4;   // fell off the end
+    block_exit: {
+      cycles += b->n_ins;
+      x[0] = 0;
+      b = next_block(b);
+#ifdef RV32_JIT
+      if (b && engine == ENGINE_JIT) b = run_native(b);
+#endif
+      if (!b) return;
+      d = b->ins.data();
+    }
+#ifdef RV32_THREADED
+    goto *labels[d->op];
+    OP(UNDECODED)
+    OP(PAGE_END)
+      exit_reason = EXIT_ILLEGAL;   // never present in a block
+      STOP;
+#include "rv32ima_ops.h"
+#include "rv32ima_fused.h"
+#else
+    continue;
+#include "rv32ima_ops.h"
+#include "rv32ima_fused.h"
+      default:   // UNDECODED/PAGE_END are never present in a block
+        exit_reason = EXIT_ILLEGAL;
+        STOP;
       }
-      pc = next_pc;
-    } break;
-    case 0x0f: pc = next_pc; break; // FENCE
-    case 0x73: {
-      if (f3 == 0) {
-        if (ins == 0x73) {  // ECALL
-          handle_syscall();
-          pc = next_pc;
-        } else if (ins == 0x100073) {  // EBREAK
-          if (trace_enabled) {
-            std::cerr << "EBREAK at PC " << std::hex << pc << std::endl;
-          }
-          exit(1);
-        }
-      } else {  // CSR instructions
-        uint32_t csr_addr = ins >> 20;
-        uint32_t old_val = read_csr(csr_addr);
-        uint32_t new_val = old_val;
-        uint32_t src = (f3 & 4) ? rs1 : x[rs1];  // Immediate vs register
-        
-        switch (f3 & 3) {
-          case 1:  // CSRRW/CSRRWI
-            new_val = src;
-            break;
-          case 2:  // CSRRS/CSRRSI
-            new_val = old_val | src;
-            break;
-          case 3:  // CSRRC/CSRRCI
-            new_val = old_val & ~src;
-            break;
-        }
-        
-        if (rd != 0) x[rd] = old_val;
-        if ((f3 & 3) == 1 || rs1 != 0) write_csr(csr_addr, new_val);
-        pc = next_pc;
+    }
+#endif
+#undef OP
+#undef D
+#undef D2
+#undef PC
+#undef NEXT
+#undef NEXT2
+#undef JUMP
+#undef STOP
+  }
+
+  // Runs until the guest stops or max_instructions more have retired.  The
+  // untraced variant uses the configured engine and single-steps only the
+  // last few instructions before the limit.
+  template <TraceMode Trace>
+  ExitReason run(uint64_t max_instructions = UINT64_MAX) {
+    exit_reason = EXIT_NONE;
+    cycle_limit = max_instructions > UINT64_MAX - cycles ? UINT64_MAX : cycles + max_instructions;
+    fast_limit = cycle_limit - std::min(cycle_limit, LIMIT_SLACK);
+    if (Trace == TRACE_OFF) {
+      if (engine != ENGINE_INTERP) run_blocks();
+#ifdef RV32_THREADED
+      else run_threaded();
+#endif
+    }
+    while (!exit_reason) {
+      if (cycles >= cycle_limit) return exit_reason = EXIT_LIMIT;
+      step<Trace>();
+    }
+    return exit_reason;
+  }
+};
+
+#ifdef RV32_JIT
+#include "rv32ima_jit.h"
+#endif
+
+// Driver (left out of librv32, which brings its own front end in librv32.cc)
+// -----------------------------------------------------------------------------
+#ifndef RV32IMA_NO_DRIVER
+static constexpr size_t RAM_SIZE = 2 << 20;   // 2 MiB at guest address 0
+static constexpr size_t LINUX_RAM_SIZE = 256 << 20;   // default with --linux
+
+// Command-line settings
+struct Options {
+  bool trace = false;
+  uint64_t max_instructions = UINT64_MAX;
+  std::string trace_file;
+  Engine engine = DEFAULT_ENGINE;
+  uint32_t block_threshold = DEFAULT_BLOCK_THRESHOLD;
+  uint32_t jit_threshold = DEFAULT_JIT_THRESHOLD;
+  bool jit_sync = false;
+  bool fusion = true, fusion_stats = false;
+  bool stats = false;
+  bool virtual_bus = false;
+  uint32_t harts = 1;
+  std::string batch;        // manifest of programs to run (--batch)
+  uint32_t jobs = 0;        // batch workers or clones at a time, 0 = one per host CPU
+  uint32_t clones = 0;      // fork this many copies at the clone point (--clones)
+  uint64_t clone_at = 0;    // clone point as an instruction count, 0 = the guest's
+  RamOptions ram;           // host pages behind guest RAM (--hugepages, --numa-node)
+  size_t ram_size = 0;      // bytes of guest RAM (--ram), 0 = the default
+  bool linux_user = false;  // run a Linux executable on LinuxProcess (--linux)
+  bool semihosting = false; // serve semihosting calls from host files (--semihosting)
+  std::vector<std::string> guest_args;   // its argv, the program path first
+  const ElfFile* elf = nullptr;   // the program's headers and symbols if it is an ELF file
+};
+
+static constexpr uint32_t MAX_HARTS = 64;   // --harts, one host thread each
+
+// The N of a numeric option "--name=N", which starts at arg[prefix]: stores
+// it in v if it is a decimal number in [min, max], else returns false (the
+// callers print the usage line)
+template <typename T>
+static bool parse_option(const std::string& arg, size_t prefix, T& v, uint64_t min, uint64_t max) {
+  const char* s = arg.c_str() + prefix;
+  if (*s < '0' || *s > '9') return false;   // strtoull skips spaces and takes "-1"
+  char* end;
+  errno = 0;
+  unsigned long long n = strtoull(s, &end, 10);
+  if (errno || *end || n < min || n > max) return false;
+  v = (T)n;
+  return true;
+}
+
+template <class Bus>
+static void configure(CPU<Bus>& cpu, const Options& opt) {
+  cpu.engine = opt.engine;
+  cpu.block_threshold = opt.block_threshold;
+  cpu.jit_threshold = opt.jit_threshold;
+  cpu.fusion = opt.fusion;
+  cpu.fusion_stats = opt.fusion_stats;
+#ifdef RV32_JIT
+  cpu.jit_background = !opt.jit_sync;
+#endif
+}
+
+static void print_mips(uint64_t instructions, std::chrono::steady_clock::time_point start) {
+  double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cerr << "Executed " << std::dec << instructions << " instructions in " << std::fixed
+            << std::setprecision(3) << s << " s (" << std::setprecision(1)
+            << instructions / s / 1e6 << " MIPS)" << std::endl;
+}
+
+// " (symbol+0x10)" for pc in an ELF program with symbols, else ""
+static std::string symbol_at(uint32_t pc, const Options& opt) {
+  std::string name = opt.elf ? opt.elf->describe(pc) : "";
+  return name.empty() ? name : " (" + name + ")";
+}
+
+// Places the program: an ELF executable's segments at their addresses, or a
+// flat binary at 0.  Returns false if it does not fit in mem.
+template <class Mem>
+static bool load_program(Mem& mem, const FileImage& bin, const ElfFile* elf) {
+  return elf ? elf->load(mem, bin) : mem.load_image(bin);
+}
+
+// Process exit status for a run that stopped for reason why
+template <class Bus>
+static int exit_status(CPU<Bus>& cpu, ExitReason why, const Options& opt) {
+  switch (why) {
+    case EXIT_HALT:
+      if (opt.trace) {
+        std::cout << "Program exited with code " << std::dec << cpu.exit_code << std::endl;
       }
-    } break;
-    case 0x2f: { // A extension (atomics)
-      uint32_t funct5 = f7 >> 2;
-      uint32_t addr = x[rs1];
-      
-      switch (funct5) {
-        case 0: { // AMOADD.W
-          uint32_t old_val = fetch32(addr);
-          store32(addr, old_val + x[rs2]);
-          if (rd) x[rd] = old_val;
-          break;
-        }
-        case 1: { // AMOSWAP.W
-          uint32_t old_val = fetch32(addr);
-          store32(addr, x[rs2]);
-          if (rd) x[rd] = old_val;
-          break;
-        }
-        case 2: { // LR.W
-          x[rd] = fetch32(addr);
-          has_reservation = true;
-          reservation_addr = addr;
-          break;
-        }
-        case 3: { // SC.W
-          if (has_reservation && reservation_addr == addr) {
-            store32(addr, x[rs2]);
-            x[rd] = 0;  // Success
-            has_reservation = false;
-          } else {
-            x[rd] = 1;  // Failure
-          }
-          break;
-        }
-        case 4: { // AMOXOR.W
-          uint32_t old_val = fetch32(addr);
-          store32(addr, old_val ^ x[rs2]);
-          if (rd) x[rd] = old_val;
-          break;
-        }
-        case 8: { // AMOOR.W
-          uint32_t old_val = fetch32(addr);
-          store32(addr, old_val | x[rs2]);
-          if (rd) x[rd] = old_val;
-          break;
-        }
-        case 12: { // AMOAND.W
-          uint32_t old_val = fetch32(addr);
-          store32(addr, old_val & x[rs2]);
-          if (rd) x[rd] = old_val;
-          break;
-        }
-        case 16: { // AMOMIN.W
-          int32_t old_val = (int32_t)fetch32(addr);
-          int32_t new_val = (int32_t)x[rs2];
-          store32(addr, (old_val < new_val) ? old_val : new_val);
-          if (rd) x[rd] = old_val;
-          break;
-        }
-        case 20: { // AMOMAX.W
-          int32_t old_val = (int32_t)fetch32(addr);
-          int32_t new_val = (int32_t)x[rs2];
-          store32(addr, (old_val > new_val) ? old_val : new_val);
-          if (rd) x[rd] = old_val;
-          break;
-        }
-        case 24: { // AMOMINU.W
-          uint32_t old_val = fetch32(addr);
-          uint32_t new_val = x[rs2];
-          store32(addr, (old_val < new_val) ? old_val : new_val);
-          if (rd) x[rd] = old_val;
-          break;
-        }
-        case 28: { // AMOMAXU.W
-          uint32_t old_val = fetch32(addr);
-          uint32_t new_val = x[rs2];
-          store32(addr, (old_val > new_val) ? old_val : new_val);
-          if (rd) x[rd] = old_val;
-          break;
-        }
+      return cpu.exit_code;
+    case EXIT_EBREAK:
+      if (opt.trace) {
+        std::cerr << "EBREAK at PC " << std::hex << cpu.pc << symbol_at(cpu.pc, opt) << std::endl;
       }
-      pc = next_pc;
-    } break;
-    default:
-      if (trace_enabled) {
-        std::cerr << "Unhandled opcode " << std::hex << opc << " at PC " << pc << std::endl;
+      return 1;
+    case EXIT_ILLEGAL:
+      if (opt.trace) {
+        std::cerr << "Unhandled opcode " << std::hex << (cpu.fetch32(cpu.pc) & 0x7f) << " at PC " << cpu.pc
+                  << symbol_at(cpu.pc, opt) << std::endl;
       }
-      exit(1);
+      return 1;
+    default:
+      std::cerr << "Stopped after " << std::dec << opt.max_instructions << " instructions at PC 0x"
+                << std::hex << cpu.pc << symbol_at(cpu.pc, opt) << std::endl;
+      return 1;
+  }
+}
+
+// Sets the CPU up to run the loaded ELF program as a Linux process (--linux):
+// its initial stack, and the process serving its system calls; nullptr if
+// the RAM has no room for them
+template <class Bus>
+static std::unique_ptr<LinuxProcess> start_linux(CPU<Bus>& cpu, const Options& opt) {
+  std::unique_ptr<LinuxProcess> process(new LinuxProcess(cpu.mem.data(), opt.ram_size));
+  uint32_t sp = process->start(*opt.elf, opt.guest_args);
+  if (!sp) {
+    std::cerr << "Error: no room for heap and stack in " << (opt.ram_size >> 20) << " MiB of RAM" << std::endl;
+    return nullptr;
+  }
+  cpu.x[2] = sp;
+  cpu.process = process.get();
+  return process;
+}
+
+// Attaches the host files of --semihosting to cpu; nullptr without it
+template <class Bus>
+static std::unique_ptr<Semihost> attach_semihost(CPU<Bus>& cpu, const Options& opt) {
+  if (!opt.semihosting) return nullptr;
+  std::unique_ptr<Semihost> host(new Semihost());
+  cpu.semihost = host.get();
+  return host;
+}
+
+// Loads the program (a flat binary at 0, or an ELF file by its headers), runs
+// it from its entry point and reports how it stopped; returns the process
+// exit status
+template <class Bus>
+static int run_program(CPU<Bus>& cpu, const FileImage& bin, const Options& opt) {
+  configure(cpu, opt);
+  if (!load_program(cpu.mem, bin, opt.elf)) {
+    std::cerr << "Error: program does not fit in " << (opt.ram_size >> 20) << " MiB of RAM" << std::endl;
+    return 1;
+  }
+  cpu.pc = opt.elf ? opt.elf->entry : 0;
+  std::unique_ptr<LinuxProcess> process;
+  if (opt.linux_user && !(process = start_linux(cpu, opt))) return 1;
+  std::unique_ptr<Semihost> semihost = attach_semihost(cpu, opt);
+
+  ExitReason why;
+  auto start = std::chrono::steady_clock::now();
+  if (!opt.trace_file.empty()) {
+    cpu.trace_out.reset(new TraceWriter());
+    if (!cpu.trace_out->open(opt.trace_file.c_str(), cpu.cycles, cpu.pc, cpu.x)) {
+      std::cerr << "Error: Cannot create trace file " << opt.trace_file << std::endl;
+      return 1;
+    }
+    why = cpu.template run<TRACE_BINARY>(opt.max_instructions);
+    TraceEnd end{uint32_t(why), cpu.exit_code, cpu.pc, cpu.cycles};
+    if (!cpu.trace_out->finish(&end)) {
+      std::cerr << "Error: Failed writing trace file " << opt.trace_file << std::endl;
     }
+  } else {
+    why = opt.trace ? cpu.template run<TRACE_FULL>(opt.max_instructions)
+                    : cpu.template run<TRACE_OFF>(opt.max_instructions);
+  }
+  if (opt.stats) print_mips(cpu.cycles, start);
+  if (opt.fusion_stats) cpu.print_fusion_stats();
+  return exit_status(cpu, why, opt);
+}
 
-    x[0] = 0;  // x0 is always zero
-    cycles++;
+// Runs opt.harts harts on one shared RAM, each on its own host thread.  All
+// start at address 0 and tell themselves apart by mhartid; a hart stops on
+// its own (exit, ebreak, instruction limit), and the run ends when all have.
+// Hart 0's result is the program's.
+template <class Mem>
+static int run_harts(Mem& ram, const FileImage& bin, const Options& opt) {
+  if (!load_program(ram, bin, opt.elf)) {
+    std::cerr << "Error: program does not fit in " << (opt.ram_size >> 20) << " MiB of RAM" << std::endl;
+    return 1;
+  }
+  std::vector<std::unique_ptr<CPU<SharedBus<Mem>>>> harts;
+  std::unique_ptr<ReservationSet> reservation_set(new ReservationSet);
+  ReservationSet& reservations = *reservation_set;
+  for (uint32_t i = 0; i < opt.harts; i++) {
+    harts.emplace_back(new CPU<SharedBus<Mem>>(SharedBus<Mem>(&ram)));
+    configure(*harts[i], opt);
+    harts[i]->harts = opt.harts;
+    harts[i]->hart_id = i;
+    harts[i]->pc = opt.elf ? opt.elf->entry : 0;
+    harts[i]->reservations = &reservations;
+    reservations.attach(harts[i]->code_pages);
   }
+
+  std::vector<ExitReason> why(opt.harts);
+  std::vector<std::thread> threads;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < opt.harts; i++)
+    threads.emplace_back([&, i] { why[i] = harts[i]->template run<TRACE_OFF>(opt.max_instructions); });
+  for (std::thread& t : threads) t.join();
+
+  if (opt.stats) {
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < opt.harts; i++) {
+      std::cerr << "hart " << i << ": " << std::dec << harts[i]->cycles << " instructions\n";
+      total += harts[i]->cycles;
+    }
+    print_mips(total, start);
+  }
+  return exit_status(*harts[0], why[0], opt);
+}
+
+// Boots the program once up to its clone point, then forks opt.clones child
+// processes that each run on from there.  The clone point is the guest's
+// SYS_CLONE_POINT ecall, which returns the clone number (0 to clones - 1) in
+// a0, or with --clone-at=N the moment N instructions have retired.  Children
+// share the booted guest RAM, the block cache and the translations with the
+// parent copy-on-write, so each starts in about the time of a fork().  At
+// most opt.jobs run at a time; the process fails unless every clone exits
+// with status 0.
+template <class Bus>
+static int run_clones(CPU<Bus>& cpu, const FileImage& bin, const Options& opt) {
+  configure(cpu, opt);
+  if (!load_program(cpu.mem, bin, opt.elf)) {
+    std::cerr << "Error: program does not fit in " << (opt.ram_size >> 20) << " MiB of RAM" << std::endl;
+    return 1;
+  }
+  cpu.pc = opt.elf ? opt.elf->entry : 0;
+  std::unique_ptr<LinuxProcess> process;
+  if (opt.linux_user && !(process = start_linux(cpu, opt))) return 1;
+  std::unique_ptr<Semihost> semihost = attach_semihost(cpu, opt);
+
+  auto start = std::chrono::steady_clock::now();
+  uint64_t boot = opt.clone_at ? std::min(opt.clone_at, opt.max_instructions) : opt.max_instructions;
+  cpu.clone_pending = !opt.clone_at;
+  ExitReason why = cpu.template run<TRACE_OFF>(boot);
+  if (why != EXIT_CLONE && !(opt.clone_at && why == EXIT_LIMIT && boot < opt.max_instructions)) {
+    std::cerr << "Error: program stopped before its clone point" << std::endl;
+    exit_status(cpu, why, opt);
+    return 1;
+  }
+  cpu.clone_pending = false;   // the children run the clone point ecall again
+  if (opt.stats) {
+    std::cerr << "clone point: ";
+    print_mips(cpu.cycles, start);
+  }
+
+  uint32_t at_once = opt.jobs ? opt.jobs : std::max(1u, std::thread::hardware_concurrency());
+  uint32_t running = 0, failed = 0;
+  auto reap = [&] {
+    int status;
+    pid_t pid;
+    while ((pid = wait(&status)) < 0 && errno == EINTR) {}
+    if (pid < 0) {             // no children left to wait for
+      running = 0;
+      return;
+    }
+    running--;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) failed++;
+  };
+  cpu.prepare_fork();
+  std::cout.flush();
+  std::cerr.flush();
+  for (uint32_t i = 0; i < opt.clones; i++) {
+    if (running == at_once) reap();
+    pid_t pid = fork();
+    if (pid < 0) {
+      std::cerr << "Error: fork failed for clone " << i << std::endl;
+      failed += opt.clones - i;
+      break;
+    }
+    if (pid == 0) {
+      cpu.clone_id = i;
+      auto t0 = std::chrono::steady_clock::now();
+      uint64_t booted = cpu.cycles;
+      why = cpu.template run<TRACE_OFF>(opt.max_instructions - booted);
+      if (opt.stats) {
+        std::cerr << "clone " << i << ": ";
+        print_mips(cpu.cycles - booted, t0);
+      }
+      int status = exit_status(cpu, why, opt);
+      std::cout.flush();
+      std::cerr.flush();
+      _exit(status);
+    }
+    running++;
+  }
+  while (running) reap();
+  std::cerr << std::dec << opt.clones << " clones, " << failed << " failed" << std::endl;
+  return failed ? 1 : 0;
+}
+
+// rv32ima_modular.cc (the SDL emulator) includes this file for the CPU and
+// the run helpers above, and brings its own main()
+#ifndef RV32IMA_NO_MAIN
+
+// ─── Batch mode ──────────────────────────────────────────────────────────────
+// Runs every program listed in a manifest (one path per line; blank lines and
+// lines starting with # are skipped) in this process.  Each worker thread
+// owns one CPU and its RAM and resets them between programs.  Jobs are dealt
+// round-robin to per-worker queues; a worker takes from the front of its own
+// queue and, once that is empty, steals from the back of the others.
+//
+// One record per job goes to stdout as it finishes, tab-separated:
+//   job  status  exit_code  instructions  wall_us  path
+// where status is halt, ebreak, illegal, limit or error (unreadable, not an
+// RV32 executable, or too large).  Guest console output is collected per job
+// and dropped.  The process fails unless every job halted with exit code 0.
+struct BatchQueue {
+  std::mutex m;
+  std::deque<size_t> jobs;
 };
 
-// Driver
-// -----------------------------------------------------------------------------
-int main(int argc, char** argv) {
-  if (argc < 2) {
-    std::cerr << "usage: " << argv[0] << " [--trace] program.bin\n";
+static bool next_batch_job(std::vector<BatchQueue>& queues, uint32_t self, size_t& job) {
+  for (uint32_t k = 0; k < queues.size(); k++) {
+    BatchQueue& q = queues[(self + k) % queues.size()];
+    std::lock_guard<std::mutex> lock(q.m);
+    if (q.jobs.empty()) continue;
+    if (k == 0) {
+      job = q.jobs.front();
+      q.jobs.pop_front();
+    } else {
+      job = q.jobs.back();
+      q.jobs.pop_back();
+    }
+    return true;
+  }
+  return false;
+}
+
+static int run_batch(const Options& opt) {
+  std::ifstream manifest(opt.batch);
+  if (!manifest.is_open()) {
+    std::cerr << "Error: Cannot open manifest " << opt.batch << std::endl;
     return 1;
   }
-  
-  bool trace = false;
+  std::vector<std::string> paths;
+  for (std::string line; std::getline(manifest, line);) {
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (!line.empty() && line[0] != '#') paths.push_back(line);
+  }
+
+  uint32_t workers = opt.jobs ? opt.jobs : std::max(1u, std::thread::hardware_concurrency());
+  workers = std::max<size_t>(1, std::min<size_t>(workers, paths.size()));
+#ifdef RV32_GUARD_MEM
+  if (workers > uint32_t(GuestMemory::MAX_SPACES)) {   // one guarded address space per worker
+    std::cerr << "Note: using " << GuestMemory::MAX_SPACES << " workers, the most a MEM=guard build can run"
+              << std::endl;
+    workers = GuestMemory::MAX_SPACES;
+  }
+#endif
+  std::vector<BatchQueue> queues(workers);
+  for (size_t i = 0; i < paths.size(); i++) queues[i % workers].jobs.push_back(i);
+
+  static const char* const STATUS[] = {"error", "halt", "ebreak", "illegal", "limit", "clone", "event"};
+  static_assert(sizeof STATUS / sizeof *STATUS == EXIT_EVENT + 1, "a status for every ExitReason");
+  std::mutex out_mutex;
+  std::atomic<size_t> passed{0};
+  auto start = std::chrono::steady_clock::now();
+  std::cout << "# job\tstatus\texit_code\tinstructions\twall_us\tpath\n";
+
+  auto worker = [&](uint32_t self) {
+    std::unique_ptr<CPU<>> cpu(new CPU<>(opt.ram_size));
+    configure(*cpu, opt);
+    std::string console;
+    cpu->console = &console;
+    size_t job;
+    while (next_batch_job(queues, self, job)) {
+      auto t0 = std::chrono::steady_clock::now();
+      FileImage bin(paths[job].c_str());
+      ElfFile elf;
+      std::string error;
+      bool is_elf = ElfFile::is_elf(bin);
+      cpu->reset();
+      cpu->mem.clear();
+      console.clear();
+      ExitReason why = EXIT_NONE;
+      if (bin.ok() && (!is_elf || elf.parse(bin, error)) && load_program(cpu->mem, bin, is_elf ? &elf : nullptr)) {
+        cpu->pc = is_elf ? elf.entry : 0;
+        why = cpu->template run<TRACE_OFF>(opt.max_instructions);
+      }
+      auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0);
+      if (why == EXIT_HALT && cpu->exit_code == 0) passed++;
+
+      std::lock_guard<std::mutex> lock(out_mutex);
+      std::cout << job << '\t' << STATUS[why] << '\t' << cpu->exit_code << '\t' << cpu->cycles << '\t'
+                << us.count() << '\t' << paths[job] << '\n';
+    }
+  };
+  std::vector<std::thread> threads;
+  for (uint32_t i = 0; i < workers; i++) threads.emplace_back(worker, i);
+  for (std::thread& t : threads) t.join();
+  std::cout.flush();
+
+  double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cerr << std::dec << paths.size() << " jobs, " << passed << " passed, " << paths.size() - passed
+            << " failed, " << workers << " workers, " << std::fixed << std::setprecision(3) << s << " s"
+            << std::endl;
+  return passed == paths.size() ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+  const char* usage = " [--trace] [--trace-file=out.rvt] [--engine=interp|block|jit] [--block-threshold=N]"
+                      " [--jit-threshold=N] [--jit-sync] [--no-fusion] [--fusion-stats]"
+                      " [--max-instructions=N] [--bus=direct|virtual] [--harts=N] [--clones=N [--clone-at=N] [--jobs=N]]"
+                      " [--hugepages=thp|hugetlb] [--numa-node=N] [--ram=MiB] [--semihosting] [--stats] program.bin\n";
+  const char* batch_usage = " [engine options] [--max-instructions=N] [--jobs=N] --batch=manifest.txt\n";
+  const char* linux_usage = " [engine options] [--ram=MiB] --linux program.elf [arguments]\n";
+  Options opt;
   std::string filename;
+  auto usage_error = [&] {
+    std::cerr << "usage: " << argv[0] << usage << "       " << argv[0] << batch_usage
+              << "       " << argv[0] << linux_usage;
+    return 1;
+  };
   
   // Parse arguments
-  if (argc == 3 && std::string(argv[1]) == "--trace") {
-    trace = true;
-    filename = argv[2];
-  } else if (argc == 2) {
-    filename = argv[1];
-  } else {
-    std::cerr << "usage: " << argv[0] << " [--trace] program.bin\n";
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (opt.linux_user && !filename.empty()) {
+      opt.guest_args.push_back(arg);   // everything after the program is its own
+    } else if (arg == "--trace") {
+      opt.trace = true;
+    } else if (arg.rfind("--trace-file=", 0) == 0) {
+      opt.trace_file = arg.substr(13);   // binary trace, decoded by rv32trace
+    } else if (arg == "--engine=interp") {
+      opt.engine = ENGINE_INTERP;
+    } else if (arg == "--engine=block") {
+      opt.engine = ENGINE_BLOCK;
+    } else if (arg == "--engine=jit") {
+      opt.engine = ENGINE_JIT;         // plain block engine in builds without the JIT
+    } else if (arg.rfind("--block-threshold=", 0) == 0) {
+      if (!parse_option(arg, 18, opt.block_threshold, 0, UINT32_MAX)) return usage_error();
+      opt.block_threshold = std::max(1u, opt.block_threshold);
+    } else if (arg.rfind("--jit-threshold=", 0) == 0) {
+      if (!parse_option(arg, 16, opt.jit_threshold, 0, UINT32_MAX)) return usage_error();
+      opt.jit_threshold = std::max(1u, opt.jit_threshold);
+    } else if (arg == "--jit-sync") {
+      opt.jit_sync = true;             // translate on the emulation thread
+    } else if (arg == "--no-fusion") {
+      opt.fusion = false;
+    } else if (arg == "--fusion-stats") {
+      opt.fusion_stats = true;
+    } else if (arg == "--stats") {
+      opt.stats = true;                // instruction count and MIPS on stderr
+    } else if (arg.rfind("--max-instructions=", 0) == 0) {
+      if (!parse_option(arg, 19, opt.max_instructions, 0, UINT64_MAX)) return usage_error();
+    } else if (arg == "--bus=direct") {
+      opt.virtual_bus = false;
+    } else if (arg == "--bus=virtual") {
+      opt.virtual_bus = true;          // RAM behind the MemorySubsystem interface
+    } else if (arg.rfind("--batch=", 0) == 0) {
+      opt.batch = arg.substr(8);       // run every program listed in the file
+    } else if (arg.rfind("--jobs=", 0) == 0) {
+      if (!parse_option(arg, 7, opt.jobs, 0, UINT32_MAX)) return usage_error();
+    } else if (arg.rfind("--clones=", 0) == 0) {
+      // fork at the clone point
+      if (!parse_option(arg, 9, opt.clones, 0, UINT32_MAX)) return usage_error();
+    } else if (arg.rfind("--clone-at=", 0) == 0) {
+      if (!parse_option(arg, 11, opt.clone_at, 0, UINT64_MAX)) return usage_error();
+      opt.clone_at = std::max<uint64_t>(1, opt.clone_at);
+    } else if (arg == "--hugepages=thp") {
+      opt.ram.pages = RamOptions::PAGES_THP;
+    } else if (arg == "--hugepages=hugetlb") {
+      opt.ram.pages = RamOptions::PAGES_HUGETLB;   // THP if the pool is empty
+    } else if (arg.rfind("--numa-node=", 0) == 0) {
+      if (!parse_option(arg, 12, opt.ram.numa_node, 0, 63)) return usage_error();
+    } else if (arg.rfind("--harts=", 0) == 0) {
+      if (!parse_option(arg, 8, opt.harts, 1, MAX_HARTS)) return usage_error();
+    } else if (arg.rfind("--ram=", 0) == 0) {
+      if (!parse_option(arg, 6, opt.ram_size, 1, 4095)) return usage_error();   // MiB
+      opt.ram_size <<= 20;
+    } else if (arg == "--semihosting") {
+      opt.semihosting = true;          // host files for the guest (semihosting.h)
+    } else if (arg == "--linux") {
+      opt.linux_user = true;           // Linux system calls (linux_user.h)
+    } else if (filename.empty() && arg[0] != '-') {
+      filename = arg;
+    } else {
+      return usage_error();
+    }
+  }
+  HostRam::defaults() = opt.ram;
+  if (!opt.ram_size) opt.ram_size = opt.linux_user ? LINUX_RAM_SIZE : RAM_SIZE;
+  opt.guest_args.insert(opt.guest_args.begin(), filename);
+  if (opt.linux_user && (!opt.batch.empty() || opt.harts > 1 || opt.virtual_bus)) {
+    std::cerr << "Error: --linux runs one program on a single hart and the direct bus" << std::endl;
     return 1;
   }
+  if (opt.semihosting && (!opt.batch.empty() || opt.harts > 1)) {
+    std::cerr << "Error: --semihosting runs one program on a single hart" << std::endl;
+    return 1;
+  }
+  if (!opt.batch.empty() && filename.empty()) return run_batch(opt);
+  if (filename.empty()) return usage_error();
   
-  std::ifstream f(filename, std::ios::binary);
-  if (!f.is_open()) {
+  FileImage bin(filename.c_str());   // mapped, and placed in RAM copy-on-write
+  if (!bin.ok()) {
     std::cerr << "Error: Cannot open file " << filename << std::endl;
     return 1;
   }
-  std::vector<uint8_t> bin((std::istreambuf_iterator<char>(f)), {});
-
-  CPU cpu(2 << 20, trace);              // 2 MiB of RAM
-  std::copy(bin.begin(), bin.end(), cpu.mem.begin());
+  ElfFile elf;              // ELF executables load by their program headers
+  if (ElfFile::is_elf(bin)) {
+    std::string error;
+    if (!elf.parse(bin, error)) {
+      std::cerr << "Error: " << filename << ": " << error << std::endl;
+      return 1;
+    }
+    opt.elf = &elf;
+  }
+  if (opt.linux_user && !opt.elf) {
+    std::cerr << "Error: " << filename << ": --linux needs an ELF executable" << std::endl;
+    return 1;
+  }
 
-  while (true) cpu.step();              // run forever (ECALL exits)
-}
\ No newline at end of file
+  if (opt.clones) {
+    if (opt.trace || !opt.trace_file.empty() || opt.harts > 1) {
+      std::cerr << "Error: --clones runs untraced on a single hart only" << std::endl;
+      return 1;
+    }
+    if (opt.virtual_bus) {
+#ifdef RV32_GUARD_MEM
+      GuardedMemory ram(opt.ram_size);
+#else
+      BasicMemory ram(opt.ram_size);
+#endif
+      CPU<VirtualBus> cpu(&ram);
+      return run_clones(cpu, bin, opt);
+    }
+    CPU<> cpu(opt.ram_size);
+    return run_clones(cpu, bin, opt);
+  }
+  if (opt.harts > 1) {
+    if (opt.trace || !opt.trace_file.empty() || opt.virtual_bus) {
+      std::cerr << "Error: --harts runs untraced on the direct bus only" << std::endl;
+      return 1;
+    }
+    DefaultBus ram(opt.ram_size);
+    return run_harts(ram, bin, opt);
+  }
+  if (opt.virtual_bus) {
+#ifdef RV32_GUARD_MEM
+    GuardedMemory ram(opt.ram_size);
+#else
+    BasicMemory ram(opt.ram_size);
+#endif
+    CPU<VirtualBus> cpu(&ram, opt.trace);
+    return run_program(cpu, bin, opt);
+  }
+  CPU<> cpu(opt.ram_size, opt.trace);
+  return run_program(cpu, bin, opt);
+}
+#endif // RV32IMA_NO_MAIN
+#endif // RV32IMA_NO_DRIVER
@@ -7,6 +7,9 @@
 #include <iterator>
 #include <cassert>
 #include <climits>
+#include <algorithm>
+#include <cerrno>
+#include <unistd.h>
 
 // -----------------------------------------------------------------------------
 // RV32IMA simulator with full trace output
@@ -67,10 +70,14 @@ struct CPU {
         uint32_t count = x[12];  // a2
         
         if (fd == 1 || fd == 2) {  // stdout or stderr
-          for (uint32_t i = 0; i < count && buf + i < mem.size(); i++) {
-            std::cout << (char)mem[buf + i];
+          size_t n = buf < mem.size() ? std::min<size_t>(count, mem.size() - buf) : 0;
+          if (trace_enabled) std::cout.flush();   // trace lines first
+          for (size_t done = 0; done < n;) {   // one write(2) unless the host takes less
+            ssize_t w = write(1, mem.data() + buf + done, n - done);
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) break;
+            done += w;
           }
-          std::cout.flush();
           x[10] = count;  // return number of bytes written
         } else {
           x[10] = -1;  // error
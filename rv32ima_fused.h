@@ -0,0 +1,38 @@
+// Semantics of fused instruction pairs for the block engine
+//
+// CPU::optimize_block() rewrites the first record of some common compiler
+// idioms into one of these ops.  The second record of the pair is left in
+// place, unchanged, and skipped.  Included next to rv32ima_ops.h in
+// CPU::run_blocks(), which provides the same macros plus:
+//
+//   D2        - the second record of the pair
+//   NEXT2     - retire both instructions and fall through to PC + 8
+//
+// Every handler bumps its pattern's hit counter (shown by --fusion-stats).
+
+#define FUSED(name) OP(name) fused_hits[OP_##name - OP_FUSED_FIRST]++;
+
+// lui rd, hi; addi rd, rd, lo  ->  imm = hi + lo
+FUSED(LI)          x[D.rd] = D.imm; NEXT2;
+
+// auipc rs1, hi; jalr rd, lo(rs1)  ->  imm = hi + lo
+FUSED(AUIPC_JALR) {
+  uint32_t target = (PC + D.imm) & ~1u;
+  x[D.rs1] = PC + D.imm - D2.imm;
+  if (D.rd) x[D.rd] = PC + 8;
+  JUMP(target);
+}
+
+// auipc rs1, hi; lw rd, lo(rs1)  ->  imm = hi + lo
+FUSED(AUIPC_LW)    x[D.rs1] = PC + D.imm - D2.imm; x[D.rd] = fetch32(PC + D.imm); NEXT2;
+
+// slt[u] rd, rs1, rs2; bnez/beqz rd, off  ->  imm = off
+FUSED(SLT_BNEZ)  { bool c = (int32_t)x[D.rs1] < (int32_t)x[D.rs2]; x[D.rd] = c; if (c)  JUMP(PC + 4 + D.imm); } NEXT2;
+FUSED(SLT_BEQZ)  { bool c = (int32_t)x[D.rs1] < (int32_t)x[D.rs2]; x[D.rd] = c; if (!c) JUMP(PC + 4 + D.imm); } NEXT2;
+FUSED(SLTU_BNEZ) { bool c = x[D.rs1] < x[D.rs2]; x[D.rd] = c; if (c)  JUMP(PC + 4 + D.imm); } NEXT2;
+FUSED(SLTU_BEQZ) { bool c = x[D.rs1] < x[D.rs2]; x[D.rd] = c; if (!c) JUMP(PC + 4 + D.imm); } NEXT2;
+
+// addi rd, rd, imm; sw rs2, off(rd)  (stack frame set-up)
+FUSED(ADDI_SW)     x[D.rd] += D.imm; store32(x[D.rd] + D2.imm, x[D2.rs2]); NEXT2;
+
+#undef FUSED
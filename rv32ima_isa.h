@@ -0,0 +1,328 @@
+// RV32IMA instruction descriptions
+//
+// INS_TABLE lists every instruction form once: the bits that identify it,
+// the predecoded Op it becomes, how its operands are laid out, which
+// extension it belongs to and its mnemonic.  Both the predecoder
+// (predecode<ISA>) and the trace disassembler (disassemble) are generated
+// from it at compile time:
+//
+//   - a 32K-entry index keyed by opcode[6:2], funct3 and funct7 picks the
+//     table entry, so decoding is one lookup plus a mask check;
+//   - every entry gets its own decoder instantiation that extracts exactly
+//     the immediate its format needs;
+//   - entries outside the ISA subset are left out of the index and decode to
+//     OP_ILLEGAL, and their handlers are compiled out of the run loops.
+//
+// Build with -DRV32_ISA=RV32_ISA_I / RV32_ISA_IM to drop extensions
+// (make emulator ISA=i|im).
+
+#ifndef RV32IMA_ISA_H
+#define RV32IMA_ISA_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <utility>
+
+#define RV32_EXT_I 1
+#define RV32_EXT_M 2
+#define RV32_EXT_A 4
+#define RV32_ISA_I   (RV32_EXT_I)
+#define RV32_ISA_IM  (RV32_EXT_I | RV32_EXT_M)
+#define RV32_ISA_IMA (RV32_EXT_I | RV32_EXT_M | RV32_EXT_A)
+#ifndef RV32_ISA
+#define RV32_ISA RV32_ISA_IMA
+#endif
+
+// ─── Predecoded instructions ───────────────────────────────────────────────
+// Each guest instruction is decoded once into a compact record holding the
+// handler index, register numbers and a pre-sign-extended immediate.
+enum Op : uint8_t {
+  OP_UNDECODED = 0,   // cache slot not filled yet
+  OP_PAGE_END,        // sentinel after the last slot of a decoded page
+  OP_BLOCK_END,       // sentinel after the last instruction of a block
+  OP_ILLEGAL,
+  OP_LUI, OP_AUIPC, OP_JAL, OP_JALR,
+  OP_BEQ, OP_BNE, OP_BLT, OP_BGE, OP_BLTU, OP_BGEU,
+  OP_LB, OP_LH, OP_LW, OP_LBU, OP_LHU,
+  OP_SB, OP_SH, OP_SW,
+  OP_ADDI, OP_SLTI, OP_SLTIU, OP_XORI, OP_ORI, OP_ANDI, OP_SLLI, OP_SRLI, OP_SRAI,
+  OP_ADD, OP_SUB, OP_SLL, OP_SLT, OP_SLTU, OP_XOR, OP_SRL, OP_SRA, OP_OR, OP_AND,
+  OP_MUL, OP_MULH, OP_MULHSU, OP_MULHU, OP_DIV, OP_DIVU, OP_REM, OP_REMU,
+  OP_NOP, OP_FENCE, OP_FENCE_I, OP_ECALL, OP_EBREAK,
+  OP_CSRRW, OP_CSRRS, OP_CSRRC, OP_CSRRWI, OP_CSRRSI, OP_CSRRCI,
+  OP_LR, OP_SC, OP_AMOADD, OP_AMOSWAP, OP_AMOXOR, OP_AMOOR, OP_AMOAND,
+  OP_AMOMIN, OP_AMOMAX, OP_AMOMINU, OP_AMOMAXU,
+  // Fused pairs (rv32ima_fused.h), only ever formed inside blocks
+  OP_LI, OP_AUIPC_JALR, OP_AUIPC_LW,
+  OP_SLT_BNEZ, OP_SLT_BEQZ, OP_SLTU_BNEZ, OP_SLTU_BEQZ,
+  OP_ADDI_SW,
+  OP_COUNT
+};
+
+struct DecodedIns {
+  uint8_t op;           // Op
+  uint8_t rd, rs1, rs2;
+  int32_t imm;          // sign-extended immediate, shamt or CSR address
+};
+
+// ─── Instruction table ─────────────────────────────────────────────────────
+enum Format : uint8_t {
+  FMT_R,       // op rd,rs1,rs2
+  FMT_I,       // op rd,rs1,imm
+  FMT_SHIFT,   // op rd,rs1,shamt
+  FMT_JALR,    // op rd,rs1,imm
+  FMT_LOAD,    // op rd,imm(rs1)
+  FMT_S,       // op rs2,imm(rs1)
+  FMT_B,       // op rs1,rs2,offset
+  FMT_U,       // op rd,imm[31:12]
+  FMT_J,       // op rd,offset
+  FMT_CSR,     // op rd,csr,rs1
+  FMT_CSRI,    // op rd,csr,uimm (uimm kept in rs1)
+  FMT_CSRR,    // reserved funct3 4: plain CSR read, rs1 forced to 0
+  FMT_AMO,     // op rd,rs2,(rs1)
+  FMT_NONE,    // no operands
+};
+
+struct InsDesc {
+  uint32_t mask, match;   // (ins & mask) == match
+  uint8_t op;             // Op
+  Format fmt;
+  uint8_t ext;            // RV32_EXT_*
+  const char* name;
+};
+
+namespace isa {
+
+constexpr uint32_t OPC = 0x0000007f;   // opcode
+constexpr uint32_t F3  = 0x0000707f;   // opcode + funct3
+constexpr uint32_t F7  = 0xfe00707f;   // opcode + funct3 + funct7
+constexpr uint32_t F5  = 0xf800707f;   // opcode + funct3 + funct5 (AMO aq/rl ignored)
+constexpr uint32_t ALL = 0xffffffff;
+
+constexpr uint32_t f3(uint32_t v) { return v << 12; }
+constexpr uint32_t f7(uint32_t v) { return v << 25; }
+constexpr uint32_t f5(uint32_t v) { return v << 27; }
+
+}  // namespace isa
+
+// Where several entries share the same index key, the first one that matches
+// wins, so exact encodings go before catch-alls.
+static constexpr InsDesc INS_TABLE[] = {
+  {isa::OPC, 0x37, OP_LUI,   FMT_U,    RV32_EXT_I, "lui"},
+  {isa::OPC, 0x17, OP_AUIPC, FMT_U,    RV32_EXT_I, "auipc"},
+  {isa::OPC, 0x6f, OP_JAL,   FMT_J,    RV32_EXT_I, "jal"},
+  {isa::OPC, 0x67, OP_JALR,  FMT_JALR, RV32_EXT_I, "jalr"},
+
+  {isa::F3, 0x63 | isa::f3(0), OP_BEQ,  FMT_B, RV32_EXT_I, "beq"},
+  {isa::F3, 0x63 | isa::f3(1), OP_BNE,  FMT_B, RV32_EXT_I, "bne"},
+  {isa::F3, 0x63 | isa::f3(4), OP_BLT,  FMT_B, RV32_EXT_I, "blt"},
+  {isa::F3, 0x63 | isa::f3(5), OP_BGE,  FMT_B, RV32_EXT_I, "bge"},
+  {isa::F3, 0x63 | isa::f3(6), OP_BLTU, FMT_B, RV32_EXT_I, "bltu"},
+  {isa::F3, 0x63 | isa::f3(7), OP_BGEU, FMT_B, RV32_EXT_I, "bgeu"},
+
+  {isa::F3, 0x03 | isa::f3(0), OP_LB,  FMT_LOAD, RV32_EXT_I, "lb"},
+  {isa::F3, 0x03 | isa::f3(1), OP_LH,  FMT_LOAD, RV32_EXT_I, "lh"},
+  {isa::F3, 0x03 | isa::f3(2), OP_LW,  FMT_LOAD, RV32_EXT_I, "lw"},
+  {isa::F3, 0x03 | isa::f3(4), OP_LBU, FMT_LOAD, RV32_EXT_I, "lbu"},
+  {isa::F3, 0x03 | isa::f3(5), OP_LHU, FMT_LOAD, RV32_EXT_I, "lhu"},
+
+  {isa::F3, 0x23 | isa::f3(0), OP_SB, FMT_S, RV32_EXT_I, "sb"},
+  {isa::F3, 0x23 | isa::f3(1), OP_SH, FMT_S, RV32_EXT_I, "sh"},
+  {isa::F3, 0x23 | isa::f3(2), OP_SW, FMT_S, RV32_EXT_I, "sw"},
+
+  {isa::F3, 0x13 | isa::f3(0), OP_ADDI,  FMT_I, RV32_EXT_I, "addi"},
+  {isa::F3, 0x13 | isa::f3(2), OP_SLTI,  FMT_I, RV32_EXT_I, "slti"},
+  {isa::F3, 0x13 | isa::f3(3), OP_SLTIU, FMT_I, RV32_EXT_I, "sltiu"},
+  {isa::F3, 0x13 | isa::f3(4), OP_XORI,  FMT_I, RV32_EXT_I, "xori"},
+  {isa::F3, 0x13 | isa::f3(6), OP_ORI,   FMT_I, RV32_EXT_I, "ori"},
+  {isa::F3, 0x13 | isa::f3(7), OP_ANDI,  FMT_I, RV32_EXT_I, "andi"},
+  {isa::F7, 0x13 | isa::f3(1),                 OP_SLLI, FMT_SHIFT, RV32_EXT_I, "slli"},
+  {isa::F7, 0x13 | isa::f3(5),                 OP_SRLI, FMT_SHIFT, RV32_EXT_I, "srli"},
+  {isa::F7, 0x13 | isa::f3(5) | isa::f7(0x20), OP_SRAI, FMT_SHIFT, RV32_EXT_I, "srai"},
+
+  {isa::F7, 0x33 | isa::f3(0),                 OP_ADD,  FMT_R, RV32_EXT_I, "add"},
+  {isa::F7, 0x33 | isa::f3(0) | isa::f7(0x20), OP_SUB,  FMT_R, RV32_EXT_I, "sub"},
+  {isa::F7, 0x33 | isa::f3(1),                 OP_SLL,  FMT_R, RV32_EXT_I, "sll"},
+  {isa::F7, 0x33 | isa::f3(2),                 OP_SLT,  FMT_R, RV32_EXT_I, "slt"},
+  {isa::F7, 0x33 | isa::f3(3),                 OP_SLTU, FMT_R, RV32_EXT_I, "sltu"},
+  {isa::F7, 0x33 | isa::f3(4),                 OP_XOR,  FMT_R, RV32_EXT_I, "xor"},
+  {isa::F7, 0x33 | isa::f3(5),                 OP_SRL,  FMT_R, RV32_EXT_I, "srl"},
+  {isa::F7, 0x33 | isa::f3(5) | isa::f7(0x20), OP_SRA,  FMT_R, RV32_EXT_I, "sra"},
+  {isa::F7, 0x33 | isa::f3(6),                 OP_OR,   FMT_R, RV32_EXT_I, "or"},
+  {isa::F7, 0x33 | isa::f3(7),                 OP_AND,  FMT_R, RV32_EXT_I, "and"},
+
+  {isa::F3,  0x0f | isa::f3(1), OP_FENCE_I, FMT_NONE, RV32_EXT_I, "fence.i"},
+  {isa::OPC, 0x0f,              OP_FENCE,   FMT_NONE, RV32_EXT_I, "fence"},
+
+  {isa::ALL, 0x00000073, OP_ECALL,  FMT_NONE, RV32_EXT_I, "ecall"},
+  {isa::ALL, 0x00100073, OP_EBREAK, FMT_NONE, RV32_EXT_I, "ebreak"},
+  // mret/wfi and friends have no effect in this bare-metal model
+  {isa::F3, 0x73 | isa::f3(0), OP_NOP,    FMT_NONE, RV32_EXT_I, "system"},
+  {isa::F3, 0x73 | isa::f3(1), OP_CSRRW,  FMT_CSR,  RV32_EXT_I, "csrrw"},
+  {isa::F3, 0x73 | isa::f3(2), OP_CSRRS,  FMT_CSR,  RV32_EXT_I, "csrrs"},
+  {isa::F3, 0x73 | isa::f3(3), OP_CSRRC,  FMT_CSR,  RV32_EXT_I, "csrrc"},
+  {isa::F3, 0x73 | isa::f3(4), OP_CSRRSI, FMT_CSRR, RV32_EXT_I, "csrr"},
+  {isa::F3, 0x73 | isa::f3(5), OP_CSRRWI, FMT_CSRI, RV32_EXT_I, "csrrwi"},
+  {isa::F3, 0x73 | isa::f3(6), OP_CSRRSI, FMT_CSRI, RV32_EXT_I, "csrrsi"},
+  {isa::F3, 0x73 | isa::f3(7), OP_CSRRCI, FMT_CSRI, RV32_EXT_I, "csrrci"},
+
+  {isa::F7, 0x33 | isa::f3(0) | isa::f7(1), OP_MUL,    FMT_R, RV32_EXT_M, "mul"},
+  {isa::F7, 0x33 | isa::f3(1) | isa::f7(1), OP_MULH,   FMT_R, RV32_EXT_M, "mulh"},
+  {isa::F7, 0x33 | isa::f3(2) | isa::f7(1), OP_MULHSU, FMT_R, RV32_EXT_M, "mulhsu"},
+  {isa::F7, 0x33 | isa::f3(3) | isa::f7(1), OP_MULHU,  FMT_R, RV32_EXT_M, "mulhu"},
+  {isa::F7, 0x33 | isa::f3(4) | isa::f7(1), OP_DIV,    FMT_R, RV32_EXT_M, "div"},
+  {isa::F7, 0x33 | isa::f3(5) | isa::f7(1), OP_DIVU,   FMT_R, RV32_EXT_M, "divu"},
+  {isa::F7, 0x33 | isa::f3(6) | isa::f7(1), OP_REM,    FMT_R, RV32_EXT_M, "rem"},
+  {isa::F7, 0x33 | isa::f3(7) | isa::f7(1), OP_REMU,   FMT_R, RV32_EXT_M, "remu"},
+
+  {isa::F5, 0x2f | isa::f3(2) | isa::f5(0x02), OP_LR,      FMT_AMO, RV32_EXT_A, "lr.w"},
+  {isa::F5, 0x2f | isa::f3(2) | isa::f5(0x03), OP_SC,      FMT_AMO, RV32_EXT_A, "sc.w"},
+  {isa::F5, 0x2f | isa::f3(2) | isa::f5(0x00), OP_AMOADD,  FMT_AMO, RV32_EXT_A, "amoadd.w"},
+  {isa::F5, 0x2f | isa::f3(2) | isa::f5(0x01), OP_AMOSWAP, FMT_AMO, RV32_EXT_A, "amoswap.w"},
+  {isa::F5, 0x2f | isa::f3(2) | isa::f5(0x04), OP_AMOXOR,  FMT_AMO, RV32_EXT_A, "amoxor.w"},
+  {isa::F5, 0x2f | isa::f3(2) | isa::f5(0x08), OP_AMOOR,   FMT_AMO, RV32_EXT_A, "amoor.w"},
+  {isa::F5, 0x2f | isa::f3(2) | isa::f5(0x0c), OP_AMOAND,  FMT_AMO, RV32_EXT_A, "amoand.w"},
+  {isa::F5, 0x2f | isa::f3(2) | isa::f5(0x10), OP_AMOMIN,  FMT_AMO, RV32_EXT_A, "amomin.w"},
+  {isa::F5, 0x2f | isa::f3(2) | isa::f5(0x14), OP_AMOMAX,  FMT_AMO, RV32_EXT_A, "amomax.w"},
+  {isa::F5, 0x2f | isa::f3(2) | isa::f5(0x18), OP_AMOMINU, FMT_AMO, RV32_EXT_A, "amominu.w"},
+  {isa::F5, 0x2f | isa::f3(2) | isa::f5(0x1c), OP_AMOMAXU, FMT_AMO, RV32_EXT_A, "amomaxu.w"},
+};
+
+static constexpr size_t INS_COUNT = sizeof(INS_TABLE) / sizeof(INS_TABLE[0]);
+
+namespace isa {
+
+// ─── Field extraction ──────────────────────────────────────────────────────
+constexpr int32_t sx(uint32_t v, unsigned bits) {
+  uint32_t sign = 1u << (bits - 1);
+  return int32_t((v ^ sign) - sign);
+}
+
+constexpr int32_t imm_i(uint32_t ins) { return sx(ins >> 20, 12); }
+constexpr int32_t imm_u(uint32_t ins) { return int32_t(ins & 0xfffff000u); }
+constexpr int32_t imm_s(uint32_t ins) { return sx(((ins >> 7) & 0x1f) | ((ins >> 20) & 0xfe0), 12); }
+constexpr int32_t imm_b(uint32_t ins) {
+  return sx(((ins >> 7) & 0x1e) | ((ins >> 20) & 0x7e0) | ((ins << 4) & 0x800) | ((ins >> 19) & 0x1000), 13);
+}
+constexpr int32_t imm_j(uint32_t ins) {
+  return sx(((ins >> 20) & 0x7fe) | ((ins >> 9) & 0x800) | (ins & 0xff000) | ((ins >> 11) & 0x100000), 21);
+}
+
+// ─── Index ─────────────────────────────────────────────────────────────────
+// opcode[6:2] | funct3 << 5 | funct7 << 8.  The low opcode bits are always
+// 0b11 for 32-bit encodings and are checked separately.
+constexpr uint32_t INDEX_SIZE = 1u << 15;
+constexpr uint32_t KEY_BITS   = 0xfe00707c;
+
+constexpr uint32_t key(uint32_t ins) {
+  return ((ins >> 2) & 0x1f) | ((ins >> 7) & 0xe0) | ((ins >> 17) & 0x7f00);
+}
+
+// Each slot holds the first entry in the subset whose key bits agree with
+// the key (table position + 1), or 0.  Entries are written last to first over
+// every key they cover, so earlier entries win.
+template <unsigned Subset>
+constexpr std::array<uint8_t, INDEX_SIZE> make_index() {
+  std::array<uint8_t, INDEX_SIZE> index{};
+  for (size_t i = INS_COUNT; i-- > 0;) {
+    const InsDesc& e = INS_TABLE[i];
+    if (!(e.ext & Subset)) continue;
+    uint32_t fixed = key(e.mask & KEY_BITS), value = key(e.match), free = (INDEX_SIZE - 1) & ~fixed;
+    for (uint32_t s = free;; s = (s - 1) & free) {
+      index[value | s] = uint8_t(i + 1);
+      if (!s) break;
+    }
+  }
+  return index;
+}
+
+template <unsigned Subset>
+constexpr std::array<uint8_t, INDEX_SIZE> INDEX = make_index<Subset>();
+
+// Full match for the rare encodings that share a key with another entry
+// (ebreak behind ecall).
+constexpr uint8_t find(uint32_t ins, unsigned subset) {
+  for (size_t i = 0; i < INS_COUNT; i++) {
+    const InsDesc& e = INS_TABLE[i];
+    if ((e.ext & subset) && (ins & e.mask) == e.match) return uint8_t(i + 1);
+  }
+  return 0;
+}
+
+template <unsigned Subset>
+inline const InsDesc* describe(uint32_t ins) {
+  if ((ins & 3) != 3) return nullptr;
+  uint8_t e = INDEX<Subset>[key(ins)];
+  if (e && (ins & INS_TABLE[e - 1].mask) != INS_TABLE[e - 1].match) e = find(ins, Subset);
+  return e ? &INS_TABLE[e - 1] : nullptr;
+}
+
+// ─── Per-entry decoders ────────────────────────────────────────────────────
+// One instantiation per table entry; the format is a compile-time constant,
+// so each only extracts the fields its instruction has.
+template <size_t I>
+DecodedIns decode_entry(uint32_t ins) {
+  constexpr InsDesc e = INS_TABLE[I];
+  DecodedIns d{e.op, uint8_t((ins >> 7) & 0x1f), uint8_t((ins >> 15) & 0x1f), uint8_t((ins >> 20) & 0x1f), 0};
+  if constexpr (e.fmt == FMT_I || e.fmt == FMT_JALR || e.fmt == FMT_LOAD) d.imm = imm_i(ins);
+  else if constexpr (e.fmt == FMT_SHIFT) d.imm = d.rs2;
+  else if constexpr (e.fmt == FMT_S) d.imm = imm_s(ins);
+  else if constexpr (e.fmt == FMT_B) d.imm = imm_b(ins);
+  else if constexpr (e.fmt == FMT_U) d.imm = imm_u(ins);
+  else if constexpr (e.fmt == FMT_J) d.imm = imm_j(ins);
+  else if constexpr (e.fmt == FMT_CSR || e.fmt == FMT_CSRI) d.imm = ins >> 20;
+  else if constexpr (e.fmt == FMT_CSRR) { d.imm = ins >> 20; d.rs1 = 0; }
+  return d;
+}
+
+using EntryDecoder = DecodedIns (*)(uint32_t);
+
+template <size_t... I>
+constexpr std::array<EntryDecoder, INS_COUNT> make_decoders(std::index_sequence<I...>) {
+  return {{&decode_entry<I>...}};
+}
+
+constexpr std::array<EntryDecoder, INS_COUNT> DECODERS = make_decoders(std::make_index_sequence<INS_COUNT>());
+
+}  // namespace isa
+
+// Predecodes one instruction.  Encodings outside Subset become OP_ILLEGAL.
+template <unsigned Subset = RV32_ISA>
+inline DecodedIns predecode(uint32_t ins) {
+  const InsDesc* e = isa::describe<Subset>(ins);
+  if (!e) return {OP_ILLEGAL, uint8_t((ins >> 7) & 0x1f), uint8_t((ins >> 15) & 0x1f), uint8_t((ins >> 20) & 0x1f), 0};
+  return isa::DECODERS[e - INS_TABLE](ins);
+}
+
+// Trace disassembly.  Always covers the full RV32IMA table so that a build
+// without an extension still names the instructions it rejects.
+inline std::string disassemble(uint32_t ins) {
+  const InsDesc* e = isa::describe<RV32_ISA_IMA>(ins);
+  if (!e) return "unknown";
+
+  DecodedIns d = isa::DECODERS[e - INS_TABLE](ins);
+  std::stringstream ss;
+  ss << e->name;
+  switch (e->fmt) {
+    case FMT_R:     ss << " x" << +d.rd << ",x" << +d.rs1 << ",x" << +d.rs2; break;
+    case FMT_I:
+    case FMT_SHIFT:
+    case FMT_JALR:  ss << " x" << +d.rd << ",x" << +d.rs1 << "," << d.imm; break;
+    case FMT_LOAD:  ss << " x" << +d.rd << "," << d.imm << "(x" << +d.rs1 << ")"; break;
+    case FMT_S:     ss << " x" << +d.rs2 << "," << d.imm << "(x" << +d.rs1 << ")"; break;
+    case FMT_B:     ss << " x" << +d.rs1 << ",x" << +d.rs2 << "," << d.imm; break;
+    case FMT_U:     ss << " x" << +d.rd << ",0x" << std::hex << uint32_t(d.imm); break;
+    case FMT_J:     ss << " x" << +d.rd << "," << d.imm; break;
+    case FMT_CSR:   ss << " x" << +d.rd << ",0x" << std::hex << d.imm << std::dec << ",x" << +d.rs1; break;
+    case FMT_CSRI:  ss << " x" << +d.rd << ",0x" << std::hex << d.imm << std::dec << "," << +d.rs1; break;
+    case FMT_CSRR:  ss << " x" << +d.rd << ",0x" << std::hex << d.imm; break;
+    case FMT_AMO:   ss << " x" << +d.rd << ",x" << +d.rs2 << ",(x" << +d.rs1 << ")"; break;
+    case FMT_NONE:  break;
+  }
+  return ss.str();
+}
+
+#endif // RV32IMA_ISA_H
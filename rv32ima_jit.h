@@ -0,0 +1,560 @@
+// x86-64 translator for hot basic blocks (included by rv32ima.cc)
+//
+// A block that has been interpreted jit_threshold times is queued for the
+// compile thread (or translated on the spot with jit_background off) into a
+// native function (NativeBlock) that runs the whole block, adds its cycles and
+// leaves for the successor.  Exits to a static successor (branch targets,
+// JAL, falling off the end) jump straight into the successor's translation
+// once run_native() has linked the edge; JALR, unlinked exits and exits after
+// a store dirtied cached code return to the dispatcher, as do all exits once
+// cycles reaches cpu->fast_limit.  Inside the generated code:
+//
+//   rbx               CPU*
+//   r15               host address of guest RAM
+//   rax, rcx, rdx     scratch
+//   rbp, r12-r14,     the block's most used guest registers, loaded on entry
+//   rsi, rdi, r8-r11  and written back to cpu->x on exit
+//
+// Loads and stores are a bounds check plus a direct access to guest RAM.
+// Out-of-range addresses, and stores to pages that hold decoded code (which
+// must be invalidated), branch to out-of-line stubs that call back into the
+// CPU; so does every access on a bus without directly addressable memory
+// (VirtualBus).  Atomics go through the interpreter handlers with the registers spilled.
+// SYSTEM instructions always run alone in their block and are never translated.
+
+#include <algorithm>
+#include "x86_emitter.h"
+
+// Host registers guest values may live in; callee-saved ones first, as they
+// survive slow-path calls without being pushed
+static const x86::Reg JIT_GUEST_REGS[] = {
+  x86::RBP, x86::R12, x86::R13, x86::R14,
+  x86::RSI, x86::RDI, x86::R8, x86::R9, x86::R10, x86::R11,
+};
+static constexpr x86::Reg JIT_NO_REG = x86::RSP;   // guest register lives in cpu->x
+
+static bool jit_caller_saved(x86::Reg r) {
+  return r == x86::RSI || r == x86::RDI || (r >= x86::R8 && r <= x86::R11);
+}
+
+// ─── Slow paths called from translated code ──────────────────────────────────
+template <class Bus>
+uint32_t CPU<Bus>::jit_load(CPU* c, uint32_t addr, uint32_t op) {
+  switch (op) {
+    case OP_LB:  return (int8_t)c->fetch8(addr);
+    case OP_LH:  return (int16_t)c->fetch16(addr);
+    case OP_LBU: return c->fetch8(addr);
+    case OP_LHU: return c->fetch16(addr);
+    default:     return c->fetch32(addr);
+  }
+}
+
+template <class Bus>
+void CPU<Bus>::jit_store(CPU* c, uint32_t addr, uint32_t v, uint32_t op) {
+  switch (op) {
+    case OP_SB: c->store8(addr, v);  break;
+    case OP_SH: c->store16(addr, v); break;
+    default:    c->store32(addr, v); break;
+  }
+}
+
+template <class Bus>
+void CPU<Bus>::jit_exec(CPU* c, const DecodedIns* d, uint32_t at) {
+  c->exec_one(*d, at);
+}
+
+// ─── Compile thread ──────────────────────────────────────────────────────────
+// The emulation thread only ever waits for the compiler when it drops blocks
+// from the cache (a compile in flight may still be reading one).
+template <class Bus>
+void CPU<Bus>::jit_request(Block* b) {
+  if (jit_full) {               // recycle the code buffer at the next block exit
+    blocks_dirty = true;
+    return;
+  }
+  if (!jit_background) {
+    std::lock_guard<std::mutex> code_lock(jit_code_mutex);
+    jit_compile(b);
+    return;
+  }
+  std::lock_guard<std::mutex> queue_lock(jit_queue_mutex);
+  if (!jit_thread.joinable()) jit_thread = std::thread(&CPU::jit_worker, this);
+  jit_queue.push_back(b);
+  jit_cv.notify_one();
+}
+
+template <class Bus>
+void CPU<Bus>::jit_worker() {
+  std::unique_lock<std::mutex> queue_lock(jit_queue_mutex);
+  for (;;) {
+    jit_cv.wait(queue_lock, [&] { return jit_stop || !jit_queue.empty(); });
+    if (jit_stop) return;
+    Block* b = jit_queue.front();
+    jit_queue.pop_front();
+    // Take the code lock before dropping the queue lock, so a flush cannot
+    // free b in between
+    std::lock_guard<std::mutex> code_lock(jit_code_mutex);
+    queue_lock.unlock();
+    jit_compile(b);
+    queue_lock.lock();
+  }
+}
+
+template <class Bus>
+void CPU<Bus>::jit_shutdown() {
+  {
+    std::lock_guard<std::mutex> queue_lock(jit_queue_mutex);
+    jit_stop = true;
+  }
+  jit_cv.notify_one();
+  if (jit_thread.joinable()) jit_thread.join();
+}
+
+// ─── Translation ─────────────────────────────────────────────────────────────
+// Called with jit_code_mutex held.  Touches nothing of the CPU but the code
+// buffer and the block, which is published through Block::native last.
+template <class Bus>
+bool CPU<Bus>::jit_compile(Block* b) {
+  using namespace x86;
+
+  if (runs_alone(b->ins[0].op)) return false;
+  if (!jit_code) jit_code.reset(new CodeBuffer(JIT_CODE_SIZE));
+  if (!jit_code->ok()) return false;
+
+  // Guest registers used at least twice get a host register, most used first
+  int uses[32] = {};
+  bool written[32] = {};
+  for (uint32_t i = 0; i < b->n_ins; i++) {
+    uint32_t reads, writes;
+    reg_effects(&b->ins[i], reads, writes);
+    for (int g = 1; g < 32; g++) {
+      uses[g] += ((reads >> g) & 1) + ((writes >> g) & 1);
+      if ((writes >> g) & 1) written[g] = true;
+    }
+    if (b->ins[i].op >= OP_FUSED_FIRST) i++;   // second record of a pair
+  }
+  int order[31];
+  for (int g = 1; g < 32; g++) order[g - 1] = g;
+  std::stable_sort(order, order + 31, [&](int p, int q) { return uses[p] > uses[q]; });
+
+  Reg host[32];
+  std::fill(host, host + 32, JIT_NO_REG);
+  std::vector<Reg> call_saved;   // allocated registers a helper call may clobber
+  size_t n_alloc = 0;
+  for (int g : order) {
+    if (uses[g] < 2 || n_alloc == sizeof(JIT_GUEST_REGS) / sizeof(JIT_GUEST_REGS[0])) break;
+    host[g] = JIT_GUEST_REGS[n_alloc++];
+    if (jit_caller_saved(host[g])) call_saved.push_back(host[g]);
+  }
+
+  Emitter a(jit_code->cur(), jit_code->avail());
+  auto offset = [&](const void* field) { return int32_t((const char*)field - (const char*)this); };
+  const int32_t xoff = offset(x);
+  auto xreg = [&](int g) { return ptr(RBX, xoff + 4 * g); };
+
+  auto reload = [&] {
+    for (int g = 1; g < 32; g++)
+      if (host[g] != JIT_NO_REG) a.load(host[g], xreg(g));
+  };
+  auto writeback = [&] {
+    for (int g = 1; g < 32; g++)
+      if (host[g] != JIT_NO_REG && written[g]) a.store(xreg(g), host[g]);
+  };
+  auto save = [&] {
+    for (Reg r : call_saved) a.push(r);
+    if (call_saved.size() & 1) a.sub_rsp(8);   // keep rsp 16-byte aligned at the call
+  };
+  auto restore = [&] {
+    if (call_saved.size() & 1) a.add_rsp(8);
+    for (size_t i = call_saved.size(); i-- > 0;) a.pop(call_saved[i]);
+  };
+
+  // Register holding guest register g, loading it into scratch if unallocated
+  auto get = [&](int g, Reg scratch) -> Reg {
+    if (g == 0) { a.mov(scratch, 0u); return scratch; }
+    if (host[g] != JIT_NO_REG) return host[g];
+    a.load(scratch, xreg(g));
+    return scratch;
+  };
+  auto get_into = [&](int g, Reg r) {
+    Reg s = get(g, r);
+    if (s != r) a.mov(r, s);
+  };
+  auto set = [&](int g, Reg r) {
+    if (g == 0) return;
+    if (host[g] == JIT_NO_REG) a.store(xreg(g), r);
+    else if (host[g] != r) a.mov(host[g], r);
+  };
+  auto set_imm = [&](int g, uint32_t v) {
+    if (g == 0) return;
+    if (host[g] == JIT_NO_REG) a.store_imm(xreg(g), v);
+    else a.mov(host[g], v);
+  };
+  // Where to compute rd: its own host register unless that would clobber rs2
+  // before it is read
+  auto dest = [&](const DecodedIns& d, bool reads_rs2) {
+    return (host[d.rd] != JIT_NO_REG && !(reads_rs2 && d.rd == d.rs2)) ? host[d.rd] : RAX;
+  };
+  // t = t <op> x[rs2]
+  auto alu_rs2 = [&](AluOp op, Reg t, int rs2) {
+    if (rs2 == 0) a.alu(op, t, 0);
+    else if (host[rs2] != JIT_NO_REG) a.alu(op, t, host[rs2]);
+    else a.alu(op, t, xreg(rs2));
+  };
+  // eax = x[rs1] + imm
+  auto addr = [&](const DecodedIns& d) {
+    Reg s = get(d.rs1, RAX);
+    if (d.imm) a.lea(RAX, ptr(s, d.imm));
+    else if (s != RAX) a.mov(RAX, s);
+  };
+
+  // Out-of-line slow paths, emitted after the epilogue
+  struct Stub {
+    Label entry, resume;
+    const DecodedIns* d;
+    Reg dst;   // loads: register the value is expected in at resume
+  };
+  std::vector<Stub> stubs;
+  stubs.reserve(b->n_ins);
+
+  // Branches to a stub when eax + size exceeds guest RAM; false (and an
+  // unconditional branch) when the bus has no directly addressable RAM
+  auto bounds_check = [&](Stub& s, uint32_t size) {
+    if (!mem.data()) {
+      a.jmp(s.entry);
+      return false;
+    }
+    if (mem.size() <= 0xffffffffull) {
+      a.alu(CMP, RAX, int32_t(uint32_t(mem.size() - size)));
+      a.jcc(CC_A, s.entry);
+    }
+    return true;
+  };
+
+  // Load/store of the guest address in eax; m is the (unfused) memory record
+  auto load_at_eax = [&](const DecodedIns& m) {
+    static const uint32_t size[] = {1, 2, 4, 1, 2};
+    Reg t = host[m.rd] != JIT_NO_REG ? host[m.rd] : RDX;
+    stubs.push_back({{}, {}, &m, t});
+    Stub& s = stubs.back();
+    if (bounds_check(s, size[m.op - OP_LB])) {
+      Mem p = ptr(R15, RAX, 0);
+      switch (m.op) {
+        case OP_LB:  a.movsx8(t, p);  break;
+        case OP_LH:  a.movsx16(t, p); break;
+        case OP_LW:  a.load(t, p);    break;
+        case OP_LBU: a.movzx8(t, p);  break;
+        case OP_LHU: a.movzx16(t, p); break;
+      }
+    }
+    a.bind(s.resume);
+    set(m.rd, t);
+  };
+  auto store_at_eax = [&](const DecodedIns& m) {
+    stubs.push_back({{}, {}, &m, RAX});
+    Stub& s = stubs.back();
+    if (bounds_check(s, 1u << (m.op - OP_SB))) {
+      a.mov(RCX, RAX);
+      a.shift(SHR, RCX, PAGE_SHIFT);
+      a.mov64(RDX, (uint64_t)(uintptr_t)code_pages.data());
+      a.cmp8(ptr(RDX, RCX, 0), 0);
+      a.jcc(CC_NE, s.entry);
+      Reg v = get(m.rs2, RDX);
+      Mem p = ptr(R15, RAX, 0);
+      if (m.op == OP_SB) a.store8(p, v);
+      else if (m.op == OP_SH) a.store16(p, v);
+      else a.store(p, v);
+    }
+    a.bind(s.resume);
+  };
+  auto addi = [&](const DecodedIns& d) {
+    if (d.rs1 == 0) { set_imm(d.rd, d.imm); return; }
+    Reg t = dest(d, false);
+    Reg s = get(d.rs1, t);
+    if (s != t) a.lea(t, ptr(s, d.imm));
+    else if (d.imm) a.alu(ADD, t, d.imm);
+    set(d.rd, t);
+  };
+  auto count_fused = [&](const DecodedIns& d) {
+    a.add64(ptr(RBX, offset(&fused_hits[d.op - OP_FUSED_FIRST])), 1);
+  };
+
+  // ─── Prologue ──────────────────────────────────────────────────────────────
+  static const Reg pushed[] = {RBX, RBP, R12, R13, R14, R15};
+  for (Reg r : pushed) a.push(r);
+  a.sub_rsp(8);
+  a.mov64(RBX, RDI);
+  a.mov64(R15, (uint64_t)(uintptr_t)mem.data());
+  const size_t body = a.size();   // linked translations jump here
+  reload();
+
+  // ─── Exits ─────────────────────────────────────────────────────────────────
+  Label ret;
+  auto retire = [&] {
+    writeback();
+    a.add64(ptr(RBX, offset(&cycles)), b->n_ins);
+  };
+  // Leave for a static successor through exit slot k
+  auto leave_to = [&](int k, uint32_t target) {
+    retire();
+    a.mov(RAX, target);
+    b->exit_pc[k] = target;
+    a.cmp8(ptr(RBX, offset(&blocks_dirty)), 0);
+    a.jcc(CC_NE, ret);
+    a.load64(RCX, ptr(RBX, offset(&cycles)));
+    a.cmp64(RCX, ptr(RBX, offset(&fast_limit)));
+    a.jcc(CC_AE, ret);
+    a.mov64(RCX, (uint64_t)(uintptr_t)&b->exit_to[k]);
+    a.load64(RCX, ptr(RCX));
+    a.test64(RCX, RCX);
+    a.jcc(CC_E, ret);
+    a.jmp(RCX);
+  };
+
+  // ─── Body ──────────────────────────────────────────────────────────────────
+  bool ended = false;   // the last instruction left the block
+  for (uint32_t i = 0; i < b->n_ins; i++) {
+    const DecodedIns& d = b->ins[i];
+    const DecodedIns& d2 = b->ins[i + 1];   // at worst the OP_BLOCK_END sentinel
+    const uint32_t at = b->pc + i * 4;
+
+    switch (d.op) {
+    case OP_NOP:
+    case OP_FENCE:
+      break;
+
+    case OP_LUI:   set_imm(d.rd, d.imm); break;
+    case OP_AUIPC: set_imm(d.rd, at + d.imm); break;
+
+    case OP_JAL:
+      set_imm(d.rd, at + 4);
+      leave_to(0, at + d.imm);
+      ended = true;
+      break;
+    case OP_JALR:
+      addr(d);
+      a.alu(AND, RAX, -2);
+      set_imm(d.rd, at + 4);
+      retire();
+      a.jmp(ret);
+      ended = true;
+      break;
+
+    case OP_BEQ: case OP_BNE: case OP_BLT: case OP_BGE: case OP_BLTU: case OP_BGEU: {
+      static const Cond cc[] = {CC_E, CC_NE, CC_L, CC_GE, CC_B, CC_AE};
+      Reg s = get(d.rs1, RAX);
+      if (d.rs2 == 0) a.alu(CMP, s, 0);
+      else alu_rs2(CMP, s, d.rs2);
+      Label taken;
+      a.jcc(cc[d.op - OP_BEQ], taken);
+      leave_to(1, at + 4);
+      a.bind(taken);
+      leave_to(0, at + d.imm);
+      ended = true;
+    } break;
+
+    case OP_LB: case OP_LH: case OP_LW: case OP_LBU: case OP_LHU:
+      addr(d);
+      load_at_eax(d);
+      break;
+    case OP_SB: case OP_SH: case OP_SW:
+      addr(d);
+      store_at_eax(d);
+      break;
+
+    case OP_ADDI: addi(d); break;
+    case OP_XORI: case OP_ORI: case OP_ANDI: {
+      static const AluOp ops[] = {XOR, OR, AND};
+      Reg t = dest(d, false);
+      get_into(d.rs1, t);
+      a.alu(ops[d.op - OP_XORI], t, d.imm);
+      set(d.rd, t);
+    } break;
+    case OP_SLLI: case OP_SRLI: case OP_SRAI: {
+      static const ShiftOp ops[] = {SHL, SHR, SAR};
+      Reg t = dest(d, false);
+      get_into(d.rs1, t);
+      if (d.imm & 31) a.shift(ops[d.op - OP_SLLI], t, d.imm & 31);
+      set(d.rd, t);
+    } break;
+    case OP_SLTI: case OP_SLTIU: {
+      Reg s = get(d.rs1, RAX);
+      a.alu(CMP, s, d.imm);
+      a.setcc(d.op == OP_SLTI ? CC_L : CC_B, RAX);
+      a.movzx8(RAX, RAX);
+      set(d.rd, RAX);
+    } break;
+
+    case OP_ADD: case OP_SUB: case OP_XOR: case OP_OR: case OP_AND: {
+      AluOp op = d.op == OP_ADD ? ADD : d.op == OP_SUB ? SUB : d.op == OP_XOR ? XOR : d.op == OP_OR ? OR : AND;
+      Reg t = dest(d, true);
+      get_into(d.rs1, t);
+      alu_rs2(op, t, d.rs2);
+      set(d.rd, t);
+    } break;
+    case OP_SLL: case OP_SRL: case OP_SRA: {
+      ShiftOp op = d.op == OP_SLL ? SHL : d.op == OP_SRL ? SHR : SAR;
+      get_into(d.rs2, RCX);   // the hardware masks the count to 5 bits, like RV32
+      Reg t = dest(d, true);
+      get_into(d.rs1, t);
+      a.shift_cl(op, t);
+      set(d.rd, t);
+    } break;
+    case OP_SLT: case OP_SLTU: {
+      Reg s = get(d.rs1, RAX);
+      alu_rs2(CMP, s, d.rs2);
+      a.setcc(d.op == OP_SLT ? CC_L : CC_B, RAX);
+      a.movzx8(RAX, RAX);
+      set(d.rd, RAX);
+    } break;
+
+    case OP_MUL: {
+      Reg s2 = get(d.rs2, RCX);
+      Reg t = dest(d, true);
+      get_into(d.rs1, t);
+      a.imul(t, s2);
+      set(d.rd, t);
+    } break;
+    case OP_MULH: case OP_MULHSU: case OP_MULHU: {
+      Reg s1 = get(d.rs1, RAX);
+      if (d.op == OP_MULHU) { if (s1 != RAX) a.mov(RAX, s1); }
+      else a.movsxd(RAX, s1);
+      Reg s2 = get(d.rs2, RCX);
+      if (d.op == OP_MULH) a.movsxd(RCX, s2);
+      else if (s2 != RCX) a.mov(RCX, s2);
+      a.imul64(RAX, RCX);
+      a.shift64(SHR, RAX, 32);
+      set(d.rd, RAX);
+    } break;
+    case OP_DIV: case OP_DIVU: case OP_REM: case OP_REMU: {
+      bool is_signed = d.op == OP_DIV || d.op == OP_REM;
+      bool is_rem = d.op == OP_REM || d.op == OP_REMU;
+      get_into(d.rs2, RCX);
+      get_into(d.rs1, RAX);
+      Label by_zero, done;
+      a.test(RCX, RCX);
+      a.jcc(CC_E, by_zero);
+      if (is_signed) {
+        Label normal;
+        a.alu(CMP, RCX, -1);
+        a.jcc(CC_NE, normal);
+        if (is_rem) a.mov(RDX, 0u); else a.neg(RAX);   // INT_MIN / -1 wraps
+        a.jmp(done);
+        a.bind(normal);
+        a.cdq();
+        a.idiv(RCX);
+      } else {
+        a.mov(RDX, 0u);
+        a.div(RCX);
+      }
+      a.jmp(done);
+      a.bind(by_zero);
+      if (is_rem) a.mov(RDX, RAX); else a.mov(RAX, 0xffffffffu);
+      a.bind(done);
+      set(d.rd, is_rem ? RDX : RAX);
+    } break;
+
+    case OP_FENCE_I:
+    case OP_LR: case OP_SC:
+    case OP_AMOADD: case OP_AMOSWAP: case OP_AMOXOR: case OP_AMOOR: case OP_AMOAND:
+    case OP_AMOMIN: case OP_AMOMAX: case OP_AMOMINU: case OP_AMOMAXU:
+      writeback();
+      a.mov64(RDI, RBX);
+      a.mov64(RSI, (uint64_t)(uintptr_t)&d);
+      a.mov(RDX, at);
+      a.call((const void*)&CPU::jit_exec);
+      reload();
+      break;
+
+    // ─── Fused pairs (see rv32ima_fused.h); d2 is the second record ─────────
+    case OP_LI:
+      count_fused(d);
+      set_imm(d.rd, d.imm);
+      i++;
+      break;
+    case OP_AUIPC_JALR:
+      count_fused(d);
+      set_imm(d.rs1, at + d.imm - d2.imm);
+      set_imm(d.rd, at + 8);
+      leave_to(0, (at + d.imm) & ~1u);
+      ended = true;
+      i++;
+      break;
+    case OP_AUIPC_LW:
+      count_fused(d);
+      set_imm(d.rs1, at + d.imm - d2.imm);
+      a.mov(RAX, at + d.imm);
+      load_at_eax(d2);
+      i++;
+      break;
+    case OP_SLT_BNEZ: case OP_SLT_BEQZ: case OP_SLTU_BNEZ: case OP_SLTU_BEQZ: {
+      bool is_signed = d.op == OP_SLT_BNEZ || d.op == OP_SLT_BEQZ;
+      bool on_set = d.op == OP_SLT_BNEZ || d.op == OP_SLTU_BNEZ;
+      count_fused(d);
+      Reg s = get(d.rs1, RAX);
+      alu_rs2(CMP, s, d.rs2);
+      a.setcc(is_signed ? CC_L : CC_B, RAX);   // flags survive the moves below
+      a.movzx8(RAX, RAX);
+      set(d.rd, RAX);
+      Label taken;
+      a.jcc(is_signed ? (on_set ? CC_L : CC_GE) : (on_set ? CC_B : CC_AE), taken);
+      leave_to(1, at + 8);
+      a.bind(taken);
+      leave_to(0, at + 4 + d.imm);
+      ended = true;
+      i++;
+    } break;
+    case OP_ADDI_SW:
+      count_fused(d);
+      addi(d);
+      addr(d2);
+      store_at_eax(d2);
+      i++;
+      break;
+
+    default:
+      return false;   // not expected inside a block
+    }
+  }
+  if (!ended) leave_to(0, b->pc + b->n_ins * 4);
+
+  // ─── Epilogue: back to the dispatcher with eax = next pc ───────────────────
+  a.bind(ret);
+  a.store(ptr(RBX, offset(&pc)), RAX);
+  a.mov64(RAX, (uint64_t)(uintptr_t)b);
+  a.add_rsp(8);
+  for (size_t i = sizeof(pushed) / sizeof(pushed[0]); i-- > 0;) a.pop(pushed[i]);
+  a.ret();
+
+  // ─── Slow paths ────────────────────────────────────────────────────────────
+  for (Stub& s : stubs) {
+    const DecodedIns& d = *s.d;
+    a.bind(s.entry);
+    save();
+    if (d.op >= OP_SB && d.op <= OP_SW) {
+      get_into(d.rs2, RDX);   // before rsi/rdi, which may hold guest values
+      a.mov(RSI, RAX);
+      a.mov64(RDI, RBX);
+      a.mov(RCX, uint32_t(d.op));
+      a.call((const void*)&CPU::jit_store);
+      restore();
+    } else {
+      a.mov(RSI, RAX);
+      a.mov64(RDI, RBX);
+      a.mov(RDX, uint32_t(d.op));
+      a.call((const void*)&CPU::jit_load);
+      restore();
+      if (s.dst != RAX) a.mov(s.dst, RAX);
+    }
+    a.jmp(s.resume);
+  }
+
+  if (a.overflow()) {
+    jit_full = true;   // out of code space: the next request recycles everything
+    return false;
+  }
+  b->native_body = jit_code->cur() + body;
+  b->native.store((NativeBlock)jit_code->cur(), std::memory_order_release);
+  jit_code->commit(a.size());
+  return true;
+}
@@ -0,0 +1,121 @@
+// SDL emulator (make emulator-sdl): the rv32ima CPU on the DOOM machine
+//
+// The CPU with all of its engines (interpreter, blocks, JIT), the syscalls
+// and the ELF loader are rv32ima.cc's; this file only adds the bus and the
+// driver.  The bus is SDLMemory (memory_subsystem_sdl.h) behind DeviceBus:
+// RAM and device accesses are direct calls into its address decoder, and in
+// MEM=guard builds RAM accesses are plain host loads and stores, also from
+// translated code.
+//
+// The guest runs in slices of SLICE instructions.  Between slices the driver
+// hands the cycle count to the timer, takes SDL events and redraws the window,
+// so the run loops themselves never call out to SDL.
+
+#define RV32IMA_NO_MAIN
+#include "rv32ima.cc"
+#include "memory_subsystem_sdl.h"
+
+typedef DeviceBus<SDLMemory> SDLBus;
+
+// Instructions between two SDLMemory::update() calls (a few ms of guest time)
+static constexpr uint64_t SLICE = 1 << 20;
+
+// Loads the program (an ELF file by its headers, a flat binary at the start
+// of ROM), runs it until it stops, the instruction limit is reached or the
+// window is closed, and reports how it stopped; returns the process exit
+// status
+static int run_sdl(CPU<SDLBus>& cpu, const FileImage& bin, const Options& opt) {
+  configure(cpu, opt);
+  if (opt.elf ? !opt.elf->load(cpu.mem, bin) : !cpu.mem.load_image(bin, MEM_ROM_BASE)) {
+    std::cerr << "Error: program does not fit in ROM (0x" << std::hex << MEM_ROM_BASE << ") and PSRAM (0x"
+              << MEM_PSRAM_BASE << ")" << std::endl;
+    return 1;
+  }
+  cpu.pc = opt.elf ? opt.elf->entry : MEM_ROM_BASE;
+  std::unique_ptr<Semihost> semihost = attach_semihost(cpu, opt);
+
+  ExitReason why = EXIT_LIMIT;
+  auto start = std::chrono::steady_clock::now();
+  while (why == EXIT_LIMIT && cpu.cycles < opt.max_instructions && !cpu.mem->should_quit()) {
+    uint64_t n = std::min(SLICE, opt.max_instructions - cpu.cycles);
+    why = opt.trace ? cpu.run<TRACE_FULL>(n) : cpu.run<TRACE_OFF>(n);
+    cpu.mem->update(cpu.cycles);
+  }
+  if (opt.stats) print_mips(cpu.cycles, start);
+  if (opt.fusion_stats) cpu.print_fusion_stats();
+  if (why == EXIT_LIMIT && cpu.cycles < opt.max_instructions) {
+    std::cerr << "Window closed after " << std::dec << cpu.cycles << " instructions" << std::endl;
+    return 0;
+  }
+  return exit_status(cpu, why, opt);
+}
+
+int main(int argc, char** argv) {
+  const char* usage = " [--trace] [--engine=interp|block|jit] [--jit-sync] [--no-fusion] [--fusion-stats]"
+                      " [--max-instructions=N] [--hugepages=thp|hugetlb] [--semihosting] [--stats] [-f] program.elf\n";
+  Options opt;
+  std::string filename;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--trace") {
+      opt.trace = true;
+    } else if (arg == "--engine=interp") {
+      opt.engine = ENGINE_INTERP;
+    } else if (arg == "--engine=block") {
+      opt.engine = ENGINE_BLOCK;
+    } else if (arg == "--engine=jit") {
+      opt.engine = ENGINE_JIT;         // plain block engine in builds without the JIT
+    } else if (arg == "--jit-sync") {
+      opt.jit_sync = true;
+    } else if (arg == "--no-fusion") {
+      opt.fusion = false;
+    } else if (arg == "--fusion-stats") {
+      opt.fusion_stats = true;
+    } else if (arg == "--stats") {
+      opt.stats = true;
+    } else if (arg.rfind("--max-instructions=", 0) == 0) {
+      if (!parse_option(arg, 19, opt.max_instructions, 0, UINT64_MAX)) {
+        std::cerr << "usage: " << argv[0] << usage;
+        return 1;
+      }
+    } else if (arg == "--semihosting") {
+      opt.semihosting = true;
+    } else if (arg == "--hugepages=thp") {
+      opt.ram.pages = RamOptions::PAGES_THP;
+    } else if (arg == "--hugepages=hugetlb") {
+      opt.ram.pages = RamOptions::PAGES_HUGETLB;
+    } else if (arg == "-f" && i + 1 < argc && filename.empty()) {
+      filename = argv[++i];
+    } else if (filename.empty() && arg[0] != '-') {
+      filename = arg;
+    } else {
+      std::cerr << "usage: " << argv[0] << usage;
+      return 1;
+    }
+  }
+  if (filename.empty()) {
+    std::cerr << "usage: " << argv[0] << usage;
+    return 1;
+  }
+  HostRam::defaults() = opt.ram;
+
+  FileImage bin(filename.c_str());
+  if (!bin.ok()) {
+    std::cerr << "Error: Cannot open file " << filename << std::endl;
+    return 1;
+  }
+  ElfFile elf;
+  if (ElfFile::is_elf(bin)) {
+    std::string error;
+    if (!elf.parse(bin, error)) {
+      std::cerr << "Error: " << filename << ": " << error << std::endl;
+      return 1;
+    }
+    opt.elf = &elf;
+  }
+
+  SDLMemory machine(MEM_ROM_SIZE + MEM_PSRAM_SIZE);
+  CPU<SDLBus> cpu(&machine, opt.trace);
+  return run_sdl(cpu, bin, opt);
+}
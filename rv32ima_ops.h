@@ -0,0 +1,126 @@
+// Instruction semantics for the rv32ima.cc interpreters
+//
+// This file is included into the body of each run loop (the switch-based
+// CPU::step(), the computed-goto CPU::run_threaded(), the block engine and
+// CPU::exec_one() used by the JIT), so every instruction form has exactly one
+// definition.  The includer provides:
+//
+//   OP(name)  - start of the handler for OP_<name>
+//   D         - the current DecodedIns (an lvalue)
+//   PC        - guest address of the current instruction
+//   NEXT      - retire the instruction and fall through to PC + 4
+//   JUMP(t)   - retire the instruction and continue at t
+//   STOP      - leave the run loop without retiring the instruction, with pc
+//               pointing at it (exit_reason says why)
+//
+// Handlers read and write the CPU members (x, CSRs, ...) directly and guest
+// memory through fetch8/16/32 and store8/16/32.  Writes to x[0] are allowed;
+// the run loops clear it again before it can be observed.
+// Extensions left out of RV32_ISA (rv32ima_isa.h) are never decoded, and
+// their handlers are compiled out.
+
+// ─── RV32I ───────────────────────────────────────────────────────────────────
+OP(LUI)   x[D.rd] = D.imm;      NEXT;
+OP(AUIPC) x[D.rd] = PC + D.imm; NEXT;
+OP(JAL)   { uint32_t t = PC + 4, target = PC + D.imm; if (D.rd) x[D.rd] = t; JUMP(target); }
+OP(JALR)  { uint32_t t = PC + 4, target = (x[D.rs1] + D.imm) & ~1u; if (D.rd) x[D.rd] = t; JUMP(target); }
+
+OP(BEQ)   if (x[D.rs1] == x[D.rs2]) JUMP(PC + D.imm); NEXT;
+OP(BNE)   if (x[D.rs1] != x[D.rs2]) JUMP(PC + D.imm); NEXT;
+OP(BLT)   if ((int32_t)x[D.rs1] <  (int32_t)x[D.rs2]) JUMP(PC + D.imm); NEXT;
+OP(BGE)   if ((int32_t)x[D.rs1] >= (int32_t)x[D.rs2]) JUMP(PC + D.imm); NEXT;
+OP(BLTU)  if (x[D.rs1] <  x[D.rs2]) JUMP(PC + D.imm); NEXT;
+OP(BGEU)  if (x[D.rs1] >= x[D.rs2]) JUMP(PC + D.imm); NEXT;
+
+OP(LB)    { uint32_t addr = x[D.rs1] + D.imm; x[D.rd] = (int8_t) fetch8(addr); } NEXT;
+OP(LH)    { uint32_t addr = x[D.rs1] + D.imm; x[D.rd] = (int16_t)fetch16(addr); } NEXT;
+OP(LW)    { uint32_t addr = x[D.rs1] + D.imm; x[D.rd] = fetch32(addr); } NEXT;
+OP(LBU)   { uint32_t addr = x[D.rs1] + D.imm; x[D.rd] = fetch8(addr); } NEXT;
+OP(LHU)   { uint32_t addr = x[D.rs1] + D.imm; x[D.rd] = fetch16(addr); } NEXT;
+
+OP(SB)    store8 (x[D.rs1] + D.imm, x[D.rs2]); NEXT;
+OP(SH)    store16(x[D.rs1] + D.imm, x[D.rs2]); NEXT;
+OP(SW)    store32(x[D.rs1] + D.imm, x[D.rs2]); NEXT;
+
+OP(ADDI)  x[D.rd] = x[D.rs1] + D.imm;                      NEXT;
+OP(SLTI)  x[D.rd] = (int32_t)x[D.rs1] < D.imm;             NEXT;
+OP(SLTIU) x[D.rd] = x[D.rs1] < (uint32_t)D.imm;            NEXT;
+OP(XORI)  x[D.rd] = x[D.rs1] ^ D.imm;                      NEXT;
+OP(ORI)   x[D.rd] = x[D.rs1] | D.imm;                      NEXT;
+OP(ANDI)  x[D.rd] = x[D.rs1] & D.imm;                      NEXT;
+OP(SLLI)  x[D.rd] = x[D.rs1] << D.imm;                     NEXT;
+OP(SRLI)  x[D.rd] = x[D.rs1] >> D.imm;                     NEXT;
+OP(SRAI)  x[D.rd] = int32_t(x[D.rs1]) >> D.imm;            NEXT;
+
+OP(ADD)   x[D.rd] = x[D.rs1] + x[D.rs2];                   NEXT;
+OP(SUB)   x[D.rd] = x[D.rs1] - x[D.rs2];                   NEXT;
+OP(SLL)   x[D.rd] = x[D.rs1] << (x[D.rs2] & 0x1f);         NEXT;
+OP(SLT)   x[D.rd] = (int32_t)x[D.rs1] < (int32_t)x[D.rs2]; NEXT;
+OP(SLTU)  x[D.rd] = x[D.rs1] < x[D.rs2];                   NEXT;
+OP(XOR)   x[D.rd] = x[D.rs1] ^ x[D.rs2];                   NEXT;
+OP(SRL)   x[D.rd] = x[D.rs1] >> (x[D.rs2] & 0x1f);         NEXT;
+OP(SRA)   x[D.rd] = (int32_t)x[D.rs1] >> (x[D.rs2] & 0x1f); NEXT;
+OP(OR)    x[D.rd] = x[D.rs1] | x[D.rs2];                   NEXT;
+OP(AND)   x[D.rd] = x[D.rs1] & x[D.rs2];                   NEXT;
+
+// ─── M extension ────────────────────────────────────────────────────────────
+#if RV32_ISA & RV32_EXT_M
+OP(MUL)    x[D.rd] = (int64_t)(int32_t)x[D.rs1] * (int32_t)x[D.rs2];                    NEXT;
+OP(MULH)   x[D.rd] = ((int64_t)(int32_t)x[D.rs1] * (int32_t)x[D.rs2]) >> 32;            NEXT;
+OP(MULHSU) x[D.rd] = (int64_t)((int64_t)(int32_t)x[D.rs1] * (uint64_t)x[D.rs2]) >> 32; NEXT;
+OP(MULHU)  x[D.rd] = ((uint64_t)x[D.rs1] * x[D.rs2]) >> 32;                             NEXT;
+OP(DIV) {
+  int32_t a = x[D.rs1], b = x[D.rs2];
+  x[D.rd] = b ? (b == -1 ? uint32_t(-(int64_t)a) : a / b) : -1;  // INT_MIN / -1 overflows to INT_MIN
+} NEXT;
+OP(DIVU)  x[D.rd] = x[D.rs2] ? x[D.rs1] / x[D.rs2] : UINT_MAX;  NEXT;
+OP(REM) {
+  int32_t a = x[D.rs1], b = x[D.rs2];
+  x[D.rd] = b ? (b == -1 ? 0 : a % b) : a;
+} NEXT;
+OP(REMU)  x[D.rd] = x[D.rs2] ? x[D.rs1] % x[D.rs2] : x[D.rs1];  NEXT;
+#endif
+
+// ─── System ─────────────────────────────────────────────────────────────────
+OP(NOP)    NEXT;
+OP(FENCE)  NEXT;
+// Stores already drop the decoded copies of the words they hit, and blocks
+// end here, so the block overlapping patched code is gone before the next one
+OP(FENCE_I) fence_i(); NEXT;
+OP(ECALL)   handle_syscall(); if (exit_reason) STOP; NEXT;
+OP(EBREAK)  if (!semihost_call(PC)) exit_reason = EXIT_EBREAK; if (exit_reason) STOP; NEXT;
+OP(ILLEGAL) exit_reason = EXIT_ILLEGAL; STOP;
+
+OP(CSRRW)  exec_csr(D, x[D.rs1], 1); NEXT;
+OP(CSRRS)  exec_csr(D, x[D.rs1], 2); NEXT;
+OP(CSRRC)  exec_csr(D, x[D.rs1], 3); NEXT;
+OP(CSRRWI) exec_csr(D, D.rs1, 1);    NEXT;
+OP(CSRRSI) exec_csr(D, D.rs1, 2);    NEXT;
+OP(CSRRCI) exec_csr(D, D.rs1, 3);    NEXT;
+
+// ─── A extension (atomics) ──────────────────────────────────────────────────
+#if RV32_ISA & RV32_EXT_A
+OP(LR) {
+  uint32_t addr = x[D.rs1];
+  uint32_t* p = atomic_word(addr);
+  if (reservations && p) reservation_seq = reservations->reserve(addr);   // before the load
+  uint32_t v = p ? __atomic_load_n(p, __ATOMIC_SEQ_CST) : fetch32(addr);
+  if (D.rd) x[D.rd] = v;
+  has_reservation = true;
+  reservation_addr = addr;
+  reservation_value = v;
+} NEXT;
+OP(SC) {
+  bool ok = store_conditional(x[D.rs1], x[D.rs2]);
+  if (D.rd) x[D.rd] = ok ? 0 : 1;
+} NEXT;
+OP(AMOADD)  exec_amo(D, [](uint32_t a, uint32_t b) { return a + b; }); NEXT;
+OP(AMOSWAP) exec_amo(D, [](uint32_t, uint32_t b) { return b; }); NEXT;
+OP(AMOXOR)  exec_amo(D, [](uint32_t a, uint32_t b) { return a ^ b; }); NEXT;
+OP(AMOOR)   exec_amo(D, [](uint32_t a, uint32_t b) { return a | b; }); NEXT;
+OP(AMOAND)  exec_amo(D, [](uint32_t a, uint32_t b) { return a & b; }); NEXT;
+OP(AMOMIN)  exec_amo(D, [](uint32_t a, uint32_t b) { return (int32_t)a < (int32_t)b ? a : b; }); NEXT;
+OP(AMOMAX)  exec_amo(D, [](uint32_t a, uint32_t b) { return (int32_t)a > (int32_t)b ? a : b; }); NEXT;
+OP(AMOMINU) exec_amo(D, [](uint32_t a, uint32_t b) { return a < b ? a : b; }); NEXT;
+OP(AMOMAXU) exec_amo(D, [](uint32_t a, uint32_t b) { return a > b ? a : b; }); NEXT;
+#endif
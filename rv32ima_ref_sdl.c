@@ -7,8 +7,13 @@
 #include <string.h>
 #include <math.h>
 #include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/mman.h>
 
 #ifdef __APPLE__
 #include <SDL2/SDL.h>
@@ -21,6 +26,8 @@
 // Configuration
 uint32_t ram_amt = 64*1024*1024;
 int fail_on_all_faults = 0;
+int semihosting = 0;
+static int exit_code = 0;
 
 // SDL Graphics configuration
 #define FB_WIDTH  640
@@ -28,6 +35,20 @@ int fail_on_all_faults = 0;
 #define FB_BASE   0x11100000
 #define FB_SIZE   (FB_WIDTH * FB_HEIGHT * 4)
 
+// Control space decoded by HandleControlStore/Load
+#define CONTROL_BASE       0x10000000
+#define CONTROL_SIZE       0x02000000
+#define CONTROL_PAGE_SHIFT 12
+#define CONTROL_PAGE_MASK  ((1u << CONTROL_PAGE_SHIFT) - 1)
+
+struct Device {
+    const char * name;
+    uint32_t base, size;
+    uint32_t (*load)( uint32_t offset );
+    uint32_t (*store)( uint32_t offset, uint32_t val );  // nonzero stops the core
+};
+static const struct Device * device_pages[CONTROL_SIZE >> CONTROL_PAGE_SHIFT];
+
 // SDL objects
 static SDL_Window *window = NULL;
 static SDL_Renderer *renderer = NULL;
@@ -42,8 +63,12 @@ static uint64_t GetTimeMicroseconds();
 static void ResetKeyboardInput();
 static void CaptureKeyboardInput();
 static uint32_t HandleException( uint32_t ir, uint32_t retval );
+static int IsSemihostCall( uint32_t pc );
+static int HandleSemihost();
 static uint32_t HandleControlStore( uint32_t addy, uint32_t val );
 static uint32_t HandleControlLoad( uint32_t addy );
+static void RegisterDevices();
+static int LoadElf( FILE * f, long flen, uint32_t * entry );
 static void HandleOtherCSRWrite( uint8_t * image, uint16_t csrno, uint32_t value );
 static int32_t HandleOtherCSRRead( uint8_t * image, uint16_t csrno );
 static void MiniSleep();
@@ -55,7 +80,11 @@ static int ReadKBByte();
 #define MINIRV32_DECORATE  static
 #define MINI_RV32_RAM_SIZE ram_amt
 #define MINIRV32_IMPLEMENTATION
-#define MINIRV32_POSTEXEC( pc, ir, retval ) { if( retval > 0 ) { if( fail_on_all_faults ) { printf( "FAULT\n" ); return 3; } else retval = HandleException( ir, retval ); } }
+// A semihosting EBREAK (trap 3+1) is served and stepped over; the guest's
+// exit stops the core like the power-off register
+#define MINIRV32_POSTEXEC( pc, ir, retval ) { if( retval > 0 ) { \
+    if( retval == 3 + 1 && semihosting && IsSemihostCall( pc ) ) { if( HandleSemihost() ) return 0x1234; retval = 0; pc += 4; } \
+    else if( fail_on_all_faults ) { printf( "FAULT\n" ); return 3; } else retval = HandleException( ir, retval ); } }
 #define MINIRV32_HANDLE_MEM_STORE_CONTROL( addy, val ) if( HandleControlStore( addy, val ) ) return val;
 #define MINIRV32_HANDLE_MEM_LOAD_CONTROL( addy, rval ) rval = HandleControlLoad( addy );
 #define MINIRV32_OTHERCSR_WRITE( csrno, value ) HandleOtherCSRWrite( image, csrno, value );
@@ -145,7 +174,9 @@ int main( int argc, char ** argv )
     int enable_printf = 1;
     int disable_sdl = 0;
     int single_step = 0;
+    int huge_pages = 0;
     int dtb_ptr = 0;
+    uint32_t entry = MINIRV32_RAM_IMAGE_OFFSET;
     const char * image_file_name = 0;
     const char * dtb_file_name = 0;
     
@@ -168,6 +199,8 @@ int main( int argc, char ** argv )
                 case 'd': param_continue = 1; fail_on_all_faults = 1; break;
                 case 't': time_divisor = SimpleReadNumberInt( argv[++i], 1 ); break;
                 case 'n': disable_sdl = 1; break;  // Option to disable SDL
+                case 'H': param_continue = 1; huge_pages = 1; break;
+                case 'S': param_continue = 1; semihosting = 1; break;
                 default:
                     if( param_continue )
                         continue;
@@ -198,9 +231,13 @@ int main( int argc, char ** argv )
         fprintf( stderr, "  -p                      disable printf\n" );
         fprintf( stderr, "  -d                      fail on all faults\n" );
         fprintf( stderr, "  -n                      disable SDL (console only)\n" );
+        fprintf( stderr, "  -H                      back RAM with transparent huge pages\n" );
+        fprintf( stderr, "  -S                      serve RISC-V semihosting calls (host files)\n" );
         return 1;
     }
 
+    RegisterDevices();
+
     // Initialize SDL if not disabled
     if (!disable_sdl) {
         if (InitSDL() < 0) {
@@ -209,13 +246,18 @@ int main( int argc, char ** argv )
         }
     }
 
-    ram_image = malloc( ram_amt );
-    if( !ram_image )
+    // Anonymous memory comes zero-filled page by page as the guest touches
+    // it, so only the RAM actually used is ever resident
+    ram_image = mmap( 0, ram_amt, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0 );
+    if( ram_image == MAP_FAILED )
     {
         fprintf( stderr, "Error: could not allocate system image.\n" );
         return -4;
     }
-    memset( ram_image, 0, ram_amt );
+#ifdef MADV_HUGEPAGE
+    if( huge_pages )
+        madvise( ram_image, ram_amt, MADV_HUGEPAGE );
+#endif
 
     // Load the image
     FILE * f = fopen( image_file_name, "rb" );
@@ -227,16 +269,38 @@ int main( int argc, char ** argv )
     fseek( f, 0, SEEK_END );
     long flen = ftell( f );
     fseek( f, 0, SEEK_SET );
-    if( flen > ram_amt )
+
+    // ELF executables are placed by their program headers and start at their
+    // entry point; anything else is a flat image at the start of RAM
+    char magic[4] = { 0 };
+    if( fread( magic, 1, 4, f ) == 4 && memcmp( magic, "\177ELF", 4 ) == 0 )
     {
-        fprintf( stderr, "Error: Could not fit RAM image (%ld bytes) into %d\n", flen, ram_amt );
-        return -6;
+        if( LoadElf( f, flen, &entry ) )
+        {
+            fprintf( stderr, "Error: Could not load ELF image.\n" );
+            return -7;
+        }
     }
-    
-    if( fread( ram_image, flen, 1, f ) != 1 )
+    else
     {
-        fprintf( stderr, "Error: Could not load image.\n" );
-        return -7;
+        if( flen > ram_amt )
+        {
+            fprintf( stderr, "Error: Could not fit RAM image (%ld bytes) into %d\n", flen, ram_amt );
+            return -6;
+        }
+
+        // Map the whole pages of the image copy-on-write over the start of RAM, so
+        // instances running the same image share them until the guest writes;
+        // the partial page at the end is read
+        long mapped = flen & ~4095L;
+        if( mapped && mmap( ram_image, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fileno( f ), 0 ) == MAP_FAILED )
+            mapped = 0;
+        fseek( f, mapped, SEEK_SET );
+        if( flen > mapped && fread( ram_image + mapped, flen - mapped, 1, f ) != 1 )
+        {
+            fprintf( stderr, "Error: Could not load image.\n" );
+            return -7;
+        }
     }
     fclose( f );
     
@@ -278,7 +342,7 @@ int main( int argc, char ** argv )
 
     // Initialize core
     core = (struct MiniRV32IMAState *)calloc( sizeof( struct MiniRV32IMAState ), 1 );
-    core->pc = MINIRV32_RAM_IMAGE_OFFSET;
+    core->pc = entry;
     core->regs[10] = 0x00;
     core->regs[11] = dtb_ptr ? (dtb_ptr + MINIRV32_RAM_IMAGE_OFFSET) : 0;
     core->extraflags |= 3;
@@ -328,7 +392,7 @@ int main( int argc, char ** argv )
                 core->cycleh = 0;
                 core->timerl = 0;
                 core->timerh = 0;
-                core->pc = MINIRV32_RAM_IMAGE_OFFSET;
+                core->pc = entry;
                 core->regs[10] = 0x00;
                 core->regs[11] = dtb_ptr ? (dtb_ptr + MINIRV32_RAM_IMAGE_OFFSET) : 0;
                 core->extraflags |= 3;
@@ -360,94 +424,369 @@ int main( int argc, char ** argv )
         CleanupSDL();
     }
     
-    free( ram_image );
+    munmap( ram_image, ram_amt );
     free( core );
-    return 0;
+    return exit_code;
 }
 
 // ============= Support Functions =============
 
+// Places the PT_LOAD segments of an ELF32 RISC-V executable in RAM at their
+// load address, and at their run address too when that differs (.data that
+// start.S copies from ROM), zeroes .bss and returns the entry point.  Every
+// byte must land in RAM.
+static int LoadElf( FILE * f, long flen, uint32_t * entry )
+{
+    uint8_t eh[52];
+    uint8_t ph[32];
+    int i;
+    if( fseek( f, 0, SEEK_SET ) || fread( eh, sizeof( eh ), 1, f ) != 1 )
+        return -1;
+#define LE16( p ) ( (uint32_t)(p)[0] | (uint32_t)(p)[1] << 8 )
+#define LE32( p ) ( LE16( p ) | LE16( (p) + 2 ) << 16 )
+    if( eh[4] != 1 || eh[5] != 1 || LE16( eh + 16 ) != 2 || LE16( eh + 18 ) != 243 )
+    {
+        fprintf( stderr, "Error: not a 32-bit RISC-V executable\n" );
+        return -1;
+    }
+    uint32_t phoff = LE32( eh + 28 ), phentsize = LE16( eh + 42 ), phnum = LE16( eh + 44 );
+    for( i = 0; i < (int)phnum; i++ )
+    {
+        if( fseek( f, phoff + i * phentsize, SEEK_SET ) || fread( ph, sizeof( ph ), 1, f ) != 1 )
+            return -1;
+        uint32_t offset = LE32( ph + 4 ), vaddr = LE32( ph + 8 ), paddr = LE32( ph + 12 );
+        uint32_t filesz = LE32( ph + 16 ), memsz = LE32( ph + 20 );
+        if( LE32( ph ) != 1 || memsz == 0 )
+            continue;
+        uint32_t load = paddr - MINIRV32_RAM_IMAGE_OFFSET, run = vaddr - MINIRV32_RAM_IMAGE_OFFSET;
+        if( filesz > memsz || (long)offset + filesz > flen || load > ram_amt || filesz > ram_amt - load ||
+            run > ram_amt || memsz > ram_amt - run )
+        {
+            fprintf( stderr, "Error: ELF segment at 0x%08x does not fit in RAM\n", vaddr );
+            return -1;
+        }
+        if( filesz && ( fseek( f, offset, SEEK_SET ) || fread( ram_image + load, filesz, 1, f ) != 1 ) )
+            return -1;
+        if( run != load )
+            memcpy( ram_image + run, ram_image + load, filesz );
+        // .bss; RAM starts out zero, so only bytes that are not get written and
+        // untouched pages stay unallocated
+        uint32_t a;
+        for( a = run + filesz; a < run + memsz; a++ )
+            if( ram_image[a] )
+                ram_image[a] = 0;
+    }
+    *entry = LE32( eh + 24 );
+#undef LE16
+#undef LE32
+    return 0;
+}
+
 static uint32_t HandleException( uint32_t ir, uint32_t code )
 {
     // Just move on
     return 0;
 }
 
-static uint32_t HandleControlStore( uint32_t addy, uint32_t val )
+// RISC-V semihosting (-S), as rv32ima --semihosting serves it (semihosting.h):
+// an EBREAK between slli x0, x0, 0x1f and srai x0, x0, 7 calls the host with
+// the operation in a0 and its argument in a1, and gets the result in a0.
+// Files are host files relative to the working directory, ":tt" is the
+// console; SYS_READ reads straight into guest RAM.
+#define SH_MAX_FILES 32
+
+static int sh_files[SH_MAX_FILES] = { 0, 1, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 };
+static int32_t sh_errno = 0;
+static uint64_t sh_start = 0;
+
+// Host address of guest [addr, addr + len) if it lies in RAM, else 0
+static uint8_t * GuestRange( uint32_t addr, uint32_t len )
 {
-    // Framebuffer writes
-    if( sdl_initialized && addy >= FB_BASE && addy < FB_BASE + FB_SIZE )
-    {
-        uint32_t offset = (addy - FB_BASE) / 4;
-        if( offset < FB_WIDTH * FB_HEIGHT )
-        {
-            framebuffer[offset] = val;
-        }
+    uint32_t ofs = addr - MINIRV32_RAM_IMAGE_OFFSET;
+    if( ofs >= ram_amt || len > ram_amt - ofs )
         return 0;
-    }
-    
-    // UART output
-    if( addy == 0x10000000 )
+    return ram_image + ofs;
+}
+
+static uint32_t GuestWord( uint32_t addr )
+{
+    uint8_t * p = GuestRange( addr, 4 );
+    uint32_t w = 0;
+    if( p )
+        memcpy( &w, p, 4 );
+    return w;
+}
+
+static int IsSemihostCall( uint32_t pc )
+{
+    return ( pc & 0xfff ) >= 4 && ( pc & 0xfff ) <= 0xff8 && GuestWord( pc - 4 ) == 0x01f01013 &&
+           GuestWord( pc ) == 0x00100073 && GuestWord( pc + 4 ) == 0x40705013;
+}
+
+static int SemihostFile( uint32_t handle )
+{
+    return handle < SH_MAX_FILES ? sh_files[handle] : -1;
+}
+
+static int32_t SemihostFail( int err )
+{
+    sh_errno = err;
+    return -1;
+}
+
+// Console output goes through stdio, in order with the UART's putchar
+static int32_t SemihostWrite( uint32_t handle, uint32_t buf, uint32_t len )
+{
+    int fd = SemihostFile( handle );
+    uint8_t * p = GuestRange( buf, len );
+    if( fd < 0 || !p )
     {
-        putchar( val );
-        fflush( stdout );
+        SemihostFail( fd < 0 ? EBADF : EFAULT );
+        return len;
     }
-    else if( addy == 0x11004004 )
+    if( fd == 1 || fd == 2 )
     {
-        // Timer match
-        core->timermatchh = val;
+        fwrite( p, 1, len, fd == 1 ? stdout : stderr );
+        fflush( fd == 1 ? stdout : stderr );
+        return 0;
     }
-    else if( addy == 0x11004000 )
+    ssize_t done = write( fd, p, len );
+    if( done < 0 )
     {
-        // Timer match low
-        core->timermatchl = val;
+        SemihostFail( errno );
+        return len;
     }
-    else if( addy == 0x11100000 )
+    return len - done;
+}
+
+static int32_t SemihostOpen( uint32_t name, uint32_t mode, uint32_t len )
+{
+    static const int access[] = { O_RDONLY, O_WRONLY | O_CREAT | O_TRUNC, O_WRONLY | O_CREAT | O_APPEND };
+    char path[PATH_MAX];
+    uint8_t * p = GuestRange( name, len );
+    int fd, flags;
+    uint32_t handle;
+    if( mode > 11 )
+        return SemihostFail( EINVAL );
+    if( len >= PATH_MAX )
+        return SemihostFail( ENAMETOOLONG );
+    if( !p )
+        return SemihostFail( EFAULT );
+    memcpy( path, p, len );
+    path[len] = 0;
+
+    // Mode 0-11 is fopen's "r", "rb", "r+", "r+b", "w", "wb", "w+", "w+b",
+    // "a", "ab", "a+", "a+b"
+    if( strcmp( path, ":tt" ) == 0 )
+        fd = mode < 4 ? 0 : mode < 8 ? 1 : 2;
+    else
     {
-        // Power off
-        if( val == 0x5555 )
-        {
-            return 0x1234;
-        }
+        flags = access[mode / 4];
+        if( mode & 2 )
+            flags = ( flags & ~O_WRONLY ) | O_RDWR;
+        fd = open( path, flags | O_CLOEXEC, 0666 );
+        if( fd < 0 )
+            return SemihostFail( errno );
+    }
+    for( handle = 0; handle < SH_MAX_FILES && sh_files[handle] >= 0; handle++ );
+    if( handle == SH_MAX_FILES )
+    {
+        if( fd > 2 )
+            close( fd );
+        return SemihostFail( EMFILE );
     }
-    return 0;
+    sh_files[handle] = fd;
+    return handle;
 }
 
-static uint32_t HandleControlLoad( uint32_t addy )
+// Serves the call in a0/a1; nonzero if the guest exited (status in exit_code)
+static int HandleSemihost()
 {
-    // Framebuffer reads
-    if( sdl_initialized && addy >= FB_BASE && addy < FB_BASE + FB_SIZE )
+    uint32_t * x = core->regs;
+    uint32_t a1 = x[11];
+    uint32_t arg0 = GuestWord( a1 ), arg1 = GuestWord( a1 + 4 ), arg2 = GuestWord( a1 + 8 );
+    int32_t r = -1;
+    int fd;
+    struct stat st;
+    if( !sh_start )
+        sh_start = GetTimeMicroseconds();
+    switch( x[10] )
     {
-        uint32_t offset = (addy - FB_BASE) / 4;
-        if( offset < FB_WIDTH * FB_HEIGHT )
+    case 0x01: r = SemihostOpen( arg0, arg1, arg2 ); break;
+    case 0x02:  // SYS_CLOSE
+        if( ( fd = SemihostFile( arg0 ) ) < 0 )
+            r = SemihostFail( EBADF );
+        else
         {
-            return framebuffer[offset];
+            if( fd > 2 )
+                close( fd );
+            sh_files[arg0] = -1;
+            r = 0;
         }
-        return 0;
+        break;
+    case 0x03: r = SemihostWrite( 1, a1, 1 ) ? -1 : 0; break;  // SYS_WRITEC
+    case 0x04:  // SYS_WRITE0
+    {
+        uint8_t * p = GuestRange( a1, 1 );
+        uint8_t * nul = p ? memchr( p, 0, ram_image + ram_amt - p ) : 0;
+        if( nul )
+            SemihostWrite( 1, a1, nul - p );
+        r = 0;
+        break;
+    }
+    case 0x05: r = SemihostWrite( arg0, arg1, arg2 ); break;
+    case 0x06:  // SYS_READ: returns the number of bytes not read
+    {
+        uint8_t * p = GuestRange( arg1, arg2 );
+        ssize_t got;
+        if( ( fd = SemihostFile( arg0 ) ) < 0 || !p )
+            r = SemihostFail( fd < 0 ? EBADF : EFAULT );
+        else if( ( got = read( fd, p, arg2 ) ) < 0 )
+            r = SemihostFail( errno );
+        else
+            r = arg2 - got;
+        break;
     }
-    
-    // UART/Keyboard input
-    if( addy == 0x10000000 )
+    case 0x07:  // SYS_READC
+    {
+        uint8_t c;
+        r = read( 0, &c, 1 ) == 1 ? c : -1;
+        break;
+    }
+    case 0x08: r = (int32_t)arg0 < 0; break;  // SYS_ISERROR
+    case 0x09: r = ( fd = SemihostFile( arg0 ) ) < 0 ? SemihostFail( EBADF ) : isatty( fd ); break;
+    case 0x0a:  // SYS_SEEK
+        if( ( fd = SemihostFile( arg0 ) ) < 0 )
+            r = SemihostFail( EBADF );
+        else
+            r = lseek( fd, arg1, SEEK_SET ) < 0 ? SemihostFail( errno ) : 0;
+        break;
+    case 0x0c:  // SYS_FLEN
+        if( ( fd = SemihostFile( arg0 ) ) < 0 )
+            r = SemihostFail( EBADF );
+        else
+            r = fstat( fd, &st ) ? SemihostFail( errno ) : (int32_t)st.st_size;
+        break;
+    case 0x10: r = ( GetTimeMicroseconds() - sh_start ) / 10000; break;  // SYS_CLOCK: centiseconds
+    case 0x11: r = time( 0 ); break;
+    case 0x13: r = sh_errno; break;
+    case 0x18:  // SYS_EXIT: a1 is the reason
+        exit_code = a1 == 0x20026 ? 0 : 1;
+        return 1;
+    case 0x20:  // SYS_EXIT_EXTENDED: {reason, exit code}
+        exit_code = arg0 == 0x20026 ? arg1 : 1;
+        return 1;
+    case 0x30:  // SYS_ELAPSED: 64-bit microsecond count into the block
+    {
+        uint64_t t = GetTimeMicroseconds() - sh_start;
+        uint8_t * p = GuestRange( a1, 8 );
+        if( p )
+            memcpy( p, &t, 8 );
+        r = p ? 0 : -1;
+        break;
+    }
+    case 0x31: r = 1000000; break;  // SYS_TICKFREQ
+    }
+    x[10] = r;
+    return 0;
+}
+
+// Control-space devices.  mini-rv32ima passes every access to
+// 0x10000000-0x11ffffff to HandleControlStore/Load, which find the device in a
+// table with one entry per 4 KiB page; devices see offsets into their region.
+
+static uint32_t UARTLoad( uint32_t offset )
+{
+    if( offset == 0 )
     {
         if( IsKBHit() )
-        {
             return 0x100 | ReadKBByte();
-        }
         return 0;
     }
-    else if( addy == 0x10000005 )
-    {
+    if( offset == 5 )
         return 0x60;
+    return 0;
+}
+
+static uint32_t UARTStore( uint32_t offset, uint32_t val )
+{
+    if( offset == 0 )
+    {
+        putchar( val );
+        fflush( stdout );
     }
-    else if( addy >= 0x11000000 && addy < 0x11001000 )
+    return 0;
+}
+
+// CLINT: mtimecmp at +0x4000, mtime at +0xbff8
+static uint32_t CLINTLoad( uint32_t offset )
+{
+    uint64_t ts = GetTimeMicroseconds();
+    if( offset == 0xbff8 )
+        return ts & 0xffffffff;
+    else if( offset == 0xbffc )
+        return (ts >> 32) & 0xffffffff;
+    return 0;
+}
+
+static uint32_t CLINTStore( uint32_t offset, uint32_t val )
+{
+    if( offset == 0x4000 )
+        core->timermatchl = val;
+    else if( offset == 0x4004 )
+        core->timermatchh = val;
+    return 0;
+}
+
+// Framebuffer with SDL; without it, the syscon power-off register at +0
+static uint32_t FBLoad( uint32_t offset )
+{
+    if( sdl_initialized )
+        return framebuffer[offset / 4];
+    return 0;
+}
+
+static uint32_t FBStore( uint32_t offset, uint32_t val )
+{
+    if( sdl_initialized )
+        framebuffer[offset / 4] = val;
+    else if( offset == 0 && val == 0x5555 )
+        return 0x1234;  // Power off
+    return 0;
+}
+
+static const struct Device devices[] = {
+    { "uart",        0x10000000, 0x100,   UARTLoad,  UARTStore },
+    { "clint",       0x11000000, 0x10000, CLINTLoad, CLINTStore },
+    { "framebuffer", FB_BASE,    FB_SIZE, FBLoad,    FBStore },
+};
+
+static void RegisterDevices()
+{
+    unsigned i;
+    uint32_t a;
+    for( i = 0; i < sizeof( devices ) / sizeof( devices[0] ); i++ )
     {
-        // Timer
-        uint64_t ts = GetTimeMicroseconds();
-        if( addy == 0x1100bff8 )
-            return ts & 0xffffffff;
-        else if( addy == 0x1100bffc )
-            return (ts >> 32) & 0xffffffff;
+        const struct Device * d = &devices[i];
+        for( a = d->base & ~CONTROL_PAGE_MASK; a < d->base + d->size; a += CONTROL_PAGE_MASK + 1 )
+            device_pages[(a - CONTROL_BASE) >> CONTROL_PAGE_SHIFT] = d;
     }
+}
+
+static uint32_t HandleControlStore( uint32_t addy, uint32_t val )
+{
+    const struct Device * d = device_pages[(addy - CONTROL_BASE) >> CONTROL_PAGE_SHIFT];
+    if( d && addy - d->base < d->size )
+        return d->store( addy - d->base, val );
+    return 0;
+}
+
+static uint32_t HandleControlLoad( uint32_t addy )
+{
+    const struct Device * d = device_pages[(addy - CONTROL_BASE) >> CONTROL_PAGE_SHIFT];
+    if( d && addy - d->base < d->size )
+        return d->load( addy - d->base );
     return 0;
 }
 
@@ -0,0 +1,390 @@
+// Binary instruction trace for rv32ima.cc (--trace-file) and rv32trace
+//
+// One record per executed instruction, built on the emulation thread and
+// handed to a writer thread through a lock-free single-producer ring.  The
+// writer packs whatever has accumulated into zlib-compressed chunks, so the
+// emulator only pays for encoding a few bytes per instruction.
+//
+// File layout (little-endian):
+//
+//   TraceFileHeader           initial cycle, pc and registers
+//   { TraceChunk, payload }*  CHUNK_DATA: zlib-compressed records;
+//                             CHUNK_END: TraceEnd, stored as is
+//
+// A chunk always holds whole records.  Each record is relative to the state
+// the previous ones left behind:
+//
+//   u8      flags: bit 0     pc is not the previous pc + 4
+//                  bits 1-2  memory access size: 0 none, 1/2/3 = 1/2/4 bytes
+//                  bits 3-7  number of changed registers
+//   varint  zigzag(pc - (previous pc + 4))          if bit 0
+//   u32     instruction word
+//   { u8 register, varint zigzag(new - old) }       per changed register
+//   varint  zigzag(addr - previous addr), value     if memory access (value is
+//                                                   memory after the access)
+//
+// The last record is the instruction that stopped the run, if any; like the
+// text trace it is shown but did not retire.
+
+#ifndef RV32IMA_TRACE_H
+#define RV32IMA_TRACE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <zlib.h>
+
+// ─── Text format ────────────────────────────────────────────────────────────
+// One --trace entry: the instruction about to run and the registers before
+// it.  Shared with rv32trace so decoded traces match byte for byte.
+inline void print_trace_entry(std::ostream& os, uint64_t cycle, uint32_t pc, uint32_t ins,
+                              const std::string& disasm, const uint32_t* x) {
+  os << "[cycle " << cycle << "] pc=0x" << std::hex << std::setw(8)
+     << std::setfill('0') << pc << " ins=0x" << std::setw(8)
+     << std::setfill('0') << ins << "  " << disasm << "\n";
+
+  // Show registers
+  for (int i = 0; i < 32; i++) {
+    if (i % 8 == 0) os << "x" << std::dec << std::setw(2)
+                       << std::setfill('0') << i << ":";
+    os << "0x" << std::hex << std::setw(8) << std::setfill('0')
+       << x[i] << "  ";
+    if (i % 8 == 7) os << "\n";
+  }
+  os << "\n";
+}
+
+// ─── File structures ────────────────────────────────────────────────────────
+static const char TRACE_MAGIC[8] = {'R', 'V', '3', '2', 'T', 'R', 'C', '1'};
+
+struct TraceFileHeader {
+  char magic[8];
+  uint64_t start_cycle;
+  uint32_t start_pc;
+  uint32_t x[32];
+};
+
+enum TraceChunkType : uint32_t { CHUNK_DATA = 1, CHUNK_END = 2 };
+
+struct TraceChunk {
+  uint32_t type;
+  uint32_t raw_size;      // payload size once decompressed
+  uint32_t packed_size;   // payload size in the file
+};
+
+struct TraceEnd {
+  uint32_t reason;        // ExitReason
+  uint32_t exit_code;
+  uint32_t pc;
+  uint64_t cycles;
+};
+
+static constexpr size_t TRACE_MAX_RECORD = 256;      // 1 + 5 + 4 + 31 * 6 + 5 + 4 rounded up
+static constexpr size_t TRACE_RING_SIZE = 16 << 20;  // power of two
+static constexpr size_t TRACE_CHUNK_MIN = 1 << 20;   // writer waits for this much
+
+// ─── Record encoding ────────────────────────────────────────────────────────
+inline uint8_t* put_varint(uint8_t* p, uint32_t v) {
+  while (v >= 0x80) { *p++ = uint8_t(v) | 0x80; v >>= 7; }
+  *p++ = uint8_t(v);
+  return p;
+}
+
+inline const uint8_t* get_varint(const uint8_t* p, const uint8_t* end, uint32_t& v) {
+  v = 0;
+  for (int shift = 0; p < end && shift < 35; shift += 7) {
+    uint8_t b = *p++;
+    v |= uint32_t(b & 0x7f) << shift;
+    if (!(b & 0x80)) return p;
+  }
+  return nullptr;   // truncated
+}
+
+inline uint32_t zigzag(int32_t v) { return (uint32_t(v) << 1) ^ uint32_t(v >> 31); }
+inline int32_t unzigzag(uint32_t v) { return int32_t(v >> 1) ^ -int32_t(v & 1); }
+
+struct TraceRecord {
+  uint32_t pc, ins;
+  uint32_t n_regs;
+  uint8_t reg[31];
+  uint32_t value[31];     // new register values
+  uint32_t mem_size;      // 0 if the instruction does not access memory
+  uint32_t mem_addr, mem_value;
+};
+
+// Encoder/decoder state: what the records so far have established
+struct TraceState {
+  uint32_t pc = 0;        // previous record's pc
+  uint32_t x[32]{};
+  uint32_t mem_addr = 0;
+
+  void reset(uint32_t start_pc, const uint32_t* regs) {
+    pc = start_pc - 4;    // a first record at start_pc is "sequential"
+    memcpy(x, regs, sizeof(x));
+    mem_addr = 0;
+  }
+
+  // Appends the record for one instruction (x_after: registers once it ran)
+  uint8_t* encode(uint8_t* p, uint32_t at, uint32_t ins, const uint32_t* x_after,
+                  uint32_t mem_size, uint32_t addr, uint32_t value) {
+    uint8_t* flags = p++;
+    uint8_t f = mem_size == 0 ? 0 : mem_size == 1 ? 2 : mem_size == 2 ? 4 : 6;
+    if (at != pc + 4) {
+      f |= 1;
+      p = put_varint(p, zigzag(int32_t(at - (pc + 4))));
+    }
+    pc = at;
+    memcpy(p, &ins, 4);
+    p += 4;
+    uint32_t n = 0;
+    for (int i = 1; i < 32; i++) {
+      if (x_after[i] == x[i]) continue;
+      *p++ = uint8_t(i);
+      p = put_varint(p, zigzag(int32_t(x_after[i] - x[i])));
+      x[i] = x_after[i];
+      n++;
+    }
+    if (mem_size) {
+      p = put_varint(p, zigzag(int32_t(addr - mem_addr)));
+      mem_addr = addr;
+      memcpy(p, &value, mem_size);
+      p += mem_size;
+    }
+    *flags = uint8_t(f | n << 3);
+    return p;
+  }
+
+  // Reads one record; nullptr if it is malformed.  Register values are
+  // relative to x, so each record must be apply()d before the next decode().
+  const uint8_t* decode(const uint8_t* p, const uint8_t* end, TraceRecord& r) {
+    if (p >= end) return nullptr;
+    uint8_t f = *p++;
+    uint32_t v;
+    r.pc = pc + 4;
+    if (f & 1) {
+      if (!(p = get_varint(p, end, v))) return nullptr;
+      r.pc += unzigzag(v);
+    }
+    pc = r.pc;
+    if (end - p < 4) return nullptr;
+    memcpy(&r.ins, p, 4);
+    p += 4;
+    r.n_regs = f >> 3;
+    for (uint32_t i = 0; i < r.n_regs; i++) {
+      if (p >= end) return nullptr;
+      r.reg[i] = *p++ & 31;
+      if (!(p = get_varint(p, end, v))) return nullptr;
+      r.value[i] = x[r.reg[i]] + unzigzag(v);
+    }
+    static const uint32_t sizes[] = {0, 1, 2, 4};
+    r.mem_size = sizes[(f >> 1) & 3];
+    r.mem_addr = r.mem_value = 0;
+    if (r.mem_size) {
+      if (!(p = get_varint(p, end, v))) return nullptr;
+      r.mem_addr = mem_addr += unzigzag(v);
+      if (uint32_t(end - p) < r.mem_size) return nullptr;
+      memcpy(&r.mem_value, p, r.mem_size);
+      p += r.mem_size;
+    }
+    return p;
+  }
+
+  // Commits the register writes of a decoded record; until then x still
+  // shows the state before the instruction
+  void apply(const TraceRecord& r) {
+    for (uint32_t i = 0; i < r.n_regs; i++) x[r.reg[i]] = r.value[i];
+  }
+};
+
+// ─── Ring buffer ────────────────────────────────────────────────────────────
+// Single producer (emulation thread), single consumer (writer thread).  head
+// and tail count bytes ever written and read; each side only stores its own.
+class TraceRing {
+ public:
+  explicit TraceRing(size_t size) : buf_(new uint8_t[size]), mask_(size - 1) {}
+
+  // Producer: waits while the writer is behind by more than the ring
+  void push(const uint8_t* p, size_t n) {
+    uint64_t h = head_.load(std::memory_order_relaxed);
+    while (h + n - tail_cache_ > mask_ + 1) {
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+      if (h + n - tail_cache_ > mask_ + 1) std::this_thread::yield();
+    }
+    size_t at = h & mask_, first = std::min(n, mask_ + 1 - at);
+    memcpy(&buf_[at], p, first);
+    memcpy(&buf_[0], p + first, n - first);
+    head_.store(h + n, std::memory_order_release);
+  }
+
+  // Consumer
+  size_t readable() const {
+    return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_relaxed);
+  }
+  void pop(std::vector<uint8_t>& out, size_t n) {
+    uint64_t t = tail_.load(std::memory_order_relaxed);
+    size_t at = t & mask_, first = std::min(n, mask_ + 1 - at);
+    out.assign(&buf_[at], &buf_[at] + first);
+    out.insert(out.end(), &buf_[0], &buf_[0] + (n - first));
+    tail_.store(t + n, std::memory_order_release);
+  }
+
+ private:
+  std::unique_ptr<uint8_t[]> buf_;
+  size_t mask_;
+  alignas(64) std::atomic<uint64_t> head_{0};
+  uint64_t tail_cache_ = 0;            // producer's view of tail_
+  alignas(64) std::atomic<uint64_t> tail_{0};
+};
+
+// ─── Writer ─────────────────────────────────────────────────────────────────
+class TraceWriter {
+ public:
+  TraceWriter() : ring_(TRACE_RING_SIZE) {}
+  ~TraceWriter() { finish(nullptr); }
+
+  bool open(const char* path, uint64_t cycle, uint32_t pc, const uint32_t* x) {
+    file_ = fopen(path, "wb");
+    if (!file_) return false;
+    TraceFileHeader h;
+    memcpy(h.magic, TRACE_MAGIC, sizeof(h.magic));
+    h.start_cycle = cycle;
+    h.start_pc = pc;
+    memcpy(h.x, x, sizeof(h.x));
+    fwrite(&h, sizeof(h), 1, file_);
+    state_.reset(pc, x);
+    thread_ = std::thread(&TraceWriter::drain, this);
+    return true;
+  }
+
+  // Called on the emulation thread once the instruction at pc has run
+  void record(uint32_t pc, uint32_t ins, const uint32_t* x,
+              uint32_t mem_size, uint32_t mem_addr, uint32_t mem_value) {
+    uint8_t buf[TRACE_MAX_RECORD];
+    uint8_t* end = state_.encode(buf, pc, ins, x, mem_size, mem_addr, mem_value);
+    ring_.push(buf, end - buf);
+  }
+
+  // Drains the ring, appends the CHUNK_END trailer (if given) and closes
+  // the file; false if anything failed to write
+  bool finish(const TraceEnd* end) {
+    if (!file_) return ok_;
+    stop_.store(true, std::memory_order_release);
+    thread_.join();
+    if (end) {
+      TraceChunk c{CHUNK_END, sizeof(*end), sizeof(*end)};
+      ok_ &= fwrite(&c, sizeof(c), 1, file_) == 1 && fwrite(end, sizeof(*end), 1, file_) == 1;
+    }
+    ok_ &= fclose(file_) == 0;
+    file_ = nullptr;
+    return ok_;
+  }
+
+ private:
+  TraceRing ring_;
+  TraceState state_;            // producer side only
+  FILE* file_ = nullptr;
+  std::thread thread_;
+  std::atomic<bool> stop_{false};
+  bool ok_ = true;              // writer thread until joined
+
+  void drain() {
+    std::vector<uint8_t> raw, packed;
+    for (;;) {
+      bool stopping = stop_.load(std::memory_order_acquire);
+      size_t n = ring_.readable();   // only whole records are ever published
+      if (n >= TRACE_CHUNK_MIN || (stopping && n)) {
+        ring_.pop(raw, n);
+        uLongf size = compressBound(raw.size());
+        packed.resize(size);
+        ok_ &= compress2(packed.data(), &size, raw.data(), raw.size(), Z_BEST_SPEED) == Z_OK;
+        TraceChunk c{CHUNK_DATA, uint32_t(raw.size()), uint32_t(size)};
+        ok_ &= fwrite(&c, sizeof(c), 1, file_) == 1 && fwrite(packed.data(), size, 1, file_) == 1;
+        continue;
+      }
+      if (stopping) return;
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+  }
+};
+
+// ─── Reader ─────────────────────────────────────────────────────────────────
+class TraceReader {
+ public:
+  ~TraceReader() { if (file_) fclose(file_); }
+
+  bool open(const char* path) {
+    file_ = fopen(path, "rb");
+    if (!file_) return false;
+    if (fread(&header_, sizeof(header_), 1, file_) != 1 ||
+        memcmp(header_.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0) return false;
+    state_.reset(header_.start_pc, header_.x);
+    return true;
+  }
+
+  const TraceFileHeader& header() const { return header_; }
+  const TraceState& state() const { return state_; }
+  bool has_end() const { return has_end_; }
+  const TraceEnd& end() const { return end_; }
+  bool corrupt() const { return corrupt_; }
+
+  // Next record, without applying it to state(); false at the end of the file
+  bool next(TraceRecord& r) {
+    while (pos_ == raw_.size()) {
+      if (!load_chunk()) return false;
+    }
+    const uint8_t* p = state_.decode(raw_.data() + pos_, raw_.data() + raw_.size(), r);
+    if (!p) {
+      corrupt_ = true;
+      return false;
+    }
+    pos_ = p - raw_.data();
+    return true;
+  }
+
+  void apply(const TraceRecord& r) { state_.apply(r); }
+
+ private:
+  FILE* file_ = nullptr;
+  TraceFileHeader header_{};
+  TraceState state_;
+  std::vector<uint8_t> raw_, packed_;
+  size_t pos_ = 0;
+  TraceEnd end_{};
+  bool has_end_ = false, corrupt_ = false;
+
+  bool load_chunk() {
+    TraceChunk c;
+    if (fread(&c, sizeof(c), 1, file_) != 1) return false;   // ends without a trailer
+    packed_.resize(c.packed_size);
+    if (c.packed_size && fread(packed_.data(), c.packed_size, 1, file_) != 1) {
+      corrupt_ = true;
+      return false;
+    }
+    if (c.type == CHUNK_END) {
+      if (c.packed_size != sizeof(end_)) { corrupt_ = true; return false; }
+      memcpy(&end_, packed_.data(), sizeof(end_));
+      has_end_ = true;
+      return false;
+    }
+    raw_.resize(c.raw_size);
+    uLongf size = c.raw_size;
+    if (c.type != CHUNK_DATA ||
+        uncompress(raw_.data(), &size, packed_.data(), c.packed_size) != Z_OK || size != c.raw_size) {
+      corrupt_ = true;
+      return false;
+    }
+    pos_ = 0;
+    return true;
+  }
+};
+
+#endif // RV32IMA_TRACE_H
@@ -0,0 +1,74 @@
+// Offline decoder for rv32ima binary traces (rv32ima --trace-file=...)
+//
+// Prints the same text as `rv32ima --trace`: for every instruction its
+// address, encoding and disassembly followed by the registers before it ran.
+// --mem adds a line for each memory access.
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include "rv32ima_isa.h"
+#include "rv32ima_trace.h"
+
+// Matches ExitReason in rv32ima.cc
+enum { EXIT_HALT = 1, EXIT_EBREAK, EXIT_ILLEGAL, EXIT_LIMIT };
+
+int main(int argc, char** argv) {
+  const char* usage = " [--mem] trace.rvt\n";
+  bool show_mem = false;
+  const char* path = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--mem")) show_mem = true;
+    else if (!path && argv[i][0] != '-') path = argv[i];
+    else { std::cerr << "usage: " << argv[0] << usage; return 1; }
+  }
+  if (!path) {
+    std::cerr << "usage: " << argv[0] << usage;
+    return 1;
+  }
+
+  TraceReader in;
+  if (!in.open(path)) {
+    std::cerr << "Error: " << path << " is not an rv32ima trace" << std::endl;
+    return 1;
+  }
+
+  uint64_t cycle = in.header().start_cycle;
+  TraceRecord r;
+  uint32_t last_ins = 0;
+  while (in.next(r)) {
+    print_trace_entry(std::cout, cycle++, r.pc, r.ins, disassemble(r.ins), in.state().x);
+    if (show_mem && r.mem_size) {
+      std::cout << "mem[0x" << std::hex << std::setw(8) << std::setfill('0') << r.mem_addr
+                << "] = 0x" << std::setw(r.mem_size * 2) << r.mem_value << "\n";
+    }
+    in.apply(r);
+    last_ins = r.ins;
+  }
+  if (in.corrupt()) {
+    std::cerr << "Error: " << path << " is corrupt after cycle " << std::dec << cycle << std::endl;
+    return 1;
+  }
+  if (!in.has_end()) {
+    std::cerr << "Warning: " << path << " ends without a trailer (emulator killed?)" << std::endl;
+    return 0;
+  }
+
+  const TraceEnd& end = in.end();
+  switch (end.reason) {
+    case EXIT_HALT:
+      std::cout << "Program exited with code " << std::dec << end.exit_code << std::endl;
+      break;
+    case EXIT_EBREAK:
+      std::cerr << "EBREAK at PC " << std::hex << end.pc << std::endl;
+      break;
+    case EXIT_ILLEGAL:
+      std::cerr << "Unhandled opcode " << std::hex << (last_ins & 0x7f) << " at PC " << end.pc << std::endl;
+      break;
+    case EXIT_LIMIT:
+      std::cerr << "Stopped after " << std::dec << end.cycles - in.header().start_cycle
+                << " instructions at PC 0x" << std::hex << end.pc << std::endl;
+      break;
+  }
+  return 0;
+}
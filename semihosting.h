@@ -0,0 +1,252 @@
+// RISC-V semihosting for rv32ima --semihosting and rv32ima_sdl --semihosting
+//
+// A guest calls the host with the standard sequence, uncompressed and within
+// one page:
+//
+//   slli x0, x0, 0x1f
+//   ebreak              a0 = operation, a1 = argument or parameter block
+//   srai x0, x0, 7      a0 = result
+//
+// The CPU recognizes it at the EBREAK (CPU::semihost_call) and hands the
+// call to Semihost::call(); any other EBREAK still stops the run.  The
+// operations are the Arm semihosting ones, with 32-bit fields: open, close,
+// read, write, seek, flen, istty, writec, write0, readc, errno, clock, time,
+// elapsed, tickfreq, exit and exit_extended.
+//
+// Files are host files, named relative to the emulator's working directory;
+// ":tt" is the console.  Reads go straight from the file into guest memory
+// (one preadv(2) over the buffer's host spans, see the bus's span()), so a
+// program can read large data files on demand instead of linking them in.
+
+#ifndef SEMIHOSTING_H
+#define SEMIHOSTING_H
+
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// Instructions around the EBREAK of a semihosting call
+static constexpr uint32_t SEMIHOST_ENTRY = 0x01f01013;   // slli x0, x0, 0x1f
+static constexpr uint32_t SEMIHOST_EXIT  = 0x40705013;   // srai x0, x0, 7
+
+class Semihost {
+public:
+  Semihost() : files{{0, 0, false}, {1, 0, false}, {2, 0, false}}, start(std::chrono::steady_clock::now()) {}
+
+  ~Semihost() {
+    for (const File& f : files)
+      if (f.fd > 2) close(f.fd);
+  }
+
+  Semihost(const Semihost&) = delete;
+  Semihost& operator=(const Semihost&) = delete;
+
+  // Serves the call with operation a0 and argument a1; false if the program
+  // exited (SYS_EXIT, SYS_EXIT_EXTENDED), with its status in a0
+  template <class Cpu>
+  bool call(Cpu& cpu) {
+    uint32_t* x = cpu.x;
+    uint32_t a1 = x[11];
+    auto arg = [&](int i) { return cpu.fetch32(a1 + 4 * i); };
+    int32_t r;
+    switch (x[10]) {
+      case 0x01: r = sys_open(cpu, arg(0), arg(1), arg(2)); break;
+      case 0x02: r = sys_close(arg(0)); break;
+      case 0x03: r = sys_write(cpu, 1, a1, 1) ? -1 : 0; break;   // SYS_WRITEC
+      case 0x04: r = sys_write0(cpu, a1); break;
+      case 0x05: r = sys_write(cpu, arg(0), arg(1), arg(2)); break;
+      case 0x06: r = sys_read(cpu, arg(0), arg(1), arg(2)); break;
+      case 0x07: {   // SYS_READC
+        uint8_t c;
+        r = read(0, &c, 1) == 1 ? c : -1;
+        break;
+      }
+      case 0x08: r = int32_t(arg(0)) < 0; break;   // SYS_ISERROR
+      case 0x09: r = file(arg(0)) ? isatty(file(arg(0))->fd) : -1; break;
+      case 0x0a: r = sys_seek(arg(0), arg(1)); break;
+      case 0x0c: r = sys_flen(arg(0)); break;
+      case 0x10: r = int32_t(elapsed_us() / 10000); break;   // SYS_CLOCK: centiseconds
+      case 0x11: r = int32_t(time(nullptr)); break;
+      case 0x13: r = last_errno; break;
+      case 0x18:   // SYS_EXIT: a1 is the reason
+        x[10] = a1 == ADP_STOPPED_APPLICATION_EXIT ? 0 : 1;
+        return false;
+      case 0x20:   // SYS_EXIT_EXTENDED: {reason, exit code}
+        x[10] = arg(0) == ADP_STOPPED_APPLICATION_EXIT ? arg(1) : 1;
+        return false;
+      case 0x30: {   // SYS_ELAPSED: 64-bit tick count into the block
+        uint64_t t = elapsed_us();
+        cpu.store32(a1, uint32_t(t));
+        cpu.store32(a1 + 4, uint32_t(t >> 32));
+        r = 0;
+        break;
+      }
+      case 0x31: r = 1000000; break;   // SYS_TICKFREQ: SYS_ELAPSED counts microseconds
+      default:   r = -1; break;        // command line, heap info, remove, rename, system
+    }
+    x[10] = uint32_t(r);
+    return true;
+  }
+
+private:
+  static constexpr uint32_t ADP_STOPPED_APPLICATION_EXIT = 0x20026;
+  static constexpr int MAX_SPANS = 16;
+
+  struct File {
+    int fd;          // host descriptor, -1 if the handle is free
+    uint64_t pos;    // file position of regular files
+    bool seekable;   // regular file: read and written at pos
+  };
+  std::vector<File> files;   // handle -> file; 0-2 are the console
+  int32_t last_errno = 0;
+  std::chrono::steady_clock::time_point start;
+
+  uint64_t elapsed_us() const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  File* file(uint32_t handle) {
+    return handle < files.size() && files[handle].fd >= 0 ? &files[handle] : nullptr;
+  }
+
+  int32_t fail() {
+    last_errno = errno;
+    return -1;
+  }
+
+  // Mode 0-11 is fopen's "r", "rb", "r+", "r+b", "w", "wb", "w+", "w+b",
+  // "a", "ab", "a+", "a+b"
+  template <class Cpu>
+  int32_t sys_open(Cpu& cpu, uint32_t name, uint32_t mode, uint32_t len) {
+    if (mode > 11 || len >= PATH_MAX) {
+      last_errno = mode > 11 ? EINVAL : ENAMETOOLONG;
+      return -1;
+    }
+    std::string path;
+    struct iovec iov[MAX_SPANS];
+    int n = cpu.guest_iov(name, len, iov, MAX_SPANS);
+    for (int i = 0; i < n; i++) path.append(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+    if (path.size() != len) {   // the name is not all in guest RAM
+      last_errno = EFAULT;
+      return -1;
+    }
+
+    int fd;
+    if (path == ":tt") {
+      fd = mode < 4 ? 0 : mode < 8 ? 1 : 2;
+    } else {
+      static const int access[] = {O_RDONLY, O_WRONLY | O_CREAT | O_TRUNC, O_WRONLY | O_CREAT | O_APPEND};
+      int flags = access[mode / 4];
+      if (mode & 2) flags = (flags & ~O_WRONLY) | O_RDWR;
+      if ((fd = open(path.c_str(), flags | O_CLOEXEC, 0666)) < 0) return fail();
+    }
+    struct stat st;
+    File f{fd, 0, fd > 2 && !fstat(fd, &st) && S_ISREG(st.st_mode)};
+    if (f.seekable && mode >= 8) f.pos = st.st_size;
+    uint32_t handle = 0;
+    while (handle < files.size() && files[handle].fd >= 0) handle++;
+    if (handle == files.size()) files.push_back(f);
+    else files[handle] = f;
+    return handle;
+  }
+
+  int32_t sys_close(uint32_t handle) {
+    File* f = file(handle);
+    if (!f) {
+      last_errno = EBADF;
+      return -1;
+    }
+    if (f->fd > 2) close(f->fd);
+    f->fd = -1;
+    return 0;
+  }
+
+  // Returns the number of bytes not read (len at end of file)
+  template <class Cpu>
+  int32_t sys_read(Cpu& cpu, uint32_t handle, uint32_t buf, uint32_t len) {
+    File* f = file(handle);
+    if (!f) {
+      last_errno = EBADF;
+      return -1;
+    }
+    struct iovec iov[MAX_SPANS];
+    int n = cpu.guest_iov(buf, len, iov, MAX_SPANS);
+    ssize_t got = f->seekable ? preadv(f->fd, iov, n, f->pos) : readv(f->fd, iov, n);
+    if (got < 0) return fail();
+    if (f->seekable) f->pos += got;
+    cpu.code_changed(buf, got);
+    return len - got;
+  }
+
+  // Returns the number of bytes not written
+  template <class Cpu>
+  int32_t sys_write(Cpu& cpu, uint32_t handle, uint32_t buf, uint32_t len) {
+    File* f = file(handle);
+    if (!f) {
+      last_errno = EBADF;
+      return len;
+    }
+    struct iovec iov[MAX_SPANS];
+    int n = cpu.guest_iov(buf, len, iov, MAX_SPANS);
+    if (cpu.console && (f->fd == 1 || f->fd == 2)) {
+      size_t done = 0;
+      for (int i = 0; i < n; i++) cpu.console->append(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len), done += iov[i].iov_len;
+      return len - done;
+    }
+    ssize_t done = f->seekable ? pwritev(f->fd, iov, n, f->pos) : writev(f->fd, iov, n);
+    if (done < 0) {
+      fail();
+      return len;
+    }
+    if (f->seekable) f->pos += done;
+    return len - done;
+  }
+
+  // SYS_WRITE0: the NUL-terminated string at addr to the console
+  template <class Cpu>
+  int32_t sys_write0(Cpu& cpu, uint32_t addr) {
+    uint32_t len = 0;
+    for (uint32_t part = 4096; part == 4096; len += part) {
+      uint8_t* p = cpu.mem.span(addr + len, part);
+      if (!p) break;
+      if (const void* nul = memchr(p, 0, part)) {
+        len += static_cast<const uint8_t*>(nul) - p;
+        break;
+      }
+    }
+    sys_write(cpu, 1, addr, len);
+    return 0;
+  }
+
+  int32_t sys_seek(uint32_t handle, uint32_t pos) {
+    File* f = file(handle);
+    if (!f || !f->seekable) {
+      last_errno = f ? ESPIPE : EBADF;
+      return -1;
+    }
+    f->pos = pos;
+    return 0;
+  }
+
+  int32_t sys_flen(uint32_t handle) {
+    File* f = file(handle);
+    struct stat st;
+    if (!f) {
+      last_errno = EBADF;
+      return -1;
+    }
+    if (fstat(f->fd, &st)) return fail();
+    return int32_t(st.st_size);
+  }
+};
+
+#endif // SEMIHOSTING_H
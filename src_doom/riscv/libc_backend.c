@@ -84,25 +84,62 @@ _sbrk(intptr_t increment)
 
 // File handling
 // -------------
+//
+// Files are the host's, through RISC-V semihosting: run the emulator with
+// --semihosting and the WAD is read from the host file on demand, straight
+// into the buffer DOOM passes, instead of being linked into the image.
 
 #define NUM_FDS		16
 
-/* Flash "filesystem" */
-static struct {
-    const char *name;	/* Filename */
-    size_t      len;	/* Length */
-    void *      addr;	/* Address in flash */
-} fs[2];  // Will be initialized at runtime
+#define SYS_OPEN	0x01
+#define SYS_CLOSE	0x02
+#define SYS_READ	0x06
+#define SYS_SEEK	0x0a
+#define SYS_FLEN	0x0c
+
+#define SH_MODE_RB	1	/* fopen mode "rb" */
+
+static long
+semihost(long op, const void *args)
+{
+    register long a0 asm("a0") = op;
+    register const void *a1 asm("a1") = args;
+
+    /* The three instructions must be uncompressed and within one page */
+    asm volatile(
+        ".option push\n"
+        ".option norvc\n"
+        ".balign 16\n"
+        "slli zero, zero, 0x1f\n"
+        "ebreak\n"
+        "srai zero, zero, 7\n"
+        ".option pop\n"
+        : "+r"(a0) : "r"(a1) : "memory");
+    return a0;
+}
+
+static long
+host_open(const char *pathname)
+{
+    long args[3] = { (long)pathname, SH_MODE_RB, strlen(pathname) };
+    return semihost(SYS_OPEN, args);
+}
+
+static void
+host_close(long handle)
+{
+    semihost(SYS_CLOSE, &handle);
+}
 
 static struct {
     enum {
         FD_NONE  = 0,
         FD_STDIO = 1,
-        FD_FLASH = 2,
+        FD_HOST  = 2,
     } type;
+    long   handle;	/* semihosting file handle */
     size_t offset;
     size_t len;
-    void   *data;
 } fds[NUM_FDS] = {
     [0] = {
         .type = FD_STDIO,
@@ -115,107 +152,11 @@ static struct {
     },
 };
 
-static int fs_initialized = 0;
-
-// External symbols for the embedded WAD file
-extern unsigned char _binary_doom1_real_wad_start;
-extern unsigned char _binary_doom1_real_wad_end;
-
-static void init_fs(void) {
-    if (!fs_initialized) {
-        debug_puts("init_fs: Using REAL DOOM1.WAD\n");
-        
-        // The WAD is embedded at a specific offset in the binary
-        // It should be around 0x80048b20 based on the binary layout
-        unsigned char *wad_start = (unsigned char *)0x80048b20;
-        
-        // Verify it's actually there
-        debug_puts("init_fs: Checking for IWAD at fixed location 0x80048b20...\n");
-        if (wad_start[0] == 'I' && wad_start[1] == 'W' && wad_start[2] == 'A' && wad_start[3] == 'D') {
-            debug_puts("init_fs: Found IWAD at expected location!\n");
-        } else {
-            // If not at expected location, search for it
-            debug_puts("init_fs: IWAD not at expected location, searching...\n");
-            unsigned char *search_start = (unsigned char *)0x80000000;
-            wad_start = NULL;
-            
-            for (uint32_t offset = 0x40000; offset < 0x500000; offset += 4) {
-                unsigned char *test = search_start + offset;
-                if (test[0] == 'I' && test[1] == 'W' && test[2] == 'A' && test[3] == 'D') {
-                    wad_start = test;
-                    debug_puts("init_fs: Found IWAD at ");
-                    debug_hex((unsigned int)wad_start);
-                    debug_puts("\n");
-                    break;
-                }
-            }
-        }
-        
-        if (!wad_start) {
-            debug_puts("init_fs: ERROR - Could not find IWAD magic!\n");
-            wad_start = &_binary_doom1_real_wad_start;  // Fallback
-        }
-        
-        // The WAD size is approximately 4MB
-        uint32_t wad_size = 0x4006B4;  // From ls -l output
-        
-        debug_puts("init_fs: WAD at ");
-        debug_hex((unsigned int)wad_start);
-        debug_puts(", size = ");
-        debug_hex(wad_size);
-        debug_puts(" bytes\n");
-        
-        fs[0].name = "doom1.wad";
-        fs[0].len = wad_size;
-        fs[0].addr = (void*)wad_start;
-        fs[1].name = NULL;
-        
-        // Verify WAD header
-        debug_puts("WAD header: ");
-        for (int i = 0; i < 12; i++) {
-            debug_hex(wad_start[i]);
-            debug_puts(" ");
-        }
-        debug_puts("\n");
-        
-        // Check for IWAD magic
-        if (wad_start[0] == 'I' && wad_start[1] == 'W' && 
-            wad_start[2] == 'A' && wad_start[3] == 'D') {
-            debug_puts("init_fs: Valid IWAD detected!\n");
-        } else {
-            debug_puts("init_fs: WARNING - Invalid WAD magic!\n");
-        }
-        
-        // Initialize FDs 3-15 to FD_NONE (0)
-        for (int i = 3; i < NUM_FDS; i++) {
-            fds[i].type = 0;  // FD_NONE
-        }
-        
-        debug_puts("init_fs: File descriptors initialized\n");
-        fs_initialized = 1;
-        debug_puts("init_fs: COMPLETE - Real WAD loaded\n");
-    }
-}
-
 int
 _open(const char *pathname, int flags)
 {
-    int fn, fd;
-
-    // Initialize filesystem on first use
-    init_fs();
-
-    /* Try to find file */
-    for (fn=0; fs[fn].name; fn++) {
-        if (!strcmp(pathname, fs[fn].name))
-            break;
-    }
-
-    if (!fs[fn].name) {
-        debug_puts("_open: file not found\n");
-        errno = ENOENT;
-        return -1;
-    }
+    long handle;
+    int fd;
 
     /* Find free FD */
     for (fd=3; (fd<NUM_FDS) && (fds[fd].type != FD_NONE); fd++);
@@ -225,32 +166,28 @@ _open(const char *pathname, int flags)
         return -1;
     }
 
-    /* "Open" file */
-    fds[fd].type   = FD_FLASH;
+    handle = host_open(pathname);
+    if (handle < 0) {
+        debug_puts("_open: file not found\n");
+        errno = ENOENT;
+        return -1;
+    }
+
+    fds[fd].type   = FD_HOST;
+    fds[fd].handle = handle;
     fds[fd].offset = 0;
-    fds[fd].len    = fs[fn].len;
-    fds[fd].data   = fs[fn].addr;
+    fds[fd].len    = semihost(SYS_FLEN, &handle);
 
     return fd;
 }
 
-// Track total bytes read
-static unsigned int total_bytes_read = 0;
-static unsigned int read_count = 0;
-
 ssize_t
 _read(int fd, void *buf, size_t nbyte)
 {
-    // Only log first read
-    if (read_count == 1) {
-        debug_puts("_read called: fd=");
-        debug_hex(fd);
-        debug_puts(" nbyte=");
-        debug_hex(nbyte);
-        debug_puts("\n");
-    }
-    
-    if ((fd < 0) || (fd >= NUM_FDS) || (fds[fd].type != FD_FLASH)) {
+    long args[3];
+    long left;
+
+    if ((fd < 0) || (fd >= NUM_FDS) || (fds[fd].type != FD_HOST)) {
         debug_puts("_read: invalid fd ");
         debug_hex(fd);
         debug_puts("\n");
@@ -258,37 +195,19 @@ _read(int fd, void *buf, size_t nbyte)
         return -1;
     }
 
-    if ((fds[fd].offset + nbyte) > fds[fd].len)
-        nbyte = fds[fd].len - fds[fd].offset;
-
-    // Track reads
-    total_bytes_read += nbyte;
-    read_count++;
-    
-    // Only report major milestones
-    if (read_count == 1 || read_count % 500 == 0) {
-        debug_puts("_read #");
-        debug_hex(read_count);
-        debug_puts(": ");
-        debug_hex(nbyte);
-        debug_puts(" bytes\n");
-    }
-
-    // For first read, dump the data being read
-    if (read_count == 1) {
-        debug_puts("First read data: ");
-        unsigned char* data = (unsigned char*)(fds[fd].data + fds[fd].offset);
-        for (int i = 0; i < (nbyte < 16 ? nbyte : 16); i++) {
-            debug_hex(data[i]);
-            debug_puts(" ");
-        }
-        debug_puts("\n");
+    /* SYS_READ returns the number of bytes it did not read, or -1 */
+    args[0] = fds[fd].handle;
+    args[1] = (long)buf;
+    args[2] = nbyte;
+    left = semihost(SYS_READ, args);
+    if ((left < 0) || ((size_t)left > nbyte)) {
+        debug_puts("_read: host read failed\n");
+        errno = EIO;
+        return -1;
     }
+    fds[fd].offset += nbyte - left;
 
-    memcpy(buf, fds[fd].data + fds[fd].offset, nbyte);
-    fds[fd].offset += nbyte;
-
-    return nbyte;
+    return nbyte - left;
 }
 
 ssize_t
@@ -308,6 +227,8 @@ _close(int fd)
         return -1;
     }
 
+    if (fds[fd].type == FD_HOST)
+        host_close(fds[fd].handle);
     fds[fd].type = FD_NONE;
 
     return 0;
@@ -317,8 +238,9 @@ off_t
 _lseek(int fd, off_t offset, int whence)
 {
     size_t new_offset;
+    long args[2];
 
-    if ((fd < 0) || (fd >= NUM_FDS) || (fds[fd].type != FD_FLASH)) {
+    if ((fd < 0) || (fd >= NUM_FDS) || (fds[fd].type != FD_HOST)) {
         errno = EINVAL;
         return -1;
     }
@@ -343,6 +265,12 @@ _lseek(int fd, off_t offset, int whence)
         return -1;
     }
 
+    args[0] = fds[fd].handle;
+    args[1] = new_offset;
+    if (semihost(SYS_SEEK, args) != 0) {
+        errno = EINVAL;
+        return -1;
+    }
     fds[fd].offset = new_offset;
 
     return new_offset;
@@ -381,20 +309,7 @@ _isatty(int fd)
 int
 access(const char *pathname, int mode)
 {
-    int fn;
-
-    // Initialize filesystem on first use
-    init_fs();
-
-    /* Try to find file */
-    for (fn=0; fs[fn].name; fn++)
-        if (!strcmp(pathname, fs[fn].name))
-            break;
-
-    if (!fs[fn].name) {
-        errno = ENOENT;
-        return -1;
-    }
+    long handle;
 
     /* Check requested access */
     if (mode & ~(R_OK | F_OK)) {
@@ -402,6 +317,13 @@ access(const char *pathname, int mode)
         return -1;
     }
 
+    handle = host_open(pathname);
+    if (handle < 0) {
+        errno = ENOENT;
+        return -1;
+    }
+    host_close(handle);
+
     return 0;
 }
 
@@ -0,0 +1,186 @@
+#!/usr/bin/env python3
+# Regenerates the run_checks.sh fixtures in this directory:
+#
+#   random_NN.bin   random RV32IMA programs.  Registers start at random values;
+#                   ALU, M, load/store, branch, jump, AMO, LR/SC and CSR code
+#                   runs in loops (the odd ones long enough to reach the block
+#                   and JIT tiers), then the registers and the data area are
+#                   written to stdout.  Output and exit code must not depend
+#                   on the engine.
+#   harts_counter.bin  for --harts=4: every hart bumps one counter with
+#                   amoadd and another with an LR/SC loop; hart 0 prints "ok"
+#                   and exits 0 if neither lost an update, else exits 1.
+#
+# usage: python3 tests/mkfixtures.py [directory]
+import os
+import random
+import sys
+
+from rvasm import ALU_I, ALU_R, AMO, BR, LOADS, SHI, STORES, Asm
+
+SPECIAL = [0, 1, 0xffffffff, 0x80000000, 0x7fffffff, 2, 31, 32]
+FREE = [i for i in range(1, 32) if i not in (3, 4)]   # gp: data base, tp: loop counter
+DATA = 0x100000
+RANDOM_PROGRAMS = 16
+HARTS, HART_ITERATIONS = 4, 20000
+
+
+def rreg(rng, allow0=True):
+    if allow0 and rng.random() < 0.04:
+        return 0
+    return rng.choice(FREE)
+
+
+def src(rng):
+    return rng.choice([0, 3] + FREE) if rng.random() < 0.15 else rng.choice(FREE)
+
+
+def random_ins(a, rng, labels, pending):
+    k = rng.random()
+    if k < 0.30:
+        a.alu(rng.choice(list(ALU_R)), rreg(rng), src(rng), src(rng))
+    elif k < 0.50:
+        a.alui(rng.choice(list(ALU_I) + list(SHI)), rreg(rng), src(rng), rng.randint(-2048, 2047))
+    elif k < 0.55:
+        (a.lui if rng.random() < 0.5 else a.auipc)(rreg(rng), rng.randint(0, 0xfffff))
+    elif k < 0.58:
+        rd = rreg(rng, False)
+        a.li(rd, rng.randint(0, 0xffffffff))
+    elif k < 0.68:
+        a.load(rng.choice(list(LOADS)), rreg(rng), "gp", rng.randint(0, 2000))
+    elif k < 0.78:
+        a.store(rng.choice(list(STORES)), src(rng), "gp", rng.randint(0, 2000))
+    elif k < 0.86:
+        lab = f"L{labels[0]}"
+        labels[0] += 1
+        a.br(rng.choice(list(BR)), src(rng), src(rng), lab)
+        pending.append([lab, rng.randint(1, 4)])
+    elif k < 0.88:
+        lab = f"L{labels[0]}"
+        labels[0] += 1
+        a.jal(rreg(rng), lab)
+        pending.append([lab, rng.randint(1, 3)])
+    elif k < 0.90:
+        # auipc + jalr to a little way ahead
+        rd = rreg(rng, False)
+        skip = rng.randint(0, 2)
+        a.auipc(rd, 0)
+        a.jalr(rreg(rng), rd, 8 + 4 * skip)
+        for _ in range(skip):
+            a.alui("addi", rreg(rng), src(rng), 1)
+    elif k < 0.93:
+        t = rreg(rng, False)
+        a.alui("addi", t, "gp", 4 * rng.randint(0, 400))
+        op = rng.choice(list(AMO))
+        if op == "lr":
+            a.amo("lr", rreg(rng), t, 0)
+            if rng.random() < 0.7:
+                a.amo("sc", rreg(rng), t, src(rng))
+        else:
+            a.amo(op, rreg(rng), t, src(rng))
+    elif k < 0.95:
+        f3 = rng.choice([1, 2, 3, 5, 6, 7])
+        a.csr(f3, rreg(rng), rng.choice([0x340, 0x341, 0x305]), rng.randint(0, 31) if f3 >= 5 else src(rng))
+    elif k < 0.97:
+        a.csr(2, rreg(rng), rng.choice([0xc00, 0xc02, 0xc80, 0xb00]), 0)   # counters
+    elif k < 0.98:
+        a.fence()
+    else:
+        # slt + branch on the result
+        rd = rreg(rng, False)
+        a.alu(rng.choice(["slt", "sltu"]), rd, src(rng), src(rng))
+        lab = f"L{labels[0]}"
+        labels[0] += 1
+        a.br(rng.choice(["bne", "beq"]), rd, 0, lab)
+        pending.append([lab, rng.randint(1, 3)])
+
+
+def random_program(seed, hot):
+    rng = random.Random(seed)
+    a = Asm(0)
+    for i in FREE:
+        a.li(i, rng.choice(SPECIAL) if rng.random() < 0.3 else rng.randint(0, 0xffffffff))
+    a.li("gp", DATA)
+    labels = [0]
+    for seg in range(rng.randint(3, 10)):
+        pending = []
+        looped = rng.random() < 0.5
+        if looped:
+            a.li("tp", rng.choice([1, 2, 5, 50, 300] + ([2000, 5000] if hot else [])))
+            a.label(f"loop{seg}")
+        for _ in range(rng.randint(1, 25) if looped else rng.randint(5, 60)):
+            random_ins(a, rng, labels, pending)
+            for p in pending:
+                p[1] -= 1
+            for p in [p for p in pending if p[1] <= 0]:
+                a.label(p[0])
+                pending.remove(p)
+        for p in pending:
+            a.label(p[0])
+        if looped:
+            a.alui("addi", "tp", "tp", -1)
+            a.br("bne", "tp", "zero", f"loop{seg}")
+    # write(1, registers + data, ...), exit(0)
+    for i in range(1, 32):
+        a.store("sw", i, "gp", -128 + 4 * i)
+    a.alui("addi", "a1", "gp", -128)
+    a.li("a7", 64)
+    a.li("a0", 1)
+    a.li("a2", 128 + 2048)
+    a.ecall()
+    a.li("a7", 93)
+    a.li("a0", 0)
+    a.ecall()
+    return a.assemble()
+
+
+def harts_counter():
+    a = Asm(0)
+    a.csr(2, "s0", 0xf14, "zero")            # mhartid
+    a.li("s1", HART_ITERATIONS)
+    a.li("s2", DATA)                         # amoadd counter
+    a.alui("addi", "s3", "s2", 64)           # LR/SC counter, in another granule
+    a.alui("addi", "s4", "s2", 128)          # harts done
+    a.li("t0", 1)
+    a.label("loop")
+    a.amo("amoadd", "zero", "s2", "t0")
+    a.label("retry")
+    a.amo("lr", "t1", "s3", "zero")
+    a.alui("addi", "t1", "t1", 1)
+    a.amo("sc", "t2", "s3", "t1")
+    a.br("bne", "t2", "zero", "retry")
+    a.alui("addi", "s1", "s1", -1)
+    a.br("bne", "s1", "zero", "loop")
+    a.amo("amoadd", "zero", "s4", "t0")
+    a.br("bne", "s0", "zero", "exit")
+    a.li("t3", HARTS)
+    a.label("wait")
+    a.load("lw", "t4", "s4", 0)
+    a.br("bne", "t4", "t3", "wait")
+    a.li("a0", 1)
+    a.li("t3", HARTS * HART_ITERATIONS)
+    a.load("lw", "t4", "s2", 0)
+    a.br("bne", "t4", "t3", "exit")
+    a.load("lw", "t4", "s3", 0)
+    a.br("bne", "t4", "t3", "exit")
+    a.li("t3", 0x0a6b6f)                     # "ok\n"
+    a.store("sw", "t3", "s2", 192)
+    a.alui("addi", "a1", "s2", 192)
+    a.li("a7", 64)
+    a.li("a0", 1)
+    a.li("a2", 3)
+    a.ecall()
+    a.li("a0", 0)
+    a.label("exit")
+    a.li("a7", 93)
+    a.ecall()
+    return a.assemble()
+
+
+if __name__ == "__main__":
+    out = sys.argv[1] if len(sys.argv) > 1 else os.path.dirname(os.path.abspath(__file__))
+    for seed in range(1, RANDOM_PROGRAMS + 1):
+        with open(os.path.join(out, f"random_{seed:02d}.bin"), "wb") as f:
+            f.write(random_program(seed, hot=seed % 2 == 1))
+    with open(os.path.join(out, "harts_counter.bin"), "wb") as f:
+        f.write(harts_counter())
@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+# Minimal RV32IMA assembler used by mkfixtures.py.  Programs are built by
+# calling Asm methods; branches and jumps take labels resolved at assemble().
+import struct
+
+REG = {f"x{i}": i for i in range(32)}
+ABI = ["zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2", "s0", "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+       "a6", "a7", "s2", "s3", "s4", "s5", "s6", "s7", "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6"]
+for i, n in enumerate(ABI):
+    REG[n] = i
+
+
+def r(x):
+    return REG[x] if isinstance(x, str) else x
+
+
+def R(op, f3, f7, rd, rs1, rs2):
+    return (f7 << 25) | (r(rs2) << 20) | (r(rs1) << 15) | (f3 << 12) | (r(rd) << 7) | op
+
+
+def I(op, f3, rd, rs1, imm):
+    assert -2048 <= imm < 2048, imm
+    return ((imm & 0xfff) << 20) | (r(rs1) << 15) | (f3 << 12) | (r(rd) << 7) | op
+
+
+def S(op, f3, rs1, rs2, imm):
+    assert -2048 <= imm < 2048, imm
+    imm &= 0xfff
+    return ((imm >> 5) << 25) | (r(rs2) << 20) | (r(rs1) << 15) | (f3 << 12) | ((imm & 0x1f) << 7) | op
+
+
+def B(f3, rs1, rs2, off):
+    assert off % 2 == 0 and -4096 <= off < 4096, off
+    o = off & 0x1fff
+    return (((o >> 12) & 1) << 31) | (((o >> 5) & 0x3f) << 25) | (r(rs2) << 20) | (r(rs1) << 15) | \
+           (f3 << 12) | (((o >> 1) & 0xf) << 8) | (((o >> 11) & 1) << 7) | 0x63
+
+
+def U(op, rd, imm20):
+    return ((imm20 & 0xfffff) << 12) | (r(rd) << 7) | op
+
+
+def J(rd, off):
+    assert off % 2 == 0 and -(1 << 20) <= off < (1 << 20), off
+    o = off & 0x1fffff
+    return (((o >> 20) & 1) << 31) | (((o >> 1) & 0x3ff) << 21) | (((o >> 11) & 1) << 20) | \
+           (((o >> 12) & 0xff) << 12) | (r(rd) << 7) | 0x6f
+
+
+ALU_R = {"add": (0, 0), "sub": (0, 0x20), "sll": (1, 0), "slt": (2, 0), "sltu": (3, 0), "xor": (4, 0),
+         "srl": (5, 0), "sra": (5, 0x20), "or": (6, 0), "and": (7, 0),
+         "mul": (0, 1), "mulh": (1, 1), "mulhsu": (2, 1), "mulhu": (3, 1), "div": (4, 1), "divu": (5, 1),
+         "rem": (6, 1), "remu": (7, 1)}
+ALU_I = {"addi": 0, "slti": 2, "sltiu": 3, "xori": 4, "ori": 6, "andi": 7}
+SHI = {"slli": (1, 0), "srli": (5, 0), "srai": (5, 0x20)}
+LOADS = {"lb": 0, "lh": 1, "lw": 2, "lbu": 4, "lhu": 5}
+STORES = {"sb": 0, "sh": 1, "sw": 2}
+BR = {"beq": 0, "bne": 1, "blt": 4, "bge": 5, "bltu": 6, "bgeu": 7}
+AMO = {"amoadd": 0, "amoswap": 1, "lr": 2, "sc": 3, "amoxor": 4, "amoor": 8, "amoand": 12,
+       "amomin": 16, "amomax": 20, "amominu": 24, "amomaxu": 28}
+
+
+class Asm:
+    def __init__(self, base=0):
+        self.base = base
+        self.words = []      # instruction words, or callables taking the label table
+        self.labels = {}
+
+    def pc(self):
+        return self.base + 4 * len(self.words)
+
+    def label(self, name):
+        self.labels[name] = self.pc()
+
+    def emit(self, w):
+        self.words.append(w)
+
+    def alu(self, op, rd, rs1, rs2):
+        f3, f7 = ALU_R[op]
+        self.emit(R(0x33, f3, f7, rd, rs1, rs2))
+
+    def alui(self, op, rd, rs1, imm):
+        if op in SHI:
+            f3, f7 = SHI[op]
+            self.emit(R(0x13, f3, f7, rd, rs1, imm & 31))
+        else:
+            self.emit(I(0x13, ALU_I[op], rd, rs1, imm))
+
+    def lui(self, rd, imm20): self.emit(U(0x37, rd, imm20))
+    def auipc(self, rd, imm20): self.emit(U(0x17, rd, imm20))
+    def load(self, op, rd, rs1, imm): self.emit(I(0x03, LOADS[op], rd, rs1, imm))
+    def store(self, op, rs2, rs1, imm): self.emit(S(0x23, STORES[op], rs1, rs2, imm))
+    def amo(self, op, rd, rs1, rs2): self.emit(R(0x2f, 2, AMO[op] << 2, rd, rs1, rs2))
+    def csr(self, f3, rd, csr, rs1): self.emit((csr << 20) | (r(rs1) << 15) | (f3 << 12) | (r(rd) << 7) | 0x73)
+    def jalr(self, rd, rs1, imm): self.emit(I(0x67, 0, rd, rs1, imm))
+    def ecall(self): self.emit(0x00000073)
+    def fence(self): self.emit(0x0ff0000f)
+
+    def li(self, rd, v):
+        v &= 0xffffffff
+        sv = v - (1 << 32) if v & 0x80000000 else v
+        if -2048 <= sv < 2048:
+            self.alui("addi", rd, "zero", sv)
+            return
+        lo = v & 0xfff
+        if lo & 0x800:
+            lo -= 0x1000
+        self.lui(rd, ((v - lo) >> 12) & 0xfffff)
+        if lo:
+            self.alui("addi", rd, rd, lo)
+
+    def br(self, op, rs1, rs2, lab):
+        at = self.pc()
+        self.emit(lambda L: B(BR[op], rs1, rs2, L[lab] - at))
+
+    def jal(self, rd, lab):
+        at = self.pc()
+        self.emit(lambda L: J(rd, L[lab] - at))
+
+    def assemble(self):
+        words = [w(self.labels) if callable(w) else w for w in self.words]
+        return b"".join(struct.pack("<I", w & 0xffffffff) for w in words)
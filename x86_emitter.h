@@ -0,0 +1,195 @@
+// Minimal x86-64 machine code emitter for the rv32ima JIT
+// Covers only the instruction forms the translator needs: 32-bit ALU ops,
+// loads/stores with [base + index + disp] addressing, multiply/divide,
+// conditional jumps to labels and absolute calls.
+
+#ifndef X86_EMITTER_H
+#define X86_EMITTER_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <sys/mman.h>
+
+namespace x86 {
+
+enum Reg : uint8_t {
+  RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+  R8, R9, R10, R11, R12, R13, R14, R15
+};
+
+// Condition codes (low nibble of Jcc/SETcc)
+enum Cond : uint8_t {
+  CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_BE = 0x6, CC_A = 0x7,
+  CC_L = 0xc, CC_GE = 0xd, CC_LE = 0xe, CC_G = 0xf
+};
+
+// Two-operand ALU ops; the value is the /digit of the 0x81/0x83 forms
+enum AluOp : uint8_t { ADD = 0, OR = 1, AND = 4, SUB = 5, XOR = 6, CMP = 7 };
+
+// Shift ops; the value is the /digit of the 0xC1/0xD3 forms
+enum ShiftOp : uint8_t { SHL = 4, SHR = 5, SAR = 7 };
+
+// Memory operand [base + index + disp]
+struct Mem {
+  Reg base;
+  Reg index;
+  bool has_index;
+  int32_t disp;
+};
+
+inline Mem ptr(Reg base, int32_t disp = 0) { return {base, RAX, false, disp}; }
+inline Mem ptr(Reg base, Reg index, int32_t disp) { return {base, index, true, disp}; }
+
+struct Label {
+  int pos = -1;                // bound offset, or -1
+  std::vector<int> fixups;     // offsets of rel32 fields waiting for pos
+};
+
+class Emitter {
+ public:
+  Emitter(uint8_t* buf, size_t cap) : buf_(buf), cap_(cap) {}
+
+  size_t size() const { return pos_; }
+  bool overflow() const { return overflow_; }
+
+  // ─── Moves ────────────────────────────────────────────────────────────────
+  void mov(Reg dst, Reg src)             { rex(false, src, 0, dst); byte(0x89); modrm(3, src, dst); }
+  void mov64(Reg dst, Reg src)           { rex(true, src, 0, dst); byte(0x89); modrm(3, src, dst); }
+  void mov(Reg dst, uint32_t imm) {
+    if (imm == 0) { alu(XOR, dst, dst); return; }
+    rex(false, 0, 0, dst); byte(0xb8 + (dst & 7)); dword(imm);
+  }
+  void mov64(Reg dst, uint64_t imm)      { rex(true, 0, 0, dst); byte(0xb8 + (dst & 7)); qword(imm); }
+  void load(Reg dst, const Mem& m)       { rex(false, dst, m); byte(0x8b); modrm_mem(dst, m); }
+  void load64(Reg dst, const Mem& m)     { rex(true, dst, m); byte(0x8b); modrm_mem(dst, m); }
+  void store(const Mem& m, Reg src)      { rex(false, src, m); byte(0x89); modrm_mem(src, m); }
+  void store16(const Mem& m, Reg src)    { byte(0x66); rex(false, src, m); byte(0x89); modrm_mem(src, m); }
+  void store8(const Mem& m, Reg src)     { rex(false, src, m, src >= RSP); byte(0x88); modrm_mem(src, m); }
+  void store_imm(const Mem& m, uint32_t imm) { rex(false, 0, m); byte(0xc7); modrm_mem(0, m); dword(imm); }
+  void movzx8(Reg dst, const Mem& m)     { rex(false, dst, m); byte(0x0f); byte(0xb6); modrm_mem(dst, m); }
+  void movsx8(Reg dst, const Mem& m)     { rex(false, dst, m); byte(0x0f); byte(0xbe); modrm_mem(dst, m); }
+  void movzx16(Reg dst, const Mem& m)    { rex(false, dst, m); byte(0x0f); byte(0xb7); modrm_mem(dst, m); }
+  void movsx16(Reg dst, const Mem& m)    { rex(false, dst, m); byte(0x0f); byte(0xbf); modrm_mem(dst, m); }
+  void movzx8(Reg dst, Reg src)          { rex(false, dst, 0, src, src >= RSP); byte(0x0f); byte(0xb6); modrm(3, dst, src); }
+  void movsxd(Reg dst, Reg src)          { rex(true, dst, 0, src); byte(0x63); modrm(3, dst, src); }
+  void lea(Reg dst, const Mem& m)        { rex(false, dst, m); byte(0x8d); modrm_mem(dst, m); }
+
+  // ─── ALU ──────────────────────────────────────────────────────────────────
+  void alu(AluOp op, Reg dst, Reg src)   { rex(false, src, 0, dst); byte(op * 8 + 1); modrm(3, src, dst); }
+  void alu(AluOp op, Reg dst, const Mem& m) { rex(false, dst, m); byte(op * 8 + 3); modrm_mem(dst, m); }
+  void alu(AluOp op, Reg dst, int32_t imm) {
+    rex(false, 0, 0, dst);
+    if (imm >= -128 && imm <= 127) { byte(0x83); modrm(3, op, dst); byte(imm); }
+    else { byte(0x81); modrm(3, op, dst); dword(imm); }
+  }
+  void add64(Reg dst, const Mem& m)      { rex(true, dst, m); byte(0x03); modrm_mem(dst, m); }
+  void cmp64(Reg a, const Mem& m)        { rex(true, a, m); byte(0x3b); modrm_mem(a, m); }
+  void add64(const Mem& m, int32_t imm) {
+    rex(true, 0, m);
+    if (imm >= -128 && imm <= 127) { byte(0x83); modrm_mem(0, m); byte(imm); }
+    else { byte(0x81); modrm_mem(0, m); dword(imm); }
+  }
+  void test(Reg a, Reg b)                { rex(false, b, 0, a); byte(0x85); modrm(3, b, a); }
+  void test64(Reg a, Reg b)              { rex(true, b, 0, a); byte(0x85); modrm(3, b, a); }
+  void cmp8(const Mem& m, uint8_t imm)   { rex(false, 0, m); byte(0x80); modrm_mem(7, m); byte(imm); }
+  void shift(ShiftOp op, Reg dst, uint8_t imm) { rex(false, 0, 0, dst); byte(0xc1); modrm(3, op, dst); byte(imm); }
+  void shift_cl(ShiftOp op, Reg dst)     { rex(false, 0, 0, dst); byte(0xd3); modrm(3, op, dst); }
+  void shift64(ShiftOp op, Reg dst, uint8_t imm) { rex(true, 0, 0, dst); byte(0xc1); modrm(3, op, dst); byte(imm); }
+  void neg(Reg dst)                      { rex(false, 0, 0, dst); byte(0xf7); modrm(3, 3, dst); }
+  void imul(Reg dst, Reg src)            { rex(false, dst, 0, src); byte(0x0f); byte(0xaf); modrm(3, dst, src); }
+  void imul64(Reg dst, Reg src)          { rex(true, dst, 0, src); byte(0x0f); byte(0xaf); modrm(3, dst, src); }
+  void cdq()                             { byte(0x99); }
+  void div(Reg src)                      { rex(false, 0, 0, src); byte(0xf7); modrm(3, 6, src); }
+  void idiv(Reg src)                     { rex(false, 0, 0, src); byte(0xf7); modrm(3, 7, src); }
+  void setcc(Cond cc, Reg dst)           { rex(false, 0, 0, dst, dst >= RSP); byte(0x0f); byte(0x90 + cc); modrm(3, 0, dst); }
+
+  // ─── Control flow ─────────────────────────────────────────────────────────
+  void jcc(Cond cc, Label& l)            { byte(0x0f); byte(0x80 + cc); rel32(l); }
+  void jmp(Label& l)                     { byte(0xe9); rel32(l); }
+  void jmp(Reg target)                   { rex(false, 0, 0, target); byte(0xff); modrm(3, 4, target); }
+  void call(const void* fn)              { mov64(RAX, (uint64_t)(uintptr_t)fn); byte(0xff); modrm(3, 2, RAX); }
+  void push(Reg r)                       { rex(false, 0, 0, r); byte(0x50 + (r & 7)); }
+  void pop(Reg r)                        { rex(false, 0, 0, r); byte(0x58 + (r & 7)); }
+  void ret()                             { byte(0xc3); }
+  void add_rsp(int8_t imm)               { byte(0x48); byte(0x83); modrm(3, 0, RSP); byte(imm); }
+  void sub_rsp(int8_t imm)               { byte(0x48); byte(0x83); modrm(3, 5, RSP); byte(imm); }
+
+  void bind(Label& l) {
+    l.pos = pos_;
+    for (int at : l.fixups) patch32(at, l.pos - (at + 4));
+    l.fixups.clear();
+  }
+
+ private:
+  uint8_t* buf_;
+  size_t cap_;
+  size_t pos_ = 0;
+  bool overflow_ = false;
+
+  void byte(uint8_t b) {
+    if (pos_ < cap_) buf_[pos_] = b; else overflow_ = true;
+    pos_++;
+  }
+  void dword(uint32_t v) { for (int i = 0; i < 4; i++) byte(v >> (8 * i)); }
+  void qword(uint64_t v) { for (int i = 0; i < 8; i++) byte(v >> (8 * i)); }
+  void patch32(size_t at, int32_t v) { if (at + 4 <= cap_) memcpy(buf_ + at, &v, 4); }
+
+  void rel32(Label& l) {
+    if (l.pos >= 0) { dword(l.pos - int(pos_ + 4)); return; }
+    l.fixups.push_back(pos_);
+    dword(0);
+  }
+
+  // REX prefix for a register/register or register/memory form
+  void rex(bool w, int reg, int index, int base, bool force = false) {
+    uint8_t r = 0x40 | (w << 3) | ((reg >> 3) & 1) << 2 | ((index >> 3) & 1) << 1 | ((base >> 3) & 1);
+    if (r != 0x40 || force) byte(r);
+  }
+  void rex(bool w, int reg, const Mem& m, bool force = false) {
+    rex(w, reg, m.has_index ? m.index : 0, m.base, force);
+  }
+
+  void modrm(int mod, int reg, int rm) { byte((mod << 6) | ((reg & 7) << 3) | (rm & 7)); }
+
+  void modrm_mem(int reg, const Mem& m) {
+    int base = m.base & 7;
+    int mod = (m.disp == 0 && base != 5) ? 0 : (m.disp >= -128 && m.disp <= 127) ? 1 : 2;
+    if (m.has_index || base == 4) {
+      modrm(mod, reg, 4);
+      byte(((m.has_index ? (m.index & 7) : 4) << 3) | base);   // scale 1
+    } else {
+      modrm(mod, reg, base);
+    }
+    if (mod == 1) byte(m.disp);
+    else if (mod == 2) dword(m.disp);
+  }
+};
+
+// Executable memory for generated code.  Functions are appended bump-pointer
+// style and the whole buffer is recycled at once.
+class CodeBuffer {
+ public:
+  explicit CodeBuffer(size_t cap) : cap_(cap) {
+    void* p = mmap(nullptr, cap, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    base_ = (p == MAP_FAILED) ? nullptr : (uint8_t*)p;
+  }
+  ~CodeBuffer() { if (base_) munmap(base_, cap_); }
+  CodeBuffer(const CodeBuffer&) = delete;
+  CodeBuffer& operator=(const CodeBuffer&) = delete;
+
+  bool ok() const { return base_ != nullptr; }
+  uint8_t* cur() const { return base_ + used_; }
+  size_t avail() const { return cap_ - used_; }
+  void commit(size_t n) { used_ += (n + 15) & ~size_t(15); if (used_ > cap_) used_ = cap_; }
+  void reset() { used_ = 0; }
+
+ private:
+  uint8_t* base_ = nullptr;
+  size_t cap_;
+  size_t used_ = 0;
+};
+
+}  // namespace x86
+
+#endif // X86_EMITTER_H